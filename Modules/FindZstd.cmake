@@ -0,0 +1,29 @@
+# - find zstd (Zstandard compression library)
+# ZSTD_INCLUDE_DIR - Where to find zstd.h (directory)
+# ZSTD_LIBRARIES - zstd libraries
+# ZSTD_FOUND - Set to TRUE if we found the library and the header
+#
+
+IF( ZSTD_INCLUDE_DIR AND ZSTD_LIBRARIES )
+    SET(ZSTD_FIND_QUIETLY TRUE)
+ENDIF( ZSTD_INCLUDE_DIR AND ZSTD_LIBRARIES )
+
+FIND_PATH( ZSTD_INCLUDE_DIR zstd.h )
+FIND_LIBRARY( ZSTD_LIBRARIES NAMES zstd )
+
+IF( ZSTD_INCLUDE_DIR AND ZSTD_LIBRARIES )
+        SET( ZSTD_FOUND TRUE )
+ENDIF( ZSTD_INCLUDE_DIR AND ZSTD_LIBRARIES )
+
+IF( ZSTD_FOUND )
+        IF( NOT ZSTD_FIND_QUIETLY )
+                MESSAGE( STATUS "Found zstd header file in ${ZSTD_INCLUDE_DIR}")
+                MESSAGE( STATUS "Found zstd libraries: ${ZSTD_LIBRARIES}")
+        ENDIF( NOT ZSTD_FIND_QUIETLY )
+ELSE( ZSTD_FOUND )
+        IF( ZSTD_FIND_REQUIRED )
+                MESSAGE( FATAL_ERROR "Could not find zstd" )
+        ELSE( ZSTD_FIND_REQUIRED )
+                MESSAGE( STATUS "Optional package zstd was not found" )
+        ENDIF( ZSTD_FIND_REQUIRED )
+ENDIF( ZSTD_FOUND )
@@ -0,0 +1,578 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+// PmssBench: benchmarks for PmssReader and the ingest path. Synthetic files 
+// (see PmssGen) are written to a scratch directory (tmpfs by default, so that 
+// the disk is not measured) and read with different access paths:
+//   rows:    getNextRow only (read, byteswap, boundary check = decode)
+//   items:   getNextRow and getItemInRow for each item of the schema, as
+//            done by DBIngestor (decode and dispatch)
+//   batch:   getNextRows, column-wise (decode, no per-value dispatch)
+//   null:    the complete ingest path (schema mapper, reader with read-ahead
+//            thread, all values fetched as DBIngestor does), but the values 
+//            are discarded instead of being sent to a database
+//   sqlite3: the complete ingest path through DBIngestor into an sqlite3 
+//            file in the scratch directory (only if compiled with sqlite3)
+// for little and big endian files, 100% and 50% particles inside the
+// subbox, several block sizes and all decoding kernels of this CPU.
+// Each measurement is repeated and the fastest run is reported.
+//
+// With --baseline, the rows/s are compared to the ones stored in a file
+// (written by the first run) and the exit status is 1 if any of them 
+// dropped by more than --tolerance.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include <AsserterFactory.h>
+#include <ConverterFactory.h>
+#include <DBIngestor.h>
+#include <DBAdaptorsFactory.h>
+#ifdef DB_SQLITE3
+#include <sqlite3.h>
+#endif
+#include "Pmss_Reader.h"
+#include "Pmss_SchemaMapper.h"
+#include "Pmss_Generator.h"
+#include "pmssingest_error.h"
+#include <boost/program_options.hpp>
+
+using namespace std;
+using namespace Pmss;
+namespace po = boost::program_options;
+
+enum { BENCH_ROWS = 0, BENCH_ITEMS = 1, BENCH_BATCH = 2, BENCH_NULL = 3, BENCH_SQLITE3 = 4, NUM_BENCHES = 5 };
+
+const char * benchNames[] = {"rows", "items", "batch", "null", "sqlite3"};
+
+typedef struct {
+    std::string scratchDir;
+    int queueDepth;     // for the complete ingest path (null, sqlite3)
+    int numRuns;
+    bool verbose;
+} benchSettings;
+
+typedef struct {
+    std::string fileName;
+    bool bigEndian;
+    double inside;
+    int nrecord;
+    long numBytes;
+} benchFile;
+
+typedef struct {
+    long numRows;       // rows handed out (inside the subbox)
+    double seconds;
+    double cycles;
+    double readTime;    // reading data blocks from the file
+    double decodeTime;  // byteswap, boundary check
+    double ingestWait;  // waiting for the read-ahead thread
+    double peakRss;     // MB, highest of all runs
+} benchResult;
+
+
+double wallTime() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + 1.e-6 * tv.tv_usec;
+}
+
+/* time stamp counter (reference cycles), 0 if not available */
+unsigned long long readCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/* Start a new measurement of the peak resident set size (Linux only, 
+ * otherwise the peak of the whole process is reported) */
+void resetPeakRss() {
+    FILE * fp = fopen("/proc/self/clear_refs", "w");
+    if (fp != NULL) {
+        fputs("5", fp);
+        fclose(fp);
+    }
+}
+
+/* Peak resident set size in MB */
+double getPeakRss() {
+    char line[256];
+    long kB = -1;
+    struct rusage usage;
+    FILE * fp;
+
+    fp = fopen("/proc/self/status", "r");
+    if (fp != NULL) {
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            if (strncmp(line, "VmHWM:", 6) == 0) {
+                kB = atol(line + 6);
+            }
+        }
+        fclose(fp);
+    }
+    if (kB < 0) {
+        getrusage(RUSAGE_SELF, &usage);
+        kB = usage.ru_maxrss;
+    }
+
+    return kB / 1024.;
+}
+
+/* The reader prints a line for each data block, which should not be measured */
+int silenceStdout() {
+    int saved;
+    int devNull;
+
+    fflush(stdout);
+    saved = dup(1);
+    devNull = open("/dev/null", O_WRONLY);
+    if (saved < 0 || devNull < 0) {
+        PmssIngest_error("PmssBench: Cannot redirect output.\n");
+    }
+    dup2(devNull, 1);
+    close(devNull);
+    return saved;
+}
+
+void restoreStdout(int saved) {
+    fflush(stdout);
+    dup2(saved, 1);
+    close(saved);
+}
+
+#ifdef DB_SQLITE3
+/* Start with a new database file and create the table for the schema */
+void createSqliteTable(string dbFile, DBDataSchema::Schema * schema, string table) {
+    vector<DBDataSchema::SchemaItem *> & items = schema->getArrSchemaItems();
+    string statement;
+    sqlite3 * db;
+    char * errorMsg = NULL;
+
+    remove(dbFile.c_str());
+    if (sqlite3_open(dbFile.c_str(), &db) != SQLITE_OK) {
+        printf("PmssBench: Could not open %s: %s\n", dbFile.c_str(), sqlite3_errmsg(db));
+        PmssIngest_error("PmssBench: Cannot create sqlite3 database.\n");
+    }
+
+    statement = "create table " + table + " (";
+    for (size_t i = 0; i < items.size(); i++) {
+        DBDataSchema::DType type = items[i]->getDataDesc()->getDataObjDType();
+        statement += (i > 0 ? ", " : "") + items[i]->getColumnName() + 
+            ((type == DBDataSchema::DT_REAL4 || type == DBDataSchema::DT_REAL8) ? " real" : " integer");
+    }
+    statement += ")";
+
+    if (sqlite3_exec(db, statement.c_str(), NULL, NULL, &errorMsg) != SQLITE_OK) {
+        printf("PmssBench: %s: %s\n", statement.c_str(), errorMsg);
+        sqlite3_free(errorMsg);
+        PmssIngest_error("PmssBench: Cannot create sqlite3 table.\n");
+    }
+    sqlite3_close(db);
+}
+#endif
+
+/* Read the whole file once with the given access path */
+void runOnce(benchFile & file, int bench, PmssSchemaMapper * schemaMapper, benchSettings & settings, benchResult & result) {
+    DBDataSchema::Schema * schema;
+    PmssReader * reader;
+    long numRows = 0;
+    long n;
+    size_t i;
+    char value[16];
+    const void * columns[PMSS_NUM_COLUMNS + 16];
+
+    schema = schemaMapper->generateSchema("bench", "bench");
+    vector<DBDataSchema::SchemaItem *> & items = schema->getArrSchemaItems();
+    if (items.size() > PMSS_NUM_COLUMNS + 16) {
+        PmssIngest_error("PmssBench: Too many items in the schema.\n");
+    }
+
+    // byte order of the file is detected from the record markers, as when ingesting
+    reader = new PmssReader(file.fileName, PmssRecordFormat::swapAuto, 0, 1.e11, file.nrecord, 0, -1);
+
+    switch (bench) {
+        case BENCH_ROWS:
+            while (reader->getNextRow()) {
+                numRows++;
+            }
+            break;
+        case BENCH_ITEMS:
+            while (reader->getNextRow()) {
+                for (i = 0; i < items.size(); i++) {
+                    reader->getItemInRow(items[i]->getDataDesc(), true, true, value);
+                }
+                numRows++;
+            }
+            break;
+        case BENCH_BATCH:
+            reader->bindSchema(schema);
+            while ((n = reader->getNextRows(0, columns)) > 0) {
+                numRows += n;
+            }
+            break;
+        case BENCH_NULL:
+            reader->setQueueDepth(settings.queueDepth);
+            while (reader->getNextRow()) {
+                for (i = 0; i < items.size(); i++) {
+                    reader->getItemInRow(items[i]->getDataDesc(), true, true, value);
+                }
+                numRows++;
+            }
+            break;
+#ifdef DB_SQLITE3
+        case BENCH_SQLITE3: {
+            string dbFile = settings.scratchDir + "/PmssBench.sqlite";
+            DBServer::DBAdaptorsFactory adaptorFac;
+            DBServer::DBAbstractor * dbServer;
+            DBIngest::DBIngestor * ingestor;
+
+            createSqliteTable(dbFile, schema, "bench");
+            reader->setQueueDepth(settings.queueDepth);
+
+            dbServer = adaptorFac.getDBAdaptors("sqlite3");
+            ingestor = new DBIngest::DBIngestor(schema, reader, dbServer);
+            ingestor->setHost(dbFile);
+            ingestor->setPerformanceMeter(100000);
+            ingestor->ingestData(128);
+            numRows = reader->getNumRowsInside();
+
+            delete ingestor;
+            delete dbServer;
+            remove(dbFile.c_str());
+            break;
+        }
+#endif
+    }
+
+    result.numRows = numRows;
+    result.readTime = reader->getReadTime();
+    result.decodeTime = reader->getDecodeTime();
+    result.ingestWait = reader->getIngestWait();
+
+    delete reader;
+    delete schema;
+}
+
+benchResult runBench(benchFile & file, int bench, PmssSchemaMapper * schemaMapper, benchSettings & settings) {
+    benchResult result;
+    benchResult thisRun;
+    double startTime, seconds;
+    unsigned long long startCycles, cycles;
+    int saved = -1;
+
+    result.numRows = 0;
+    result.seconds = 0;
+    result.cycles = 0;
+    result.readTime = 0;
+    result.decodeTime = 0;
+    result.ingestWait = 0;
+    result.peakRss = 0;
+
+    for (int run = 0; run < settings.numRuns; run++) {
+        if (!settings.verbose) 
+            saved = silenceStdout();
+
+        resetPeakRss();
+        startTime = wallTime();
+        startCycles = readCycles();
+        runOnce(file, bench, schemaMapper, settings, thisRun);
+        cycles = readCycles() - startCycles;
+        seconds = wallTime() - startTime;
+        thisRun.peakRss = getPeakRss();
+
+        if (!settings.verbose) 
+            restoreStdout(saved);
+
+        if (run == 0 || seconds < result.seconds) {
+            thisRun.seconds = seconds;
+            thisRun.cycles = (double) cycles;
+            thisRun.peakRss = (thisRun.peakRss > result.peakRss) ? thisRun.peakRss : result.peakRss;
+            result = thisRun;
+        } else if (thisRun.peakRss > result.peakRss) {
+            result.peakRss = thisRun.peakRss;
+        }
+    }
+
+    return result;
+}
+
+/* Comma separated list of numbers or names */
+vector<string> splitList(string list) {
+    vector<string> values;
+    string value;
+    stringstream stream(list);
+
+    while (getline(stream, value, ',')) {
+        if (value.length() > 0) 
+            values.push_back(value);
+    }
+    return values;
+}
+
+/* Baseline file: one line per measurement with endian, inside, nrecord, kernel, bench and rows/s */
+map<string, double> readBaseline(string fileName) {
+    map<string, double> baseline;
+    ifstream input(fileName.c_str());
+    string endian, kernel, bench;
+    int inside, nrecord;
+    double rowsPerSec;
+
+    while (input >> endian >> inside >> nrecord >> kernel >> bench >> rowsPerSec) {
+        stringstream key;
+        key << endian << " " << inside << " " << nrecord << " " << kernel << " " << bench;
+        baseline[key.str()] = rowsPerSec;
+    }
+    return baseline;
+}
+
+void writeBaseline(string fileName, map<string, double> & baseline) {
+    ofstream output(fileName.c_str());
+    map<string, double>::iterator it;
+
+    if (!output) {
+        printf("PmssBench: Could not write baseline %s.\n", fileName.c_str());
+        return;
+    }
+    for (it = baseline.begin(); it != baseline.end(); ++it) {
+        output << it->first << " " << (long) it->second << endl;
+    }
+}
+
+int main (int argc, const char * argv[])
+{
+    benchSettings settings;
+    string nrecordList;
+    string kernelList;
+    string benchList;
+    string baselineFile;
+    long numParticles;
+    double tolerance;
+    bool updateBaseline;
+    bool keepFiles;
+    int numRegressions;
+    struct stat st;
+
+#ifdef DB_SQLITE3
+    string defaultBenches = "rows,items,batch,null,sqlite3";
+#else
+    string defaultBenches = "rows,items,batch,null";
+#endif
+
+    po::options_description progDesc("PmssBench - Benchmarks for the PMss reader and the ingest path\n\nPmssBench [OPTIONS]\n\nCommand line options:");
+
+    progDesc.add_options()
+                ("help,?", "output help")
+                ("scratchDir", po::value<string>(&settings.scratchDir)->default_value(""), "directory for the generated files, should be on tmpfs [default: /dev/shm if it exists, else /tmp]")
+                ("numParticles,n", po::value<long>(&numParticles)->default_value(4000000), "number of particles per file [default: 4000000]")
+                ("nrecord", po::value<string>(&nrecordList)->default_value("10000,500000"), "comma separated list of block sizes [default: 10000,500000]")
+                ("decodeKernel", po::value<string>(&kernelList)->default_value("all"), "comma separated list of decoding kernels (auto, scalar, ssse3, avx2), or all supported ones [default: all]")
+                ("bench", po::value<string>(&benchList)->default_value(defaultBenches), ("comma separated list of benchmarks [default: " + defaultBenches + "]").c_str())
+                ("queueDepth", po::value<int32_t>(&settings.queueDepth)->default_value(2), "read-ahead of the reader for null and sqlite3, as in PmssIngest [default: 2]")
+                ("runs", po::value<int32_t>(&settings.numRuns)->default_value(3), "repetitions of each measurement, the fastest one is reported [default: 3]")
+                ("baseline", po::value<string>(&baselineFile)->default_value(""), "compare rows/s with this file, or create it if it does not exist yet [default: none]")
+                ("tolerance", po::value<double>(&tolerance)->default_value(0.1), "allowed drop of rows/s relative to the baseline [default: 0.1]")
+                ("updateBaseline", po::value<bool>(&updateBaseline)->default_value(0), "write the results into the baseline file, even if it exists [default: 0]")
+                ("keepFiles", po::value<bool>(&keepFiles)->default_value(0), "do not delete the generated files at the end [default: 0]")
+                ("verbose", po::value<bool>(&settings.verbose)->default_value(0), "show the output of the reader [default: 0]")
+                ;
+
+    po::variables_map varMap;
+    po::store(po::command_line_parser(argc, (char **) argv).options(progDesc).run(), varMap);
+    po::notify(varMap);
+
+    if (varMap.count("help") || varMap.count("?")) {
+        cout << progDesc;
+        return EXIT_SUCCESS;
+    }
+
+    if (settings.scratchDir.length() == 0) {
+        settings.scratchDir = (stat("/dev/shm", &st) == 0 && S_ISDIR(st.st_mode)) ? "/dev/shm" : "/tmp";
+    }
+    if (settings.numRuns < 1) {
+        settings.numRuns = 1;
+    }
+    if (tolerance < 0 || tolerance >= 1) {
+        PmssIngest_error("PmssBench: tolerance must be between 0 and 1.\n");
+    }
+
+    vector<string> kernels;
+    if (kernelList.compare("all") == 0) {
+        kernels.push_back("scalar");
+        if (PmssBlockDecoder::getKernel() >= PmssBlockDecoder::KERNEL_SSSE3) 
+            kernels.push_back("ssse3");
+        if (PmssBlockDecoder::getKernel() >= PmssBlockDecoder::KERNEL_AVX2) 
+            kernels.push_back("avx2");
+    } else {
+        kernels = splitList(kernelList);
+    }
+    for (size_t i = 0; i < kernels.size(); i++) {
+        if (!PmssBlockDecoder::setKernel(kernels[i])) {
+            printf("Decoding kernel %s is unknown or not supported by this CPU.\n", kernels[i].c_str());
+            PmssIngest_error("PmssBench: Wrong decodeKernel.\n");
+        }
+        kernels[i] = PmssBlockDecoder::getKernelName();
+    }
+
+    vector<int> benches;
+    vector<string> benchNameList = splitList(benchList);
+    for (size_t i = 0; i < benchNameList.size(); i++) {
+        int bench = -1;
+        for (int j = 0; j < NUM_BENCHES; j++) {
+            if (benchNameList[i].compare(benchNames[j]) == 0) 
+                bench = j;
+        }
+#ifndef DB_SQLITE3
+        if (bench == BENCH_SQLITE3) {
+            PmssIngest_error("PmssBench: Compiled without sqlite3, cannot run the sqlite3 benchmark.\n");
+        }
+#endif
+        if (bench < 0) {
+            printf("Unknown benchmark %s.\n", benchNameList[i].c_str());
+            PmssIngest_error("PmssBench: Wrong bench.\n");
+        }
+        benches.push_back(bench);
+    }
+
+    map<string, double> baseline;
+    bool haveBaseline = false;
+    if (baselineFile.length() > 0 && !updateBaseline && stat(baselineFile.c_str(), &st) == 0) {
+        baseline = readBaseline(baselineFile);
+        haveBaseline = true;
+    }
+
+    // one file for each combination of endianness, fraction inside and block size
+    vector<benchFile> files;
+    vector<string> nrecords = splitList(nrecordList);
+    for (int bigEndian = 0; bigEndian < 2; bigEndian++) {
+        for (int half = 0; half < 2; half++) {
+            for (size_t i = 0; i < nrecords.size(); i++) {
+                pmssGenSettings genSettings = PmssGenerator::getDefaults();
+                benchFile file;
+                stringstream name;
+
+                name << "bench_" << (bigEndian ? "be" : "le") << "_" << (half ? 50 : 100) << "_" << nrecords[i];
+                genSettings.outPath = settings.scratchDir;
+                genSettings.name = name.str();
+                genSettings.numParticles = numParticles;
+                genSettings.nrecord = atoi(nrecords[i].c_str());
+                genSettings.bigEndian = bigEndian;
+                genSettings.overlap = half ? 0.5 : 0.;
+                genSettings.firstFile = genSettings.lastFile = 1;
+                if (genSettings.nrecord < 1) {
+                    PmssIngest_error("PmssBench: nrecord must be positive.\n");
+                }
+
+                PmssGenerator generator(genSettings);
+                file.fileName = generator.getFileName(1);
+                file.bigEndian = bigEndian;
+                file.inside = 1. - genSettings.overlap;
+                file.nrecord = genSettings.nrecord;
+                file.numBytes = generator.writeFile(1);
+                files.push_back(file);
+            }
+        }
+    }
+
+    DBAsserter::AsserterFactory * assertFac = new DBAsserter::AsserterFactory;
+    DBConverter::ConverterFactory * convFac = new DBConverter::ConverterFactory;
+    PmssSchemaMapper * schemaMapper = new PmssSchemaMapper(assertFac, convFac);
+
+    // read and decode are measured on the reading side, rest is everything else 
+    // (handing out the values, inserting into the database)
+    numRegressions = 0;
+    printf("\n%-7s %-7s %8s %-7s %-8s %10s %12s %7s %9s %8s %8s %8s %8s\n", "endian", "inside", "nrecord", "kernel", "bench", 
+        "rows", "rows/s", "GB/s", "cyc/part", "read[s]", "dec[s]", "rest[s]", "RSS[MB]");
+    for (size_t f = 0; f < files.size(); f++) {
+        for (size_t k = 0; k < kernels.size(); k++) {
+            PmssBlockDecoder::setKernel(kernels[k]);
+            for (size_t b = 0; b < benches.size(); b++) {
+                int bench = benches[b];
+                benchResult result = runBench(files[f], bench, schemaMapper, settings);
+                double rowsPerSec = result.numRows / result.seconds;
+                double rest = result.seconds - result.readTime - result.decodeTime;
+                stringstream key;
+
+                if ((bench == BENCH_NULL || bench == BENCH_SQLITE3) && settings.queueDepth > 0) {
+                    // reading runs in parallel, so the rest is the time not spent waiting for it
+                    rest = result.seconds - result.ingestWait;
+                }
+
+                // cycles per particle in the file, including the ones outside the subbox
+                printf("%-7s %6.0f%% %8d %-7s %-8s %10ld %12.0f %7.2f %9.1f %8.2f %8.2f %8.2f %8.0f\n", 
+                    files[f].bigEndian ? "big" : "little", 100 * files[f].inside, files[f].nrecord, 
+                    kernels[k].c_str(), benchNames[bench], result.numRows, rowsPerSec, 
+                    files[f].numBytes / 1.e9 / result.seconds, result.cycles / numParticles, 
+                    result.readTime, result.decodeTime, rest, result.peakRss);
+
+                key << (files[f].bigEndian ? "big" : "little") << " " << (int) (100 * files[f].inside + 0.5) << " " 
+                    << files[f].nrecord << " " << kernels[k] << " " << benchNames[bench];
+                if (haveBaseline && baseline.count(key.str()) > 0 && rowsPerSec < (1. - tolerance) * baseline[key.str()]) {
+                    printf("   REGRESSION: %.0f rows/s, baseline %.0f rows/s (%.0f%% slower)\n", rowsPerSec, 
+                        baseline[key.str()], 100. * (1. - rowsPerSec / baseline[key.str()]));
+                    numRegressions++;
+                }
+                if (!haveBaseline) {
+                    baseline[key.str()] = rowsPerSec;
+                }
+                fflush(stdout);
+            }
+        }
+    }
+
+    if (baselineFile.length() > 0) {
+        if (haveBaseline) {
+            printf("\n%d measurement(s) more than %.0f%% slower than the baseline %s.\n", numRegressions, 
+                100 * tolerance, baselineFile.c_str());
+        } else {
+            writeBaseline(baselineFile, baseline);
+            printf("\nWrote baseline %s.\n", baselineFile.c_str());
+        }
+    }
+
+    if (!keepFiles) {
+        for (size_t f = 0; f < files.size(); f++) {
+            remove(files[f].fileName.c_str());
+            remove((files[f].fileName + ".idx").c_str());
+        }
+    }
+
+    delete schemaMapper;
+    delete assertFac;
+    delete convFac;
+
+    return (numRegressions > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,368 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include "Pmss_Generator.h"
+#include "pmssingest_error.h"
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+namespace Pmss {
+
+/* small and fast random numbers (xorshift64*), one generator per file */
+class GenRandom {
+private:
+    unsigned long state;
+
+public:
+    GenRandom(unsigned long seed) {
+        state = seed * 0x9E3779B97F4A7C15UL + 0x2545F4914F6CDD1DUL;
+        if (state == 0) 
+            state = 1;
+    }
+
+    unsigned long next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1DUL;
+    }
+
+    // uniform in [0,1)
+    double uniform() {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    float uniform(float low, float high) {
+        float f = (float) (low + (high - low) * uniform());
+        return (f < high) ? f : low;
+    }
+};
+
+static void swapBytes(char * p, int n) {
+    char tmp;
+    for (int i = 0; i < n / 2; i++) {
+        tmp = p[i];
+        p[i] = p[n - 1 - i];
+        p[n - 1 - i] = tmp;
+    }
+}
+
+static void putInt(char * p, int value, bool bigEndian) {
+    memcpy(p, &value, sizeof(int));
+    if (bigEndian) 
+        swapBytes(p, sizeof(int));
+}
+
+static void putMarker(char * p, long value, int markerSize, bool bigEndian) {
+    int value4 = (int) value;
+
+    if (markerSize == 8) {
+        memcpy(p, &value, sizeof(long));
+    } else {
+        memcpy(p, &value4, sizeof(int));
+    }
+    if (bigEndian) 
+        swapBytes(p, markerSize);
+}
+
+static void putFloat(char * p, float value, bool bigEndian) {
+    memcpy(p, &value, sizeof(float));
+    if (bigEndian) 
+        swapBytes(p, sizeof(float));
+}
+
+static void putLong(char * p, long value, bool bigEndian) {
+    memcpy(p, &value, sizeof(long));
+    if (bigEndian) 
+        swapBytes(p, sizeof(long));
+}
+
+PmssGenerator::PmssGenerator() {
+    settings = getDefaults();
+    nextFile = 0;
+    totalBytes = 0;
+}
+
+PmssGenerator::PmssGenerator(pmssGenSettings newSettings) {
+    settings = newSettings;
+    if (settings.lastFile <= 0) {
+        settings.lastFile = settings.nx * settings.ny * settings.nz;
+    }
+    nextFile = 0;
+    totalBytes = 0;
+}
+
+pmssGenSettings PmssGenerator::getDefaults() {
+    pmssGenSettings defaults;
+
+    defaults.outPath = ".";
+    defaults.name = "synthetic";
+    defaults.box = 1000.;
+    defaults.nx = defaults.ny = defaults.nz = 2;
+    defaults.dBuffer = 5.;
+    defaults.numParticles = 1000000;
+    defaults.nrecord = 500000;
+    defaults.randomRecords = false;
+    defaults.bigEndian = false;
+    defaults.markerSize = 4;
+    defaults.subrecordSize = 2147483639L;
+    defaults.overlap = 0.1;
+    defaults.onBoundary = 0.;
+    defaults.firstFile = 1;
+    defaults.lastFile = 0;
+    defaults.seed = 1;
+
+    return defaults;
+}
+
+std::string PmssGenerator::getFileName(int fileNum) {
+    char name[32];
+    snprintf(name, sizeof(name), "/PMss.%03d_", fileNum);
+    return settings.outPath + name + settings.name + ".DAT";
+}
+
+/* One Fortran record with its markers; with 4-byte markers, records longer 
+ * than subrecordSize are split into subrecords: the leading marker is negative 
+ * if more subrecords follow, the trailing one if previous ones were written. 
+ * Returns the number of bytes written. */
+long PmssGenerator::writeRecord(FILE * fp, const char * data, long length) {
+    char lead[8], trail[8];
+    long numBytes, pos, len;
+    bool ok;
+
+    numBytes = 0;
+    pos = 0;
+    do {
+        len = length - pos;
+        if (settings.markerSize == 4 && len > settings.subrecordSize) 
+            len = settings.subrecordSize;
+
+        putMarker(lead, (pos + len < length) ? -len : len, settings.markerSize, settings.bigEndian);
+        putMarker(trail, (pos > 0) ? -len : len, settings.markerSize, settings.bigEndian);
+
+        ok = (fwrite(lead, settings.markerSize, 1, fp) == 1);
+        ok = ok && (len == 0 || fwrite(data + pos, len, 1, fp) == 1);
+        ok = ok && (fwrite(trail, settings.markerSize, 1, fp) == 1);
+        if (!ok) {
+            PmssIngest_error("PmssGen: Could not write record.\n");
+        }
+
+        numBytes += 2 * settings.markerSize + len;
+        pos += len;
+    } while (pos < length);
+
+    return numBytes;
+}
+
+/* Header as the simulation writes it: the boundaries in the file include the overlap.
+ * Returns the number of bytes written. */
+long PmssGenerator::writeHeader(FILE * fp, int fileNum, float * left, float * right) {
+    pmssHeader header;
+    int * words;
+    size_t i;
+    long numBytes;
+
+    header.ilead1 = header.itrail1 = 6 * sizeof(float);
+    header.aexpn = 1.0;
+    header.Omega0 = 0.307115;
+    header.OmegaL0 = 0.692885;
+    header.hubble = 0.6777;
+    header.box = settings.box;
+    header.particleMass = 1.5e9;
+
+    header.ilead2 = header.itrail2 = 4 * sizeof(int) + sizeof(float) + sizeof(int);
+    header.nodeNum = fileNum;
+    header.nx = settings.nx;
+    header.ny = settings.ny;
+    header.nz = settings.nz;
+    header.dBuffer = settings.dBuffer;
+    header.nBuffer = settings.nrecord;
+
+    header.ilead3 = header.itrail3 = 6 * sizeof(float);
+    header.xL = left[0] - settings.dBuffer;
+    header.xR = right[0] + settings.dBuffer;
+    header.yL = left[1] - settings.dBuffer;
+    header.yR = right[1] + settings.dBuffer;
+    header.zL = left[2] - settings.dBuffer;
+    header.zR = right[2] + settings.dBuffer;
+
+    header.ilead4 = header.itrail4 = sizeof(int);
+    header.np = (int) settings.numParticles;
+
+    // all fields are 4 bytes long
+    if (settings.bigEndian) {
+        words = (int *) &header;
+        for (i = 0; i < sizeof(header) / sizeof(int); i++) {
+            swapBytes((char *) &words[i], sizeof(int));
+        }
+    }
+
+    // the payloads of the four records, their markers are written by writeRecord
+    numBytes = writeRecord(fp, (const char *) &header.aexpn, 6 * sizeof(float));
+    numBytes += writeRecord(fp, (const char *) &header.nodeNum, 4 * sizeof(int) + sizeof(float) + sizeof(int));
+    numBytes += writeRecord(fp, (const char *) &header.xL, 6 * sizeof(float));
+    numBytes += writeRecord(fp, (const char *) &header.np, sizeof(int));
+
+    return numBytes;
+}
+
+/* One particle: mostly inside the subbox, some in the overlap region 
+ * (outside the subbox, but inside the boundaries in the header), 
+ * some exactly on the lower or upper boundary of the subbox */
+static void makeParticle(GenRandom & random, pmssGenSettings & settings, float * left, float * right, float * pos) {
+    double u;
+    int d, dim;
+
+    for (d = 0; d < 3; d++) {
+        pos[d] = random.uniform(left[d], right[d]);
+    }
+
+    u = random.uniform();
+    if (u < settings.onBoundary) {
+        dim = random.next() % 3;
+        pos[dim] = (random.next() & 1) ? right[dim] : left[dim];
+    } else if (u < settings.onBoundary + settings.overlap) {
+        // into the slab on one side of the subbox
+        dim = random.next() % 3;
+        if (random.next() & 1) {
+            pos[dim] = random.uniform(right[dim], right[dim] + settings.dBuffer);
+        } else {
+            pos[dim] = random.uniform(left[dim] - settings.dBuffer, left[dim]);
+        }
+        for (d = 0; d < 3; d++) {
+            if (d != dim) 
+                pos[d] = random.uniform(left[d] - settings.dBuffer, right[d] + settings.dBuffer);
+        }
+    }
+}
+
+/* Write one complete file, returns number of bytes */
+long PmssGenerator::writeFile(int fileNum) {
+    std::string fileName;
+    float left[3], right[3];
+    float pos[3];
+    int i, j, k, nrecord;
+    long n, row, numBytes;
+    std::vector<char> block;
+    char count[sizeof(int)];
+    char * p;
+    FILE * fp;
+
+    // same mapping from file number to subbox as in PmssReader::setBoundary
+    k = (fileNum-1)/(settings.nx*settings.ny)+1;
+    j = (fileNum- (k-1)*settings.nx*settings.ny-1)/settings.nx +1;
+    i = fileNum- (k-1)*settings.nx*settings.ny-(j-1)*settings.nx; 
+    left[0] = (i-1) * (settings.box/settings.nx);
+    right[0] = i * (settings.box/settings.nx);
+    left[1] = (j-1) * (settings.box/settings.ny);
+    right[1] = j * (settings.box/settings.ny);
+    left[2] = (k-1) * (settings.box/settings.nz);
+    right[2] = k * (settings.box/settings.nz);
+
+    fileName = getFileName(fileNum);
+    fp = fopen(fileName.c_str(), "wb");
+    if (fp == NULL) {
+        printf("PmssGen: Could not open %s.\n", fileName.c_str());
+        PmssIngest_error("PmssGen: Cannot write file.\n");
+    }
+
+    numBytes = writeHeader(fp, fileNum, left, right);
+
+    GenRandom random(settings.seed + fileNum);
+    block.resize((long) settings.nrecord * 32);
+
+    n = 0;
+    while (n < settings.numParticles) {
+        nrecord = settings.nrecord;
+        if (settings.randomRecords) {
+            nrecord = 1 + random.next() % settings.nrecord;
+        }
+        if (nrecord > settings.numParticles - n) {
+            nrecord = settings.numParticles - n;
+        }
+
+        // the nrecord record, then the data record
+        putInt(count, nrecord, settings.bigEndian);
+        numBytes += writeRecord(fp, count, sizeof(int));
+
+        p = &block[0];
+        for (row = 0; row < nrecord; row++) {
+            makeParticle(random, settings, left, right, pos);
+            putFloat(p, pos[0], settings.bigEndian);
+            putFloat(p + 4, pos[1], settings.bigEndian);
+            putFloat(p + 8, pos[2], settings.bigEndian);
+            putFloat(p + 12, random.uniform(-1000.f, 1000.f), settings.bigEndian);
+            putFloat(p + 16, random.uniform(-1000.f, 1000.f), settings.bigEndian);
+            putFloat(p + 20, random.uniform(-1000.f, 1000.f), settings.bigEndian);
+            putLong(p + 24, (fileNum - 1) * settings.numParticles + n + row + 1, settings.bigEndian);
+            p += 32;
+        }
+
+        numBytes += writeRecord(fp, &block[0], p - &block[0]);
+        n += nrecord;
+    }
+
+    if (fclose(fp) != 0) {
+        PmssIngest_error("PmssGen: Could not close file.\n");
+    }
+
+    printf("Wrote %s (%ld particles, %ld bytes).\n", fileName.c_str(), settings.numParticles, numBytes);
+
+    return numBytes;
+}
+
+/* Take the next file number until all are done */
+void PmssGenerator::genWorker() {
+    int fileNum;
+    long numBytes;
+
+    while (true) {
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            fileNum = nextFile++;
+        }
+        if (fileNum > settings.lastFile) {
+            break;
+        }
+
+        numBytes = writeFile(fileNum);
+
+        boost::mutex::scoped_lock lock(mutex);
+        totalBytes += numBytes;
+    }
+}
+
+/* Write files firstFile to lastFile, returns the number of bytes written */
+long PmssGenerator::writeFiles(int numThreads) {
+    nextFile = settings.firstFile;
+    totalBytes = 0;
+
+    boost::thread_group workers;
+    for (int i = 0; i < numThreads; i++) {
+        workers.create_thread(boost::bind(&PmssGenerator::genWorker, this));
+    }
+    workers.join_all();
+
+    return totalBytes;
+}
+
+}
@@ -0,0 +1,85 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include <string>
+#include <boost/thread.hpp>
+#include "Pmss_Header.h"
+
+#ifndef Pmss_Pmss_Generator_h
+#define Pmss_Pmss_Generator_h
+
+namespace Pmss {
+
+    // what to generate (set from the command line or by the benchmark)
+    typedef struct {
+        std::string outPath;
+        std::string name;
+        float box;
+        int nx, ny, nz;
+        float dBuffer;
+        long numParticles;  // per file
+        int nrecord;
+        bool randomRecords; // block sizes between 1 and nrecord
+        bool bigEndian;
+        int markerSize;     // bytes of each record marker, 4 or 8 (gfortran -frecord-marker=8)
+        long subrecordSize; // longer records are split into subrecords (4-byte markers only), 
+                            // as by gfortran; smaller than its 2147483639 only for testing readers
+        double overlap;     // fraction of particles in the overlap region
+        double onBoundary;  // fraction of particles exactly on a boundary of the subbox
+        int firstFile;
+        int lastFile;
+        unsigned long seed;
+    } pmssGenSettings;
+
+    // Writes synthetic PMss files (header, then nrecord-blocks and data blocks,
+    // all as Fortran records with record markers), as expected by PmssReader.
+    // The same settings and seed give the same files.
+    class PmssGenerator {
+    private:
+        pmssGenSettings settings;
+
+        // for writing several files in parallel
+        boost::mutex mutex;
+        int nextFile;
+        long totalBytes;
+
+        long writeRecord(FILE * fp, const char * data, long length);
+
+        long writeHeader(FILE * fp, int fileNum, float * left, float * right);
+
+        void genWorker();
+
+    public:
+        PmssGenerator();
+        PmssGenerator(pmssGenSettings newSettings);
+
+        static pmssGenSettings getDefaults();
+
+        std::string getFileName(int fileNum);
+
+        long writeFile(int fileNum);
+
+        long writeFiles(int numThreads);
+    };
+
+}
+
+#endif
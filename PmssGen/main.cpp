@@ -0,0 +1,114 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+// PmssGen: writes synthetic PMss files for testing PmssIngest,
+// see Pmss_Generator.h
+
+#include <iostream>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include "Pmss_Generator.h"
+#include "pmssingest_error.h"
+#include <boost/program_options.hpp>
+
+using namespace std;
+using namespace Pmss;
+namespace po = boost::program_options;
+
+static double wallTime() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + 1.e-6 * tv.tv_usec;
+}
+
+int main (int argc, const char * argv[])
+{
+    pmssGenSettings settings;
+    int numThreads;
+    long totalBytes;
+    double startTime, seconds;
+
+    po::options_description progDesc("PmssGen - Write synthetic PMss files for testing PmssIngest\n\nPmssGen [OPTIONS]\n\nCommand line options:");
+
+    progDesc.add_options()
+                ("help,?", "output help")
+                ("outPath,o", po::value<string>(&settings.outPath)->default_value("."), "directory for the files [default: .]")
+                ("name", po::value<string>(&settings.name)->default_value("synthetic"), "files are named PMss.<fileNum>_<name>.DAT [default: synthetic]")
+                ("box", po::value<float>(&settings.box)->default_value(1000.), "side length of the box [default: 1000]")
+                ("nx", po::value<int32_t>(&settings.nx)->default_value(2), "number of subboxes in x direction [default: 2]")
+                ("ny", po::value<int32_t>(&settings.ny)->default_value(2), "number of subboxes in y direction [default: 2]")
+                ("nz", po::value<int32_t>(&settings.nz)->default_value(2), "number of subboxes in z direction [default: 2]")
+                ("dBuffer", po::value<float>(&settings.dBuffer)->default_value(5.), "overlap at the boundaries [default: 5]")
+                ("numParticles,n", po::value<long>(&settings.numParticles)->default_value(1000000), "number of particles per file [default: 1000000]")
+                ("nrecord", po::value<int32_t>(&settings.nrecord)->default_value(500000), "particles per data block, the last one may be shorter [default: 500000]")
+                ("randomRecords", po::value<bool>(&settings.randomRecords)->default_value(0), "random block sizes between 1 and nrecord [default: 0]")
+                ("bigEndian", po::value<bool>(&settings.bigEndian)->default_value(0), "write big endian files (PmssIngest detects the byte order) [default: 0]")
+                ("recordMarker", po::value<int32_t>(&settings.markerSize)->default_value(4), "bytes of each Fortran record marker, 4 or 8 [default: 4]")
+                ("subrecordSize", po::value<long>(&settings.subrecordSize)->default_value(2147483639L), "split longer records into subrecords as gfortran does, with 4-byte markers; smaller values only for testing readers [default: 2147483639]")
+                ("overlap", po::value<double>(&settings.overlap)->default_value(0.1), "fraction of particles in the overlap region [default: 0.1]")
+                ("onBoundary", po::value<double>(&settings.onBoundary)->default_value(0.), "fraction of particles exactly on a boundary of the subbox [default: 0]")
+                ("firstFile", po::value<int32_t>(&settings.firstFile)->default_value(1), "first file (node) number [default: 1]")
+                ("lastFile", po::value<int32_t>(&settings.lastFile)->default_value(0), "last file (node) number, 0 for nx*ny*nz [default: 0]")
+                ("seed", po::value<unsigned long>(&settings.seed)->default_value(1), "seed for the random numbers [default: 1]")
+                ("threads", po::value<int32_t>(&numThreads)->default_value(1), "number of files written in parallel [default: 1]")
+                ;
+
+    po::variables_map varMap;
+    po::store(po::command_line_parser(argc, (char **) argv).options(progDesc).run(), varMap);
+    po::notify(varMap);
+
+    if (varMap.count("help") || varMap.count("?")) {
+        cout << progDesc;
+        return EXIT_SUCCESS;
+    }
+
+    if (settings.nx < 1 || settings.ny < 1 || settings.nz < 1 || settings.nrecord < 1 || settings.box <= 0) {
+        PmssIngest_error("PmssGen: nx, ny, nz, nrecord and box must be positive.\n");
+    }
+    if (settings.numParticles > 2147483647L) {
+        PmssIngest_error("PmssGen: numParticles must fit into the int field np of the header.\n");
+    }
+    if (settings.markerSize != 4 && settings.markerSize != 8) {
+        PmssIngest_error("PmssGen: recordMarker must be 4 or 8.\n");
+    }
+    if (settings.subrecordSize < 1 || settings.subrecordSize > 2147483639L) {
+        PmssIngest_error("PmssGen: subrecordSize must be between 1 and 2147483639.\n");
+    }
+    if (settings.lastFile <= 0) {
+        settings.lastFile = settings.nx * settings.ny * settings.nz;
+    }
+    if (numThreads < 1) {
+        numThreads = 1;
+    }
+
+    startTime = wallTime();
+
+    PmssGenerator generator(settings);
+    totalBytes = generator.writeFiles(numThreads);
+
+    seconds = wallTime() - startTime;
+    printf("Wrote %d files, %.2f GB in %.1f s (%.2f GB/s).\n", settings.lastFile - settings.firstFile + 1, 
+        totalBytes / 1.e9, seconds, seconds > 0 ? totalBytes / 1.e9 / seconds : 0.);
+
+    return 0;
+}
@@ -0,0 +1,167 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef PMSS_ARROW
+
+#include <DType.h>
+
+#include "Pmss_ArrowWriter.h"
+
+using namespace std;
+using namespace DBDataSchema;
+
+namespace Pmss {
+
+    PmssArrowWriter::PmssArrowWriter(string basePath, long maxFileSize) : PmssBulkWriter(basePath, maxFileSize) {
+        numBuffered = 0;
+        batchSize = 65536;
+    }
+
+    PmssArrowWriter::~PmssArrowWriter() {
+        if (writer) {
+            closeFile();
+        }
+    }
+
+    string PmssArrowWriter::getExtension() {
+        return "arrow";
+    }
+
+    string PmssArrowWriter::getLoadHint(string fileName) {
+        return "pyarrow.ipc.open_file('" + fileName + "').read_all()";
+    }
+
+    bool PmssArrowWriter::openFile(string fileName) {
+        vector<shared_ptr<arrow::Field> > fields;
+        size_t i;
+
+        builders.clear();
+        for (i = 0; i < columnTypes.size(); i++) {
+            switch (columnTypes[i]) {
+                case DT_REAL4:
+                    fields.push_back(arrow::field(columnNames[i], arrow::float32()));
+                    builders.push_back(make_shared<arrow::FloatBuilder>());
+                    break;
+                case DT_REAL8:
+                    fields.push_back(arrow::field(columnNames[i], arrow::float64()));
+                    builders.push_back(make_shared<arrow::DoubleBuilder>());
+                    break;
+                case DT_INT8:
+                    fields.push_back(arrow::field(columnNames[i], arrow::int64()));
+                    builders.push_back(make_shared<arrow::Int64Builder>());
+                    break;
+                default:
+                    fields.push_back(arrow::field(columnNames[i], arrow::int32()));
+                    builders.push_back(make_shared<arrow::Int32Builder>());
+                    break;
+            }
+        }
+        arrowSchema = arrow::schema(fields);
+
+        arrow::Result<shared_ptr<arrow::io::FileOutputStream> > file = arrow::io::FileOutputStream::Open(fileName);
+        if (!file.ok()) {
+            return false;
+        }
+        outFile = *file;
+
+        arrow::Result<shared_ptr<arrow::ipc::RecordBatchWriter> > fileWriter = arrow::ipc::MakeFileWriter(outFile, arrowSchema);
+        if (!fileWriter.ok()) {
+            return false;
+        }
+        writer = *fileWriter;
+        numBuffered = 0;
+
+        return true;
+    }
+
+    bool PmssArrowWriter::writeRow(bulkCell * values, bool * isNull) {
+        arrow::Status status;
+        size_t i;
+
+        for (i = 0; i < columnTypes.size(); i++) {
+            if (isNull[i]) {
+                status = builders[i]->AppendNull();
+            } else {
+                switch (columnTypes[i]) {
+                    case DT_REAL4:
+                        status = static_cast<arrow::FloatBuilder *>(builders[i].get())->Append(values[i].f);
+                        break;
+                    case DT_REAL8:
+                        status = static_cast<arrow::DoubleBuilder *>(builders[i].get())->Append(values[i].d);
+                        break;
+                    case DT_INT8:
+                        status = static_cast<arrow::Int64Builder *>(builders[i].get())->Append(values[i].l);
+                        break;
+                    default:
+                        status = static_cast<arrow::Int32Builder *>(builders[i].get())->Append(values[i].i);
+                        break;
+                }
+            }
+            if (!status.ok()) {
+                return false;
+            }
+            bytesWritten += getByteLenOfDType(columnTypes[i]);
+        }
+
+        numBuffered++;
+        if (numBuffered >= batchSize) {
+            return flush();
+        }
+
+        return true;
+    }
+
+    bool PmssArrowWriter::flush() {
+        vector<shared_ptr<arrow::Array> > arrays;
+        shared_ptr<arrow::Array> array;
+        size_t i;
+
+        if (numBuffered == 0) {
+            return true;
+        }
+
+        for (i = 0; i < builders.size(); i++) {
+            if (!builders[i]->Finish(&array).ok()) {
+                return false;
+            }
+            arrays.push_back(array);
+        }
+
+        shared_ptr<arrow::RecordBatch> batch = arrow::RecordBatch::Make(arrowSchema, numBuffered, arrays);
+        numBuffered = 0;
+
+        return writer->WriteRecordBatch(*batch).ok();
+    }
+
+    bool PmssArrowWriter::closeFile() {
+        bool ok;
+
+        ok = flush();
+        ok = writer->Close().ok() && ok;
+        ok = outFile->Close().ok() && ok;
+        writer.reset();
+        outFile.reset();
+
+        return ok;
+    }
+
+}
+
+#endif
@@ -0,0 +1,65 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+// Only available if the Arrow C++ library was found by cmake
+#ifdef PMSS_ARROW
+
+#include <memory>
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <arrow/ipc/writer.h>
+#include "Pmss_BulkWriter.h"
+
+#ifndef Pmss_Pmss_ArrowWriter_h
+#define Pmss_Pmss_ArrowWriter_h
+
+namespace Pmss {
+
+    // Arrow IPC file (.arrow, aka Feather v2); rows are collected 
+    // and written as record batches of batchSize rows
+    class PmssArrowWriter : public PmssBulkWriter {
+    private:
+        std::shared_ptr<arrow::Schema> arrowSchema;
+        std::shared_ptr<arrow::io::FileOutputStream> outFile;
+        std::shared_ptr<arrow::ipc::RecordBatchWriter> writer;
+        std::vector<std::shared_ptr<arrow::ArrayBuilder> > builders;
+        long numBuffered;
+        long batchSize;
+
+        bool flush();
+
+    protected:
+        bool openFile(std::string fileName);
+        bool writeRow(bulkCell * values, bool * isNull);
+        bool closeFile();
+
+    public:
+        PmssArrowWriter(std::string basePath, long maxFileSize);
+        ~PmssArrowWriter();
+
+        std::string getExtension();
+        std::string getLoadHint(std::string fileName);
+    };
+
+}
+
+#endif
+
+#endif
@@ -0,0 +1,133 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include <sys/time.h>
+
+#include "Pmss_BatchQueue.h"
+#include "Pmss_Metrics.h"
+
+namespace Pmss {
+
+    static double queueTime() {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        return tv.tv_sec + 1.e-6 * tv.tv_usec;
+    }
+
+    PmssBatchQueue::PmssBatchQueue(int queueDepth) {
+        if (queueDepth < 1)
+            queueDepth = 1;
+
+        for (int i = 0; i < queueDepth + 1; i++) {
+            ring.push_back(new PmssParticleBatch());
+        }
+
+        numFilled = 0;
+        numTaken = 0;
+        numReleased = 0;
+        finished = false;
+        stopping = false;
+        producerWait = 0;
+        consumerWait = 0;
+    }
+
+    PmssBatchQueue::~PmssBatchQueue() {
+        for (size_t i = 0; i < ring.size(); i++) 
+            delete ring[i];
+    }
+
+    PmssParticleBatch * PmssBatchQueue::getFree() {
+        double startTime, waited;
+
+        boost::mutex::scoped_lock lock(mutex);
+        if (numFilled - numReleased >= (long) ring.size() && !stopping) {
+            startTime = queueTime();
+            while (numFilled - numReleased >= (long) ring.size() && !stopping) {
+                cond.wait(lock);
+            }
+            waited = queueTime() - startTime;
+            producerWait += waited;
+            PmssMetrics::addTime(TIMER_WAIT_DB, waited);
+        }
+        if (stopping) {
+            return NULL;
+        }
+
+        return ring[numFilled % ring.size()];
+    }
+
+    void PmssBatchQueue::push() {
+        boost::mutex::scoped_lock lock(mutex);
+        numFilled++;
+        cond.notify_all();
+    }
+
+    void PmssBatchQueue::finish() {
+        boost::mutex::scoped_lock lock(mutex);
+        finished = true;
+        cond.notify_all();
+    }
+
+    PmssParticleBatch * PmssBatchQueue::pop() {
+        double startTime, waited;
+
+        boost::mutex::scoped_lock lock(mutex);
+        if (numTaken == numFilled && !finished && !stopping) {
+            startTime = queueTime();
+            while (numTaken == numFilled && !finished && !stopping) {
+                cond.wait(lock);
+            }
+            waited = queueTime() - startTime;
+            consumerWait += waited;
+            PmssMetrics::addTime(TIMER_WAIT_READ, waited);
+        }
+        if (numTaken == numFilled || stopping) {
+            return NULL;
+        }
+
+        return ring[numTaken++ % ring.size()];
+    }
+
+    void PmssBatchQueue::release() {
+        boost::mutex::scoped_lock lock(mutex);
+        if (numReleased < numTaken) {
+            numReleased++;
+            cond.notify_all();
+        }
+    }
+
+    void PmssBatchQueue::stop() {
+        boost::mutex::scoped_lock lock(mutex);
+        stopping = true;
+        cond.notify_all();
+    }
+
+    double PmssBatchQueue::getProducerWait() {
+        boost::mutex::scoped_lock lock(mutex);
+        return producerWait;
+    }
+
+    double PmssBatchQueue::getConsumerWait() {
+        boost::mutex::scoped_lock lock(mutex);
+        return consumerWait;
+    }
+
+}
@@ -0,0 +1,73 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include <vector>
+#include <boost/thread.hpp>
+#include "Pmss_BlockDecoder.h"
+
+#ifndef Pmss_Pmss_BatchQueue_h
+#define Pmss_Pmss_BatchQueue_h
+
+namespace Pmss {
+
+    // Bounded ring of particle batches between one producer thread (reading
+    // and decoding blocks) and one consumer thread (sending rows to the database).
+    // The producer can be up to queueDepth batches ahead of the consumer;
+    // one more batch is held by the consumer while its rows are handed out.
+    // The time each side spends waiting for the other one is recorded.
+    class PmssBatchQueue {
+    private:
+        std::vector<PmssParticleBatch *> ring;
+        long numFilled;     // batches pushed by the producer
+        long numTaken;      // batches popped by the consumer
+        long numReleased;   // batches given back by the consumer
+
+        bool finished;      // producer will not push anything anymore
+        bool stopping;      // consumer does not want anything anymore
+
+        boost::mutex mutex;
+        boost::condition_variable cond;
+
+        double producerWait;    // seconds the producer waited for a free slot
+        double consumerWait;    // seconds the consumer waited for a filled slot
+
+    public:
+        PmssBatchQueue(int queueDepth);
+        ~PmssBatchQueue();
+
+        // producer: get the next free batch (NULL after stop), fill it and push it
+        PmssParticleBatch * getFree();
+        void push();
+        void finish();
+
+        // consumer: next filled batch in order (NULL at the end), 
+        // release it before popping the next one
+        PmssParticleBatch * pop();
+        void release();
+        void stop();
+
+        double getProducerWait();
+        double getConsumerWait();
+    };
+
+}
+
+#endif
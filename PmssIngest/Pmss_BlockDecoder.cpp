@@ -0,0 +1,713 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <boost/thread/once.hpp>
+
+#include "Pmss_BlockDecoder.h"
+#include "Pmss_Metrics.h"
+#include "Pmss_Log.h"
+
+#ifdef PMSS_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace Pmss {
+
+    PmssParticleBatch::PmssParticleBatch() {
+        numRows = 0;
+        numRowsRead = 0;
+        error = false;
+        havePhkey = false;
+        numOnBoundary = 0;
+        firstRow = 0;
+        blockOffset = -1;
+    }
+
+    void PmssParticleBatch::clear() {
+        numRows = 0;
+        numRowsRead = 0;
+        error = false;
+        havePhkey = false;
+        numOnBoundary = 0;
+        firstRow = 0;
+        blockOffset = -1;
+    }
+
+    // make room for n particles; capacity is kept between blocks
+    void PmssParticleBatch::resize(long n) {
+        if ((long) x.size() >= n) {
+            return;
+        }
+        x.resize(n);
+        y.resize(n);
+        z.resize(n);
+        vx.resize(n);
+        vy.resize(n);
+        vz.resize(n);
+        id.resize(n);
+        row.resize(n);
+        fileRowId.resize(n);
+    }
+
+    const void * PmssParticleBatch::getColumn(int column, long pos) const {
+        switch (column) {
+            case PMSS_COL_X: return &x[pos];
+            case PMSS_COL_Y: return &y[pos];
+            case PMSS_COL_Z: return &z[pos];
+            case PMSS_COL_VX: return &vx[pos];
+            case PMSS_COL_VY: return &vy[pos];
+            case PMSS_COL_VZ: return &vz[pos];
+            case PMSS_COL_ID: return &id[pos];
+            case PMSS_COL_FILEROWID: return &fileRowId[pos];
+            case PMSS_COL_PHKEY: return havePhkey ? &phkey[pos] : NULL;
+        }
+        if (column >= PMSS_NUM_COLUMNS && column - PMSS_NUM_COLUMNS < (int) derived.size()) {
+            return &derived[column - PMSS_NUM_COLUMNS][pos];
+        }
+        return NULL;
+    }
+
+
+    static inline int swap4(int i) {
+        unsigned char *cptr,tmp;
+
+        cptr = (unsigned char *) &i;
+        tmp     = cptr[0];
+        cptr[0] = cptr[3];
+        cptr[3] = tmp;
+        tmp     = cptr[1];
+        cptr[1] = cptr[2];
+        cptr[2] = tmp;
+
+        return i;
+    }
+
+    static inline long swap8(long n) {
+        unsigned char *cptr,tmp;
+
+        cptr = (unsigned char *) &n;
+        tmp     = cptr[0];
+        cptr[0] = cptr[7];
+        cptr[7] = tmp;
+        tmp     = cptr[1];
+        cptr[1] = cptr[6];
+        cptr[6] = tmp;
+        tmp     = cptr[2];
+        cptr[2] = cptr[5];
+        cptr[5] = tmp;
+        tmp     = cptr[3];
+        cptr[3] = cptr[4];
+        cptr[4] = tmp;
+
+        return n;
+    }
+
+    // The byte order is a template parameter of the decoding loops, so that 
+    // for files in native order they are a plain typed copy without any swap code.
+    template <bool swapped>
+    static inline float getFloat(const char * memblock) {
+        float f;
+        int i;
+
+        memcpy(&i, memblock, sizeof(int));
+        if (swapped) {
+            i = swap4(i);
+        }
+        memcpy(&f, &i, sizeof(float));
+
+        return f;
+    }
+
+    template <bool swapped>
+    static inline long getLong(const char * memblock) {
+        long n;
+
+        memcpy(&n, memblock, sizeof(long));
+        if (swapped) {
+            n = swap8(n);
+        }
+
+        return n;
+    }
+
+    template <bool swapped>
+    static inline int getInt(const char * memblock) {
+        int i;
+
+        memcpy(&i, memblock, sizeof(int));
+        if (swapped) {
+            i = swap4(i);
+        }
+
+        return i;
+    }
+
+
+    static inline unsigned long mixChecksum(unsigned long h, unsigned long w) {
+        h ^= w;
+        h *= 0x9E3779B97F4A7C15UL;
+        return h ^ (h >> 29);
+    }
+
+
+    PmssBlockDecoder::PmssBlockDecoder() {
+        bswap = 0;
+        xLeft = xRight = yLeft = yRight = zLeft = zRight = 0;
+        fileRowBase = 0;
+    }
+
+    void PmssBlockDecoder::setup(int newBswap, float newXLeft, float newXRight, float newYLeft, float newYRight, 
+                                 float newZLeft, float newZRight, int fileNum, double idfactor) {
+        bswap = newBswap;
+        xLeft = newXLeft;
+        xRight = newXRight;
+        yLeft = newYLeft;
+        yRight = newYRight;
+        zLeft = newZLeft;
+        zRight = newZRight;
+        fileRowBase = fileNum * idfactor;
+    }
+
+    void PmssBlockDecoder::setPhkey(int level, float box) {
+        hilbert.setup(level, box);
+    }
+
+    void PmssBlockDecoder::setRegion(const PmssRegion & newRegion) {
+        region = newRegion;
+    }
+
+    void PmssBlockDecoder::setSample(const PmssSample & newSample) {
+        sample = newSample;
+    }
+
+    void PmssBlockDecoder::setDerived(const PmssDerived & newDerived) {
+        derived = newDerived;
+    }
+
+    void PmssBlockDecoder::derive(PmssParticleBatch & batch) const {
+        const float * fields[6];
+
+        if (derived.size() == 0) {
+            return;
+        }
+        if (batch.numRows == 0) {
+            derived.evaluate(NULL, 0, batch.derived);
+            return;
+        }
+
+        fields[0] = &batch.x[0];
+        fields[1] = &batch.y[0];
+        fields[2] = &batch.z[0];
+        fields[3] = &batch.vx[0];
+        fields[4] = &batch.vy[0];
+        fields[5] = &batch.vz[0];
+        derived.evaluate(fields, batch.numRows, batch.derived);
+    }
+
+    /* Keep those of the first n particles in the batch that are inside the 
+     * region and in the sample */
+    long PmssBlockDecoder::filterSelection(PmssParticleBatch & batch, long n) const {
+        long i, m;
+
+        m = 0;
+        for (i = 0; i < n; i++) {
+            if (region.isSet() && !region.contains(batch.x[i], batch.y[i], batch.z[i])) {
+                continue;
+            }
+            if (sample.isSet() && !sample.contains(batch.id[i])) {
+                continue;
+            }
+            if (m < i) {
+                batch.x[m] = batch.x[i];
+                batch.y[m] = batch.y[i];
+                batch.z[m] = batch.z[i];
+                batch.vx[m] = batch.vx[i];
+                batch.vy[m] = batch.vy[i];
+                batch.vz[m] = batch.vz[i];
+                batch.id[m] = batch.id[i];
+                batch.row[m] = batch.row[i];
+                batch.fileRowId[m] = batch.fileRowId[i];
+            }
+            m++;
+        }
+
+        return m;
+    }
+
+    /* Plain C++ version: one particle after the other. Decodes rows
+     * from..numRows-1, stores particles inside starting at batch position n,
+     * returns the new number of particles in the batch. */
+    template <bool swapped>
+    long PmssBlockDecoder::decodeScalar(const char * data, long from, long numRows, long firstRow, PmssParticleBatch & batch, long n) const {
+        const char * memchunk;
+        float x, y, z;
+        long i;
+
+        for (i = from; i < numRows; i++) {
+            memchunk = data + i * numBytesPerRow;
+
+            x = getFloat<swapped>(&memchunk[0]);
+            y = getFloat<swapped>(&memchunk[sizeof(float)]);
+            z = getFloat<swapped>(&memchunk[2*sizeof(float)]);
+
+            // Check, if values are inside of boundary.
+            // If not: skip this row.
+            if (!(x >= xLeft && x < xRight 
+               && y >= yLeft && y < yRight
+               && z >= zLeft && z < zRight)) {
+                // exactly on the upper face/edge/corner: ingested from the neighbour
+                if (x >= xLeft && x <= xRight 
+                    && y >= yLeft && y <= yRight
+                    && z >= zLeft && z <= zRight) {
+                    batch.numOnBoundary++;
+                }
+                continue;
+            }
+
+            batch.x[n] = x;
+            batch.y[n] = y;
+            batch.z[n] = z;
+            batch.vx[n] = getFloat<swapped>(&memchunk[3*sizeof(float)]);
+            batch.vy[n] = getFloat<swapped>(&memchunk[4*sizeof(float)]);
+            batch.vz[n] = getFloat<swapped>(&memchunk[5*sizeof(float)]);
+            batch.id[n] = getLong<swapped>(&memchunk[6*sizeof(float)]);
+            batch.row[n] = firstRow + i;
+
+            // Create another id from number of file and row.
+            // This helps to check ingestions and remove particles from the
+            // database that were ingested from the same file, if something
+            // went wrong during ingestion process (e.g. connection was lost).
+            batch.fileRowId[n] = (long) (fileRowBase + (firstRow + i));
+            n++;
+        }
+
+        return n;
+    }
+
+#ifdef PMSS_X86_KERNELS
+
+    /* SSSE3 version: one particle (32 bytes) is swapped with two byte 
+     * shuffles, x/y/z are checked with one vector comparison. */
+    template <bool swapped>
+    __attribute__((target("ssse3")))
+    long PmssBlockDecoder::decodeSSSE3(const char * data, long numRows, long firstRow, PmssParticleBatch & batch, long n) const {
+        const __m128i swapFloats = _mm_setr_epi8(3,2,1,0, 7,6,5,4, 11,10,9,8, 15,14,13,12);
+        const __m128i swapFloatsLong = _mm_setr_epi8(3,2,1,0, 7,6,5,4, 15,14,13,12,11,10,9,8);
+        const __m128 lower = _mm_setr_ps(xLeft, yLeft, zLeft, 0.f);
+        const __m128 upper = _mm_setr_ps(xRight, yRight, zRight, 0.f);
+        __m128i a, b;
+        __m128 v;
+        float f[4];
+        long i;
+
+        for (i = 0; i < numRows; i++) {
+            a = _mm_loadu_si128((const __m128i *) (data + i * numBytesPerRow));
+            b = _mm_loadu_si128((const __m128i *) (data + i * numBytesPerRow + 16));
+            if (swapped) {
+                a = _mm_shuffle_epi8(a, swapFloats);
+                b = _mm_shuffle_epi8(b, swapFloatsLong);
+            }
+
+            v = _mm_castsi128_ps(a);
+            if ((_mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(v, lower), _mm_cmplt_ps(v, upper))) & 7) != 7) {
+                if ((_mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(v, lower), _mm_cmple_ps(v, upper))) & 7) == 7) {
+                    batch.numOnBoundary++;
+                }
+                continue;
+            }
+
+            _mm_storeu_ps(f, v);
+            batch.x[n] = f[0];
+            batch.y[n] = f[1];
+            batch.z[n] = f[2];
+            batch.vx[n] = f[3];
+            _mm_storeu_ps(f, _mm_castsi128_ps(b));
+            batch.vy[n] = f[0];
+            batch.vz[n] = f[1];
+            memcpy(&batch.id[n], &f[2], sizeof(long));
+            batch.row[n] = firstRow + i;
+            batch.fileRowId[n] = (long) (fileRowBase + (firstRow + i));
+            n++;
+        }
+
+        return n;
+    }
+
+    // for each 8-bit mask: indices of the set bits, packed to the left
+    static int compactTable[256][8];
+
+    static bool initCompactTable() {
+        int mask, bit, k;
+
+        for (mask = 0; mask < 256; mask++) {
+            k = 0;
+            for (bit = 0; bit < 8; bit++) {
+                if (mask & (1 << bit)) {
+                    compactTable[mask][k++] = bit;
+                }
+            }
+            while (k < 8) {
+                compactTable[mask][k++] = 0;
+            }
+        }
+        return true;
+    }
+
+    static bool compactTableDone = initCompactTable();
+
+    /* AVX2 version: 8 particles at once. Each particle fills one 256 bit 
+     * register, which is byteswapped with one shuffle. The 8x8 matrix is 
+     * transposed to get x, y, z, ... of the 8 particles in one register each,
+     * the boundary check gives an 8 bit mask and the particles inside are 
+     * packed together with one permutation per column. Needs 8 free entries
+     * at the end of each column of the batch. */
+    template <bool swapped>
+    __attribute__((target("avx2,popcnt")))
+    long PmssBlockDecoder::decodeAVX2(const char * data, long numRows, long firstRow, PmssParticleBatch & batch, long n) const {
+        const __m256i swapMask = _mm256_setr_epi8(3,2,1,0, 7,6,5,4, 11,10,9,8, 15,14,13,12,
+                                                  3,2,1,0, 7,6,5,4, 15,14,13,12,11,10,9,8);
+        const __m256 xl = _mm256_set1_ps(xLeft), xr = _mm256_set1_ps(xRight);
+        const __m256 yl = _mm256_set1_ps(yLeft), yr = _mm256_set1_ps(yRight);
+        const __m256 zl = _mm256_set1_ps(zLeft), zr = _mm256_set1_ps(zRight);
+        __m256 r[8], t[8], c[8], inside, closed;
+        __m256i perm;
+        int idLow[8], idHigh[8];
+        const int * packed;
+        int mask, closedMask, count, k, j;
+        long i;
+        const char * p;
+
+        for (i = 0; i + 8 <= numRows; i += 8) {
+            p = data + i * numBytesPerRow;
+
+            for (j = 0; j < 8; j++) {
+                __m256i row = _mm256_loadu_si256((const __m256i *) (p + j * numBytesPerRow));
+                if (swapped) {
+                    row = _mm256_shuffle_epi8(row, swapMask);
+                }
+                r[j] = _mm256_castsi256_ps(row);
+            }
+
+            // transpose: c[0] = x of all 8 particles, c[1] = y, ..., c[6]/c[7] = low/high half of id
+            t[0] = _mm256_unpacklo_ps(r[0], r[1]);
+            t[1] = _mm256_unpackhi_ps(r[0], r[1]);
+            t[2] = _mm256_unpacklo_ps(r[2], r[3]);
+            t[3] = _mm256_unpackhi_ps(r[2], r[3]);
+            t[4] = _mm256_unpacklo_ps(r[4], r[5]);
+            t[5] = _mm256_unpackhi_ps(r[4], r[5]);
+            t[6] = _mm256_unpacklo_ps(r[6], r[7]);
+            t[7] = _mm256_unpackhi_ps(r[6], r[7]);
+            r[0] = _mm256_shuffle_ps(t[0], t[2], _MM_SHUFFLE(1,0,1,0));
+            r[1] = _mm256_shuffle_ps(t[0], t[2], _MM_SHUFFLE(3,2,3,2));
+            r[2] = _mm256_shuffle_ps(t[1], t[3], _MM_SHUFFLE(1,0,1,0));
+            r[3] = _mm256_shuffle_ps(t[1], t[3], _MM_SHUFFLE(3,2,3,2));
+            r[4] = _mm256_shuffle_ps(t[4], t[6], _MM_SHUFFLE(1,0,1,0));
+            r[5] = _mm256_shuffle_ps(t[4], t[6], _MM_SHUFFLE(3,2,3,2));
+            r[6] = _mm256_shuffle_ps(t[5], t[7], _MM_SHUFFLE(1,0,1,0));
+            r[7] = _mm256_shuffle_ps(t[5], t[7], _MM_SHUFFLE(3,2,3,2));
+            c[0] = _mm256_permute2f128_ps(r[0], r[4], 0x20);
+            c[1] = _mm256_permute2f128_ps(r[1], r[5], 0x20);
+            c[2] = _mm256_permute2f128_ps(r[2], r[6], 0x20);
+            c[3] = _mm256_permute2f128_ps(r[3], r[7], 0x20);
+            c[4] = _mm256_permute2f128_ps(r[0], r[4], 0x31);
+            c[5] = _mm256_permute2f128_ps(r[1], r[5], 0x31);
+            c[6] = _mm256_permute2f128_ps(r[2], r[6], 0x31);
+            c[7] = _mm256_permute2f128_ps(r[3], r[7], 0x31);
+
+            // same comparisons as in decodeScalar (NaN is never inside)
+            inside = _mm256_and_ps(_mm256_cmp_ps(c[0], xl, _CMP_GE_OQ), _mm256_cmp_ps(c[0], xr, _CMP_LT_OQ));
+            inside = _mm256_and_ps(inside, _mm256_and_ps(_mm256_cmp_ps(c[1], yl, _CMP_GE_OQ), _mm256_cmp_ps(c[1], yr, _CMP_LT_OQ)));
+            inside = _mm256_and_ps(inside, _mm256_and_ps(_mm256_cmp_ps(c[2], zl, _CMP_GE_OQ), _mm256_cmp_ps(c[2], zr, _CMP_LT_OQ)));
+            mask = _mm256_movemask_ps(inside);
+
+            // including the upper faces, to count the particles exactly on them
+            closed = _mm256_and_ps(_mm256_cmp_ps(c[0], xl, _CMP_GE_OQ), _mm256_cmp_ps(c[0], xr, _CMP_LE_OQ));
+            closed = _mm256_and_ps(closed, _mm256_and_ps(_mm256_cmp_ps(c[1], yl, _CMP_GE_OQ), _mm256_cmp_ps(c[1], yr, _CMP_LE_OQ)));
+            closed = _mm256_and_ps(closed, _mm256_and_ps(_mm256_cmp_ps(c[2], zl, _CMP_GE_OQ), _mm256_cmp_ps(c[2], zr, _CMP_LE_OQ)));
+            closedMask = _mm256_movemask_ps(closed);
+            if (closedMask != mask) {
+                batch.numOnBoundary += _mm_popcnt_u32(closedMask & ~mask);
+            }
+
+            if (mask == 0) {
+                continue;
+            }
+
+            packed = compactTable[mask];
+            count = _mm_popcnt_u32(mask);
+            perm = _mm256_loadu_si256((const __m256i *) packed);
+
+            _mm256_storeu_ps(&batch.x[n], _mm256_permutevar8x32_ps(c[0], perm));
+            _mm256_storeu_ps(&batch.y[n], _mm256_permutevar8x32_ps(c[1], perm));
+            _mm256_storeu_ps(&batch.z[n], _mm256_permutevar8x32_ps(c[2], perm));
+            _mm256_storeu_ps(&batch.vx[n], _mm256_permutevar8x32_ps(c[3], perm));
+            _mm256_storeu_ps(&batch.vy[n], _mm256_permutevar8x32_ps(c[4], perm));
+            _mm256_storeu_ps(&batch.vz[n], _mm256_permutevar8x32_ps(c[5], perm));
+
+            _mm256_storeu_si256((__m256i *) idLow, _mm256_castps_si256(c[6]));
+            _mm256_storeu_si256((__m256i *) idHigh, _mm256_castps_si256(c[7]));
+            for (k = 0; k < count; k++) {
+                j = packed[k];
+                batch.id[n+k] = (long) (((unsigned long) (unsigned int) idHigh[j] << 32) | (unsigned int) idLow[j]);
+                batch.row[n+k] = firstRow + i + j;
+                batch.fileRowId[n+k] = (long) (fileRowBase + (firstRow + i + j));
+            }
+            n += count;
+        }
+
+        // the last few particles one by one
+        return decodeScalar<swapped>(data, i, numRows, firstRow, batch, n);
+    }
+
+#endif
+
+    int PmssBlockDecoder::bestKernel = KERNEL_SCALAR;
+    int PmssBlockDecoder::selectedKernel = KERNEL_SCALAR;
+
+    static boost::once_flag detectKernelOnce = BOOST_ONCE_INIT;
+
+    /* Find out once which decoding kernel this CPU can use (called through 
+     * boost::call_once, decoding threads may ask at the same time) */
+    void PmssBlockDecoder::detectKernel() {
+        bestKernel = KERNEL_SCALAR;
+#ifdef PMSS_X86_KERNELS
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+            bestKernel = KERNEL_AVX2;
+        } else if (__builtin_cpu_supports("ssse3")) {
+            bestKernel = KERNEL_SSSE3;
+        }
+#endif
+        selectedKernel = bestKernel;
+    }
+
+    int PmssBlockDecoder::getKernel() {
+        boost::call_once(&PmssBlockDecoder::detectKernel, detectKernelOnce);
+        return selectedKernel;
+    }
+
+    /* Use the given kernel ("scalar", "ssse3", "avx2" or "auto"), if the CPU can do it.
+     * Returns false if it is not available. Call it before any decoding threads 
+     * are started, they only read the selected kernel. */
+    bool PmssBlockDecoder::setKernel(std::string name) {
+        int best;
+
+        boost::call_once(&PmssBlockDecoder::detectKernel, detectKernelOnce);
+        best = bestKernel;
+
+        if (name.compare("auto") == 0) {
+            selectedKernel = best;
+        } else if (name.compare("scalar") == 0) {
+            selectedKernel = KERNEL_SCALAR;
+        } else if (name.compare("ssse3") == 0 && best >= KERNEL_SSSE3) {
+            selectedKernel = KERNEL_SSSE3;
+        } else if (name.compare("avx2") == 0 && best >= KERNEL_AVX2) {
+            selectedKernel = KERNEL_AVX2;
+        } else {
+            return false;
+        }
+
+        return true;
+    }
+
+    const char * PmssBlockDecoder::getKernelName() {
+        switch (getKernel()) {
+            case KERNEL_AVX2:
+                return "avx2";
+            case KERNEL_SSSE3:
+                return "ssse3";
+            default:
+                return "scalar";
+        }
+    }
+
+    void PmssBlockDecoder::decode(const char * data, long numRows, long firstRow, PmssParticleBatch & batch) const {
+        long n;
+
+        batch.clear();
+        // room for vector stores beyond the last particle
+        batch.resize(numRows + 8);
+
+        switch (getKernel()) {
+#ifdef PMSS_X86_KERNELS
+            case KERNEL_AVX2:
+                n = bswap ? decodeAVX2<true>(data, numRows, firstRow, batch, 0)
+                          : decodeAVX2<false>(data, numRows, firstRow, batch, 0);
+                break;
+            case KERNEL_SSSE3:
+                n = bswap ? decodeSSSE3<true>(data, numRows, firstRow, batch, 0)
+                          : decodeSSSE3<false>(data, numRows, firstRow, batch, 0);
+                break;
+#endif
+            default:
+                n = bswap ? decodeScalar<true>(data, 0, numRows, firstRow, batch, 0)
+                          : decodeScalar<false>(data, 0, numRows, firstRow, batch, 0);
+                break;
+        }
+
+        if (region.isSet() || sample.isSet()) {
+            n = filterSelection(batch, n);
+        }
+
+        batch.numRows = n;
+        batch.numRowsRead = numRows;
+        batch.firstRow = firstRow;
+
+        PmssMetrics::count(METRIC_ROWS_DECODED, numRows);
+        PmssMetrics::count(METRIC_ROWS_INSIDE, n);
+        PmssMetrics::count(METRIC_ROWS_REJECTED, numRows - n);
+        PmssMetrics::count(METRIC_ROWS_ON_BOUNDARY, batch.numOnBoundary);
+
+        // keys only for the particles inside
+        if (hilbert.getLevel() > 0) {
+            if ((long) batch.phkey.size() < n) 
+                batch.phkey.resize(batch.x.size());
+            hilbert.getKeys(&batch.x[0], &batch.y[0], &batch.z[0], n, &batch.phkey[0]);
+            batch.havePhkey = true;
+        }
+
+        derive(batch);
+    }
+
+    /* Check the raw values of numRows rows for a validation pass, without 
+     * storing them: NaN/infinite values, positions outside of the file 
+     * boundaries and a checksum over all values after byteswap */
+    void PmssBlockDecoder::check(const char * data, long numRows, long firstRow, int bswap, 
+                                 const float * fileBoundary, pmssBlockCheck & result) {
+        if (bswap) {
+            checkRows<true>(data, numRows, firstRow, fileBoundary, result);
+        } else {
+            checkRows<false>(data, numRows, firstRow, fileBoundary, result);
+        }
+    }
+
+    template <bool swapped>
+    void PmssBlockDecoder::checkRows(const char * data, long numRows, long firstRow, 
+                                     const float * fileBoundary, pmssBlockCheck & result) {
+        const char * memchunk;
+        unsigned int w[6];
+        float pos[3];
+        unsigned long h;
+        long i;
+        int j;
+        bool bad;
+
+        h = result.checksum;
+        for (i = 0; i < numRows; i++) {
+            memchunk = data + i * numBytesPerRow;
+
+            bad = false;
+            for (j = 0; j < 6; j++) {
+                w[j] = (unsigned int) getInt<swapped>(&memchunk[j*sizeof(float)]);
+                // exponent bits all set: infinite or NaN
+                if ((w[j] & 0x7f800000u) == 0x7f800000u) 
+                    bad = true;
+            }
+            h = mixChecksum(h, (unsigned long) w[0] | ((unsigned long) w[1] << 32));
+            h = mixChecksum(h, (unsigned long) w[2] | ((unsigned long) w[3] << 32));
+            h = mixChecksum(h, (unsigned long) w[4] | ((unsigned long) w[5] << 32));
+            h = mixChecksum(h, (unsigned long) getLong<swapped>(&memchunk[6*sizeof(float)]));
+
+            if (bad) {
+                if (result.numNonFinite++ == 0) 
+                    result.firstNonFinite = firstRow + i;
+                continue;
+            }
+            memcpy(pos, w, sizeof(pos));
+            if (!(pos[0] >= fileBoundary[0] && pos[0] <= fileBoundary[1]
+               && pos[1] >= fileBoundary[2] && pos[1] <= fileBoundary[3]
+               && pos[2] >= fileBoundary[4] && pos[2] <= fileBoundary[5])) {
+                if (result.numOutside++ == 0) 
+                    result.firstOutside = firstRow + i;
+            }
+        }
+        result.checksum = h;
+    }
+
+    /* Keep the reason why a data block could not be fetched */
+    static const char * blockError(std::string * error, const char * format, ...) {
+        char message[256];
+        va_list args;
+
+        va_start(args, format);
+        vsnprintf(message, sizeof(message), format, args);
+        va_end(args);
+
+        *error = message;
+
+        return NULL;
+    }
+
+    const char * PmssBlockDecoder::fetchBlock(PmssFileSource * source, const PmssRecordFormat & format, long * nrecord, 
+                                              std::vector<char> & buffer, bool verbose, std::string * error) {
+        const char * blockData;
+        std::string reason;
+        long datasize, length;
+        long startPos;
+
+        *error = "";
+        startPos = source->tell();
+        if (verbose) {
+            PmssLog(PMSS_LOG_DEBUG, "Skipping nrecord-header for next data block.\n");
+        }
+
+        // the record with nrecord
+        if (!format.readCount(source, buffer, nrecord, &reason)) {
+            if (reason.length() == 0) {
+                if (verbose) {
+                    PmssLog(PMSS_LOG_INFO, "End of file reached.\n");
+                }
+                return NULL;
+            }
+            return blockError(error, "%s", reason.c_str());
+        }
+
+        if (verbose) {
+            PmssLog(PMSS_LOG_DEBUG, "nrecord: %ld\n", *nrecord);
+        }
+        if (*nrecord <= 0) {
+            return blockError(error, "nrecord is %ld and not > 0", *nrecord);
+        }
+
+        // the whole data block (joined, if it is split into subrecords)
+        datasize = *nrecord * (long) numBytesPerRow;
+        blockData = format.readRecord(source, buffer, &length, &reason);
+        if (blockData == NULL) {
+            if (reason.length() == 0) {
+                reason = "data block is incomplete, file seems to be truncated.";
+            }
+            return blockError(error, "%s", reason.c_str());
+        }
+        if (length != datasize) {
+            return blockError(error, "block size (%ld) does not agree with nrecord*numBytesPerRow (%ld).",
+                length, datasize);
+        }
+
+        // all markers, the count and the data (also with 8-byte markers or subrecords)
+        PmssMetrics::count(METRIC_BYTES_READ, source->tell() - startPos);
+        PmssMetrics::count(METRIC_BLOCKS_READ, 1);
+
+        return blockData;
+    }
+
+}
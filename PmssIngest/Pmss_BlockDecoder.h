@@ -0,0 +1,187 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <vector>
+#include <string>
+#include "Pmss_FileSource.h"
+#include "Pmss_Record.h"
+#include "Pmss_Hilbert.h"
+#include "Pmss_Region.h"
+#include "Pmss_Sample.h"
+#include "Pmss_Derived.h"
+
+#ifndef Pmss_Pmss_BlockDecoder_h
+#define Pmss_Pmss_BlockDecoder_h
+
+// vectorized decoding kernels for x86 (selected at runtime, see PmssBlockDecoder::getKernel)
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PMSS_X86_KERNELS
+#endif
+
+namespace Pmss {
+
+    // columns of the particle table, in the order of the schema ("Col1" ... "Col9");
+    // derived columns follow as PMSS_NUM_COLUMNS + i ("Col10", ...)
+    enum pmssColumn {
+        PMSS_COL_X = 0,
+        PMSS_COL_Y,
+        PMSS_COL_Z,
+        PMSS_COL_VX,
+        PMSS_COL_VY,
+        PMSS_COL_VZ,
+        PMSS_COL_ID,
+        PMSS_COL_PHKEY,
+        PMSS_COL_FILEROWID,
+        PMSS_NUM_COLUMNS
+    };
+
+    // Decoded particles of (a part of) one data block, one array per column.
+    // Only particles inside the boundaries are stored.
+    class PmssParticleBatch {
+    public:
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> z;
+        std::vector<float> vx;
+        std::vector<float> vy;
+        std::vector<float> vz;
+        std::vector<long> id;
+        std::vector<long> row;          // row number in file
+        std::vector<long> fileRowId;
+        std::vector<int> phkey;         // only filled if havePhkey
+        std::vector<std::vector<float> > derived;  // one array per derived column
+
+        long numRows;       // number of particles stored in the batch
+        long numRowsRead;   // number of particles read from file for this batch
+        bool error;         // block could not be read, stop here
+        bool havePhkey;     // Peano-Hilbert keys were computed
+        long numOnBoundary; // particles skipped, because they lie exactly on an
+                            // upper boundary (i.e. belong to the neighbouring file)
+        long firstRow;      // row number in file of the first particle read
+        long blockOffset;   // file offset of the data block, if the batch starts 
+                            // with its first row (else -1); a point to resume from
+
+        PmssParticleBatch();
+
+        void clear();
+        void resize(long n);
+
+        // array of one column (see pmssColumn), starting at particle pos;
+        // NULL if the column is not stored in the batch
+        const void * getColumn(int column, long pos) const;
+    };
+
+
+    // What a validation pass finds in the raw rows of data blocks
+    typedef struct {
+        long numNonFinite;      // rows with a NaN or infinite value
+        long numOutside;        // rows with a position outside of the file boundaries (incl. overlap)
+        long firstNonFinite;    // row number in file of the first of these, -1 if none
+        long firstOutside;
+        unsigned long checksum; // over all values in file order, the same for either byte order
+    } pmssBlockCheck;
+
+
+    // Converts raw data blocks into particle batches: byteswap (if needed),
+    // check boundaries, construct fileRowId (and phkey, if a level is set).
+    // Does not change any state while decoding, so one decoder can be used
+    // by several threads at once.
+    // Depending on the CPU, a vectorized kernel (SSSE3, AVX2) is used,
+    // all kernels give exactly the same results.
+    class PmssBlockDecoder {
+    private:
+        int bswap;
+        float xLeft, xRight, yLeft, yRight, zLeft, zRight;
+        double fileRowBase;     // fileNum*idfactor
+        PmssHilbert hilbert;    // for phkey, level 0 if not needed
+        PmssRegion region;      // particles must be inside, if set
+        PmssSample sample;      // particles must be in the sample, if set
+        PmssDerived derived;    // extra columns, bound to the header of the file
+
+        // best kernel of this CPU (detected once) and the one in use
+        static int bestKernel;
+        static int selectedKernel;
+
+        static void detectKernel();
+
+        long filterSelection(PmssParticleBatch & batch, long n) const;
+
+        // one version of each kernel per byte order (swapped: file is not in native order)
+        template <bool swapped>
+        long decodeScalar(const char * data, long from, long numRows, long firstRow, PmssParticleBatch & batch, long n) const;
+#ifdef PMSS_X86_KERNELS
+        template <bool swapped>
+        long decodeSSSE3(const char * data, long numRows, long firstRow, PmssParticleBatch & batch, long n) const;
+        template <bool swapped>
+        long decodeAVX2(const char * data, long numRows, long firstRow, PmssParticleBatch & batch, long n) const;
+#endif
+        template <bool swapped>
+        static void checkRows(const char * data, long numRows, long firstRow, 
+                              const float * fileBoundary, pmssBlockCheck & result);
+
+    public:
+        static const int numBytesPerRow = 6*sizeof(float)+1*sizeof(long);
+
+        enum { KERNEL_SCALAR = 0, KERNEL_SSSE3 = 1, KERNEL_AVX2 = 2 };
+
+        static int getKernel();
+        static bool setKernel(std::string name);
+        static const char * getKernelName();
+
+        PmssBlockDecoder();
+
+        void setup(int bswap, float xLeft, float xRight, float yLeft, float yRight, float zLeft, float zRight, 
+                   int fileNum, double idfactor);
+
+        // compute phkey with level bits per dimension (0: phkey stays NULL)
+        void setPhkey(int level, float box);
+
+        // only keep particles inside this region (in addition to the boundaries)
+        void setRegion(const PmssRegion & region);
+
+        // only keep particles in this subsample
+        void setSample(const PmssSample & sample);
+
+        // compute these extra columns (already bound to the header)
+        void setDerived(const PmssDerived & derived);
+
+        // compute the derived columns for the particles in the batch
+        void derive(PmssParticleBatch & batch) const;
+
+        // decode numRows rows starting at data, the first one has the given row number in file
+        void decode(const char * data, long numRows, long firstRow, PmssParticleBatch & batch) const;
+
+        // validation: check numRows raw rows, fileBoundary as xL, xR, yL, yR, zL, zR;
+        // the counters and checksum in result are continued (start with checksum 0)
+        static void check(const char * data, long numRows, long firstRow, int bswap, 
+                          const float * fileBoundary, pmssBlockCheck & result);
+
+        // read nrecord-header and data block at the current position of source,
+        // check the record markers and return pointer to the data (NULL on error/end 
+        // of file), in buffer if the block was split into subrecords;
+        // the reason for an error is stored in error (empty at the end of file), 
+        // the caller decides whether to print it and stop
+        static const char * fetchBlock(PmssFileSource * source, const PmssRecordFormat & format, long * nrecord, 
+                                       std::vector<char> & buffer, bool verbose, std::string * error);
+    };
+
+}
+
+#endif
@@ -0,0 +1,382 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "Pmss_BlockIndex.h"
+#include "Pmss_BlockDecoder.h"
+#include "Pmss_Log.h"
+
+using namespace std;
+
+namespace Pmss {
+
+    // first 8 bytes of a sidecar index file (older versions had no bounds 
+    // or a 32-bit nrecord, they are built again)
+    static const char indexMagic[8] = {'P','M','S','S','I','D','X','3'};
+
+    std::string PmssBlockIndex::indexDir;
+
+    PmssBlockIndex::PmssBlockIndex() {
+        numRows = 0;
+        fileSize = 0;
+        fileTime = 0;
+        haveBounds = false;
+        truncated = false;
+    }
+
+    PmssBlockIndex::~PmssBlockIndex() {
+    }
+
+    bool PmssBlockIndex::statFile(string fileName, long * size, long * mtime) {
+        struct stat st;
+
+        if (stat(fileName.c_str(), &st) != 0) {
+            return false;
+        }
+
+        *size = (long) st.st_size;
+        *mtime = (long) st.st_mtime;
+        return true;
+    }
+
+    /* Jump from block to block, only reading the nrecord-record and the 
+     * marker(s) in front of each data record. A file that ends within a 
+     * data block is indexed up to the last complete block, like the reader 
+     * ingests the complete blocks when reading the file in sequence. */
+    bool PmssBlockIndex::build(PmssFileSource * source, long dataStart, const PmssRecordFormat & format, int numBytesPerRow) {
+        vector<char> buffer;
+        char message[256];
+        string reason;
+        long pos, end, nrecord, datasize, length;
+        long blockStart, countSize;
+        pmssBlockInfo info;
+
+        blocks.clear();
+        numRows = 0;
+        haveBounds = false;
+        truncated = false;
+        error = "";
+
+        // the nrecord-record with markers and a count of up to 8 bytes
+        countSize = 2 * format.getMarkerSize() + sizeof(long);
+
+        end = source->size();
+        pos = dataStart;
+
+        blockStart = pos;
+        while (pos < end) {
+            blockStart = pos;
+            if (!source->seek(pos) || !format.readCount(source, buffer, &nrecord, &reason)) {
+                if (end - pos < countSize) {
+                    truncated = true;
+                    break;
+                }
+                snprintf(message, sizeof(message), "Could not read block header at offset %ld%s%s", pos, 
+                    reason.length() > 0 ? ": " : ".", reason.c_str());
+                error = message;
+                printf("PmssBlockIndex: %s\n", message);
+                return false;
+            }
+
+            info.firstRow = numRows;
+            info.offset = pos;
+            info.nrecord = nrecord;
+            memset(info.bounds, 0, sizeof(info.bounds));
+
+            // behind the nrecord-record, to the end of the data record
+            pos = source->tell();
+            if (!format.skipRecord(source, &pos, &length, &reason)) {
+                if (pos + format.getMarkerSize() > end) {
+                    truncated = true;
+                    break;
+                }
+                error = reason;
+                printf("PmssBlockIndex: %s\n", error.c_str());
+                return false;
+            }
+            if (pos > end) {
+                truncated = true;
+                break;
+            }
+
+            datasize = nrecord * (long) numBytesPerRow;
+            if (nrecord <= 0 || length != datasize) {
+                snprintf(message, sizeof(message), "Unexpected block header at offset %ld (nrecord %ld, %ld bytes of data).", 
+                    info.offset, nrecord, length);
+                error = message;
+                printf("PmssBlockIndex: %s\n", message);
+                return false;
+            }
+
+            blocks.push_back(info);
+            numRows += nrecord;
+        }
+
+        if (truncated) {
+            // only the complete blocks stay in the table
+            snprintf(message, sizeof(message), "File is truncated in the data block at offset %ld, using the %ld complete blocks (%ld rows).", 
+                blockStart, (long) blocks.size(), numRows);
+            error = message;
+            PmssLog(PMSS_LOG_WARN, "Warning: PmssBlockIndex: %s\n", message);
+        }
+
+        source->seek(dataStart);
+
+        return true;
+    }
+
+    /* Read the data of each block and keep the smallest and largest x, y, z */
+    bool PmssBlockIndex::buildBounds(PmssFileSource * source, const PmssRecordFormat & format, int numBytesPerRow) {
+        vector<char> buffer;
+        string reason;
+        const char * data;
+        float pos[3];
+        unsigned char * c;
+        unsigned char tmp;
+        long nrecord;
+        size_t i;
+        long j;
+        int k;
+
+        for (i = 0; i < blocks.size(); i++) {
+            pmssBlockInfo & info = blocks[i];
+
+            if (!source->seek(info.offset)
+                || (data = PmssBlockDecoder::fetchBlock(source, format, &nrecord, buffer, false, &reason)) == NULL
+                || nrecord != info.nrecord) {
+                printf("PmssBlockIndex: Could not read data block at offset %ld%s%s\n", info.offset, 
+                    reason.length() > 0 ? ": " : ".", reason.c_str());
+                return false;
+            }
+
+            for (j = 0; j < info.nrecord; j++) {
+                memcpy(pos, data + j * numBytesPerRow, sizeof(pos));
+                for (k = 0; k < 3; k++) {
+                    if (format.getSwap()) {
+                        c = (unsigned char *) &pos[k];
+                        tmp = c[0]; c[0] = c[3]; c[3] = tmp;
+                        tmp = c[1]; c[1] = c[2]; c[2] = tmp;
+                    }
+                    if (j == 0 || pos[k] < info.bounds[2*k]) 
+                        info.bounds[2*k] = pos[k];
+                    if (j == 0 || pos[k] > info.bounds[2*k+1]) 
+                        info.bounds[2*k+1] = pos[k];
+                }
+            }
+        }
+
+        haveBounds = true;
+        return true;
+    }
+
+    bool PmssBlockIndex::load(string indexFileName, string dataFileName) {
+        FILE * fp;
+        char magic[8];
+        long header[5];
+        long size, mtime;
+
+        if (!statFile(dataFileName, &size, &mtime)) {
+            return false;
+        }
+
+        fp = fopen(indexFileName.c_str(), "rb");
+        if (fp == NULL) {
+            return false;
+        }
+
+        // magic, file size, modification time, number of blocks, number of rows, bounds known
+        if (fread(magic, sizeof(magic), 1, fp) != 1 || memcmp(magic, indexMagic, sizeof(magic)) != 0
+            || fread(header, sizeof(header), 1, fp) != 1
+            || header[0] != size || header[1] != mtime || header[2] < 0) {
+            fclose(fp);
+            return false;
+        }
+
+        blocks.resize(header[2]);
+        if (header[2] > 0 && fread(&blocks[0], sizeof(pmssBlockInfo), header[2], fp) != (size_t) header[2]) {
+            blocks.clear();
+            fclose(fp);
+            return false;
+        }
+        fclose(fp);
+
+        fileSize = size;
+        fileTime = mtime;
+        numRows = header[3];
+        haveBounds = (header[4] != 0);
+
+        return true;
+    }
+
+    /* Written to a temporary file, synced and renamed, so that a crash or 
+     * several workers writing the index of the same file (fileParts) never 
+     * leave a half-written sidecar */
+    bool PmssBlockIndex::save(string indexFileName, string dataFileName) {
+        vector<char> tmpName(indexFileName.begin(), indexFileName.end());
+        const char * suffix = ".XXXXXX";
+        FILE * fp;
+        long header[5];
+        bool ok;
+        int fd;
+
+        if (!statFile(dataFileName, &fileSize, &fileTime)) {
+            return false;
+        }
+
+        tmpName.insert(tmpName.end(), suffix, suffix + strlen(suffix) + 1);
+        fd = mkstemp(&tmpName[0]);
+        if (fd < 0) {
+            return false;
+        }
+        fp = fdopen(fd, "wb");
+        if (fp == NULL) {
+            close(fd);
+            remove(&tmpName[0]);
+            return false;
+        }
+
+        header[0] = fileSize;
+        header[1] = fileTime;
+        header[2] = (long) blocks.size();
+        header[3] = numRows;
+        header[4] = haveBounds ? 1 : 0;
+
+        ok = (fwrite(indexMagic, sizeof(indexMagic), 1, fp) == 1)
+            && (fwrite(header, sizeof(header), 1, fp) == 1);
+        if (ok && blocks.size() > 0) {
+            ok = (fwrite(&blocks[0], sizeof(pmssBlockInfo), blocks.size(), fp) == blocks.size());
+        }
+        ok = ok && (fflush(fp) == 0 && fsync(fileno(fp)) == 0);
+        ok = (fclose(fp) == 0) && ok;
+        ok = ok && (rename(&tmpName[0], indexFileName.c_str()) == 0);
+
+        if (!ok) {
+            remove(&tmpName[0]);
+            return false;
+        }
+
+        return true;
+    }
+
+    void PmssBlockIndex::setIndexDir(string dir) {
+        indexDir = dir;
+    }
+
+    string PmssBlockIndex::getIndexFileName(string dataFileName) {
+        size_t pos;
+
+        if (indexDir.length() == 0) {
+            return dataFileName + ".idx";
+        }
+        if (indexDir.compare("none") == 0) {
+            return "";
+        }
+
+        // named after the data file, like the journal; the size and modification 
+        // time in it tell whether it belongs to this data file
+        pos = dataFileName.find_last_of('/');
+        return indexDir + "/" + ((pos == string::npos) ? dataFileName : dataFileName.substr(pos + 1)) + ".idx";
+    }
+
+    bool PmssBlockIndex::loadOrBuild(string dataFileName, PmssFileSource * source, long dataStart, const PmssRecordFormat & format, int numBytesPerRow, 
+                                     bool withBounds) {
+        string indexFileName = getIndexFileName(dataFileName);
+
+        if (indexFileName.length() > 0 && load(indexFileName, dataFileName)) {
+            printf("Block index loaded from %s (%ld blocks, %ld rows).\n", indexFileName.c_str(), getNumBlocks(), numRows);
+            if (!withBounds || haveBounds) {
+                return true;
+            }
+        } else {
+            if (!build(source, dataStart, format, numBytesPerRow)) {
+                return false;
+            }
+            printf("Block index built (%ld blocks, %ld rows).\n", getNumBlocks(), numRows);
+        }
+
+        if (withBounds && !haveBounds) {
+            printf("Reading all data blocks once for their bounds.\n");
+            if (!buildBounds(source, format, numBytesPerRow)) {
+                return false;
+            }
+        }
+
+        // not being able to write the sidecar (e.g. read-only directory) is no problem;
+        // for a truncated file, it is not written, so that the warning is given each time
+        if (indexFileName.length() > 0 && !truncated && !save(indexFileName, dataFileName)) {
+            printf("Could not write block index to %s, continue anyway.\n", indexFileName.c_str());
+        }
+
+        return true;
+    }
+
+    /* Binary search for the block containing the given row */
+    long PmssBlockIndex::findBlock(long row) {
+        long lo, hi, mid;
+
+        if (blocks.size() == 0 || row < 0 || row >= numRows) {
+            return -1;
+        }
+
+        lo = 0;
+        hi = (long) blocks.size() - 1;
+        while (lo < hi) {
+            mid = (lo + hi + 1) / 2;
+            if (blocks[mid].firstRow <= row) {
+                lo = mid;
+            } else {
+                hi = mid - 1;
+            }
+        }
+
+        return lo;
+    }
+
+    const string & PmssBlockIndex::getError() {
+        return error;
+    }
+
+    bool PmssBlockIndex::isTruncated() {
+        return truncated;
+    }
+
+    long PmssBlockIndex::getNumBlocks() {
+        return (long) blocks.size();
+    }
+
+    long PmssBlockIndex::getNumRows() {
+        return numRows;
+    }
+
+    bool PmssBlockIndex::hasBounds() {
+        return haveBounds;
+    }
+
+    const pmssBlockInfo & PmssBlockIndex::getBlock(long i) {
+        return blocks[i];
+    }
+
+}
@@ -0,0 +1,104 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+#include "Pmss_FileSource.h"
+#include "Pmss_Record.h"
+
+#ifndef Pmss_Pmss_BlockIndex_h
+#define Pmss_Pmss_BlockIndex_h
+
+namespace Pmss {
+
+    // position of one data block in a PMss file
+    typedef struct {
+        long firstRow;  // number of first row (particle) in this block
+        long offset;    // byte offset of the block, i.e. of the record marker before nrecord
+        long nrecord;   // number of rows in this block
+        float bounds[6];    // xMin, xMax, yMin, yMax, zMin, zMax of its particles (see hasBounds)
+    } pmssBlockInfo;
+
+
+    // Table of all data blocks of a PMss file, built by jumping from one 
+    // nrecord-header to the next (no data is read), or loaded from a
+    // sidecar file (<datafile>.idx, next to the data file or in an index 
+    // directory) written at an earlier run.
+    // The range of the positions in each block is only known if asked for,
+    // because all data has to be read for it; it is kept in the sidecar.
+    class PmssBlockIndex {
+    private:
+        std::vector<pmssBlockInfo> blocks;
+        long numRows;
+        long fileSize;
+        long fileTime;
+        bool haveBounds;
+        bool truncated;     // the file ends within the last data block
+        std::string error;  // why build failed (or why the file is truncated)
+
+        static std::string indexDir;    // where the sidecars are kept
+
+        bool statFile(std::string fileName, long * size, long * mtime);
+
+    public:
+        PmssBlockIndex();
+        ~PmssBlockIndex();
+
+        // walk through all blocks, starting at byte offset dataStart; if the 
+        // file is truncated, the complete blocks are kept and a warning is printed
+        bool build(PmssFileSource * source, long dataStart, const PmssRecordFormat & format, int numBytesPerRow);
+
+        // read all blocks once for the range of x, y, z in each of them
+        bool buildBounds(PmssFileSource * source, const PmssRecordFormat & format, int numBytesPerRow);
+
+        bool load(std::string indexFileName, std::string dataFileName);
+
+        bool save(std::string indexFileName, std::string dataFileName);
+
+        // directory for the sidecars of all files: "" next to the data file, 
+        // "none" for not using sidecars; set before reading
+        static void setIndexDir(std::string dir);
+
+        // name of the sidecar file, empty if no sidecar is used
+        static std::string getIndexFileName(std::string dataFileName);
+
+        // load sidecar index if it is still valid for the data file (and has 
+        // the bounds, if needed), otherwise build it and try to write the sidecar
+        bool loadOrBuild(std::string dataFileName, PmssFileSource * source, long dataStart, const PmssRecordFormat & format, int numBytesPerRow, 
+                         bool withBounds = false);
+
+        // index of the block containing the given row, -1 if not in file
+        long findBlock(long row);
+
+        // message of the last failed build (or of a truncated file)
+        const std::string & getError();
+
+        // the file ended within a data block, only the complete blocks are in the table
+        bool isTruncated();
+
+        long getNumBlocks();
+        long getNumRows();
+        bool hasBounds();
+        const pmssBlockInfo & getBlock(long i);
+    };
+
+}
+
+#endif
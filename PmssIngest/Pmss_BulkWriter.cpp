@@ -0,0 +1,428 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <SchemaItem.h>
+#include <DataObjDesc.h>
+#include <DType.h>
+
+#include "Pmss_BulkWriter.h"
+#ifdef PMSS_ARROW
+#include "Pmss_ArrowWriter.h"
+#endif
+
+using namespace std;
+using namespace DBDataSchema;
+
+namespace Pmss {
+
+    PmssBulkWriter::PmssBulkWriter(string newBasePath, long newMaxFileSize) {
+        basePath = newBasePath;
+        maxFileSize = newMaxFileSize;
+        bytesWritten = 0;
+        fileCount = 0;
+    }
+
+    PmssBulkWriter::~PmssBulkWriter() {
+    }
+
+    string PmssBulkWriter::nextFileName() {
+        char number[16];
+
+        snprintf(number, sizeof(number), "_%04d.", fileCount);
+        fileCount++;
+
+        return basePath + number + getExtension();
+    }
+
+    long PmssBulkWriter::writeAll(PmssReader * reader, Schema * schema) {
+        vector<SchemaItem *> items = schema->getArrSchemaItems();
+        vector<bulkCell> values(items.size());
+        vector<const void *> columns(items.size());
+        bool * isNull;
+        string fileName;
+        long numRows, batchRows, j;
+        size_t i;
+
+        tableName = schema->getTableName();
+        if (schema->getDbName().length() > 0) {
+            tableName = schema->getDbName() + "." + tableName;
+        }
+        columnNames.clear();
+        columnTypes.clear();
+        for (i = 0; i < items.size(); i++) {
+            columnNames.push_back(items[i]->getColumnName());
+            columnTypes.push_back(items[i]->getDataDesc()->getDataObjDType());
+        }
+
+        // constants are the same for all rows, everything else 
+        // comes as one array per column
+        reader->bindSchema(schema);
+        isNull = new bool[items.size()];
+        for (i = 0; i < items.size(); i++) {
+            values[i].l = 0;
+            isNull[i] = false;
+            if (items[i]->getDataDesc()->getIsConstItem()) {
+                reader->getConstItem(items[i]->getDataDesc(), &values[i]);
+            }
+        }
+
+        numRows = 0;
+        fileName = "";
+
+        while ((batchRows = reader->getNextRows(0, &columns[0])) > 0) {
+            for (j = 0; j < batchRows; j++) {
+                if (fileName.length() == 0) {
+                    fileName = nextFileName();
+                    if (!openFile(fileName)) {
+                        printf("PmssBulkWriter: Could not open %s.\n", fileName.c_str());
+                        numRows = -1;
+                        break;
+                    }
+                    fileNames.push_back(fileName);
+                    bytesWritten = 0;
+                }
+
+                for (i = 0; i < items.size(); i++) {
+                    if (items[i]->getDataDesc()->getIsConstItem()) {
+                        continue;
+                    }
+                    isNull[i] = (columns[i] == NULL);
+                    if (isNull[i]) {
+                        continue;
+                    }
+                    switch (columnTypes[i]) {
+                        case DT_REAL4:
+                            values[i].f = ((const float *) columns[i])[j];
+                            break;
+                        case DT_INT4:
+                            values[i].i = ((const int *) columns[i])[j];
+                            break;
+                        default:
+                            values[i].l = ((const long *) columns[i])[j];
+                            break;
+                    }
+                }
+
+                if (!writeRow(&values[0], isNull)) {
+                    printf("PmssBulkWriter: Could not write to %s.\n", fileName.c_str());
+                    numRows = -1;
+                    break;
+                }
+                numRows++;
+
+                // start a new file, if this one is full
+                if (maxFileSize > 0 && bytesWritten >= maxFileSize) {
+                    closeFile();
+                    fileName = "";
+                }
+            }
+            if (numRows < 0) {
+                break;
+            }
+        }
+
+        if (fileName.length() > 0 && !closeFile()) {
+            printf("PmssBulkWriter: Could not close %s.\n", fileName.c_str());
+            numRows = -1;
+        }
+
+        delete [] isNull;
+
+        return numRows;
+    }
+
+    vector<string> PmssBulkWriter::getFileNames() {
+        return fileNames;
+    }
+
+    PmssBulkWriter * PmssBulkWriter::create(string format, string basePath, long maxFileSize) {
+        if (format.compare("tsv") == 0) {
+            return new PmssTsvWriter(basePath, maxFileSize);
+        } else if (format.compare("pgcopy") == 0) {
+            return new PmssPgCopyWriter(basePath, maxFileSize);
+        } else if (format.compare("bcp") == 0) {
+            return new PmssBcpWriter(basePath, maxFileSize);
+#ifdef PMSS_ARROW
+        } else if (format.compare("arrow") == 0) {
+            return new PmssArrowWriter(basePath, maxFileSize);
+#endif
+        }
+
+        return NULL;
+    }
+
+
+    PmssTsvWriter::PmssTsvWriter(string basePath, long maxFileSize) : PmssBulkWriter(basePath, maxFileSize) {
+        fp = NULL;
+    }
+
+    PmssTsvWriter::~PmssTsvWriter() {
+        if (fp != NULL) {
+            fclose(fp);
+        }
+    }
+
+    string PmssTsvWriter::getExtension() {
+        return "tsv";
+    }
+
+    string PmssTsvWriter::getLoadHint(string fileName) {
+        return "LOAD DATA INFILE '" + fileName + "' INTO TABLE " + tableName + 
+            " FIELDS TERMINATED BY '\\t' LINES TERMINATED BY '\\n';";
+    }
+
+    bool PmssTsvWriter::openFile(string fileName) {
+        fp = fopen(fileName.c_str(), "w");
+        return (fp != NULL);
+    }
+
+    bool PmssTsvWriter::writeRow(bulkCell * values, bool * isNull) {
+        size_t i, pos;
+        int len;
+
+        // 9 significant digits are enough to get the same float back
+        line.resize(32 * columnTypes.size() + 1);
+        pos = 0;
+        for (i = 0; i < columnTypes.size(); i++) {
+            if (i > 0) {
+                line[pos++] = '\t';
+            }
+
+            if (isNull[i]) {
+                line[pos++] = '\\';
+                line[pos++] = 'N';
+                continue;
+            }
+
+            switch (columnTypes[i]) {
+                case DT_REAL4:
+                    len = snprintf(&line[pos], 32, "%.9g", values[i].f);
+                    break;
+                case DT_REAL8:
+                    len = snprintf(&line[pos], 32, "%.17g", values[i].d);
+                    break;
+                case DT_INT8:
+                    len = snprintf(&line[pos], 32, "%ld", values[i].l);
+                    break;
+                default:
+                    len = snprintf(&line[pos], 32, "%d", values[i].i);
+                    break;
+            }
+            pos += len;
+        }
+        line[pos++] = '\n';
+
+        bytesWritten += pos;
+        return (fwrite(&line[0], 1, pos, fp) == pos);
+    }
+
+    bool PmssTsvWriter::closeFile() {
+        int ret;
+
+        ret = fclose(fp);
+        fp = NULL;
+        return (ret == 0);
+    }
+
+
+    static inline void putBigEndian(char * dest, const void * src, int len) {
+        const char * s = (const char *) src;
+        int i;
+
+        for (i = 0; i < len; i++) {
+            dest[i] = s[len - 1 - i];
+        }
+    }
+
+    PmssPgCopyWriter::PmssPgCopyWriter(string basePath, long maxFileSize) : PmssBulkWriter(basePath, maxFileSize) {
+        fp = NULL;
+    }
+
+    PmssPgCopyWriter::~PmssPgCopyWriter() {
+        if (fp != NULL) {
+            fclose(fp);
+        }
+    }
+
+    string PmssPgCopyWriter::getExtension() {
+        return "pgcopy";
+    }
+
+    string PmssPgCopyWriter::getLoadHint(string fileName) {
+        return "COPY " + tableName + " FROM '" + fileName + "' WITH (FORMAT binary);";
+    }
+
+    bool PmssPgCopyWriter::openFile(string fileName) {
+        // signature, flags (no oids), length of header extension
+        const char signature[11] = {'P','G','C','O','P','Y','\n','\377','\r','\n','\0'};
+        const char zeros[8] = {0,0,0,0,0,0,0,0};
+
+        fp = fopen(fileName.c_str(), "wb");
+        if (fp == NULL) {
+            return false;
+        }
+
+        if (fwrite(signature, 1, sizeof(signature), fp) != sizeof(signature) 
+            || fwrite(zeros, 1, sizeof(zeros), fp) != sizeof(zeros)) {
+            return false;
+        }
+        bytesWritten = sizeof(signature) + sizeof(zeros);
+
+        return true;
+    }
+
+    bool PmssPgCopyWriter::writeRow(bulkCell * values, bool * isNull) {
+        short numFields;
+        int len, nullLen;
+        size_t i, pos;
+
+        tuple.resize(2 + 12 * columnTypes.size());
+        numFields = (short) columnTypes.size();
+        nullLen = -1;
+
+        putBigEndian(&tuple[0], &numFields, 2);
+        pos = 2;
+        for (i = 0; i < columnTypes.size(); i++) {
+            if (isNull[i]) {
+                putBigEndian(&tuple[pos], &nullLen, 4);
+                pos += 4;
+                continue;
+            }
+
+            len = getByteLenOfDType(columnTypes[i]);
+            putBigEndian(&tuple[pos], &len, 4);
+            putBigEndian(&tuple[pos + 4], &values[i], len);
+            pos += 4 + len;
+        }
+
+        bytesWritten += pos;
+        return (fwrite(&tuple[0], 1, pos, fp) == pos);
+    }
+
+    bool PmssPgCopyWriter::closeFile() {
+        const char trailer[2] = {'\377', '\377'};
+        bool ok;
+
+        ok = (fwrite(trailer, 1, sizeof(trailer), fp) == sizeof(trailer));
+        ok = (fclose(fp) == 0) && ok;
+        fp = NULL;
+
+        return ok;
+    }
+
+
+    PmssBcpWriter::PmssBcpWriter(string basePath, long maxFileSize) : PmssBulkWriter(basePath, maxFileSize) {
+        fp = NULL;
+    }
+
+    PmssBcpWriter::~PmssBcpWriter() {
+        if (fp != NULL) {
+            fclose(fp);
+        }
+    }
+
+    string PmssBcpWriter::getExtension() {
+        return "bcp";
+    }
+
+    string PmssBcpWriter::getLoadHint(string fileName) {
+        return "bcp " + tableName + " in " + fileName + " -f " + fileName + ".fmt";
+    }
+
+    /* non-XML format file: for each column the host data type, prefix length,
+     * data length, terminator, server column number and name */
+    bool PmssBcpWriter::writeFormatFile(string fileName) {
+        FILE * fmt;
+        const char * hostType;
+        size_t i;
+        bool ok;
+
+        fmt = fopen((fileName + ".fmt").c_str(), "w");
+        if (fmt == NULL) {
+            return false;
+        }
+
+        fprintf(fmt, "10.0\n%d\n", (int) columnTypes.size());
+        for (i = 0; i < columnTypes.size(); i++) {
+            switch (columnTypes[i]) {
+                case DT_REAL4:
+                    hostType = "SQLFLT4";
+                    break;
+                case DT_REAL8:
+                    hostType = "SQLFLT8";
+                    break;
+                case DT_INT8:
+                    hostType = "SQLBIGINT";
+                    break;
+                default:
+                    hostType = "SQLINT";
+                    break;
+            }
+            fprintf(fmt, "%d\t%s\t1\t%d\t\"\"\t%d\t%s\t\"\"\n", (int) i+1, hostType, 
+                getByteLenOfDType(columnTypes[i]), (int) i+1, columnNames[i].c_str());
+        }
+
+        ok = !ferror(fmt);
+        return (fclose(fmt) == 0) && ok;
+    }
+
+    bool PmssBcpWriter::openFile(string fileName) {
+        if (!writeFormatFile(fileName)) {
+            return false;
+        }
+
+        fp = fopen(fileName.c_str(), "wb");
+        return (fp != NULL);
+    }
+
+    bool PmssBcpWriter::writeRow(bulkCell * values, bool * isNull) {
+        size_t i, pos;
+        int len;
+
+        // values are written as they are in memory, i.e. little endian on x86
+        record.resize(9 * columnTypes.size());
+        pos = 0;
+        for (i = 0; i < columnTypes.size(); i++) {
+            if (isNull[i]) {
+                record[pos++] = (char) 0xFF;
+                continue;
+            }
+
+            len = getByteLenOfDType(columnTypes[i]);
+            record[pos] = (char) len;
+            memcpy(&record[pos + 1], &values[i], len);
+            pos += 1 + len;
+        }
+
+        bytesWritten += pos;
+        return (fwrite(&record[0], 1, pos, fp) == pos);
+    }
+
+    bool PmssBcpWriter::closeFile() {
+        int ret;
+
+        ret = fclose(fp);
+        fp = NULL;
+        return (ret == 0);
+    }
+
+}
@@ -0,0 +1,150 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <Schema.h>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include "Pmss_Reader.h"
+
+#ifndef Pmss_Pmss_BulkWriter_h
+#define Pmss_Pmss_BulkWriter_h
+
+namespace Pmss {
+
+    // one value of a row, as returned by Reader::getItemInRow
+    typedef union {
+        float f;
+        double d;
+        int i;
+        long l;
+    } bulkCell;
+
+
+    // Writes the rows of a reader into files that a database server can 
+    // load directly (LOAD DATA INFILE, COPY, bcp, ...) instead of sending 
+    // them with INSERTs. Columns are taken from the schema, so the files
+    // contain the same columns as the table. When a file becomes larger than
+    // maxFileSize, the next one is started (<basePath>_<number>.<extension>).
+    class PmssBulkWriter {
+    protected:
+        std::string basePath;
+        long maxFileSize;       // in bytes, 0 for no limit
+        long bytesWritten;      // in the current file
+        int fileCount;
+        std::vector<std::string> fileNames;
+
+        // column description, taken from the schema
+        std::vector<std::string> columnNames;
+        std::vector<DBDataSchema::DType> columnTypes;
+        std::string tableName;
+
+        std::string nextFileName();
+
+        virtual bool openFile(std::string fileName) = 0;
+        virtual bool writeRow(bulkCell * values, bool * isNull) = 0;
+        virtual bool closeFile() = 0;
+
+    public:
+        PmssBulkWriter(std::string basePath, long maxFileSize);
+        virtual ~PmssBulkWriter();
+
+        virtual std::string getExtension() = 0;
+
+        // statement/command for loading one of the written files
+        virtual std::string getLoadHint(std::string fileName) = 0;
+
+        // read all rows from the reader (column-wise, batch by batch) and write them;
+        // returns number of rows
+        long writeAll(PmssReader * reader, DBDataSchema::Schema * schema);
+
+        std::vector<std::string> getFileNames();
+
+        // tsv (MySQL), pgcopy (PostgreSQL), bcp (SQL Server) or arrow (if compiled with Arrow)
+        static PmssBulkWriter * create(std::string format, std::string basePath, long maxFileSize);
+    };
+
+
+    // tab separated text, NULL as \N, as expected by MySQL's LOAD DATA INFILE
+    class PmssTsvWriter : public PmssBulkWriter {
+    private:
+        FILE * fp;
+        std::vector<char> line;
+
+    protected:
+        bool openFile(std::string fileName);
+        bool writeRow(bulkCell * values, bool * isNull);
+        bool closeFile();
+
+    public:
+        PmssTsvWriter(std::string basePath, long maxFileSize);
+        ~PmssTsvWriter();
+
+        std::string getExtension();
+        std::string getLoadHint(std::string fileName);
+    };
+
+
+    // PostgreSQL binary COPY format (big endian, length prefix per field)
+    class PmssPgCopyWriter : public PmssBulkWriter {
+    private:
+        FILE * fp;
+        std::vector<char> tuple;
+
+    protected:
+        bool openFile(std::string fileName);
+        bool writeRow(bulkCell * values, bool * isNull);
+        bool closeFile();
+
+    public:
+        PmssPgCopyWriter(std::string basePath, long maxFileSize);
+        ~PmssPgCopyWriter();
+
+        std::string getExtension();
+        std::string getLoadHint(std::string fileName);
+    };
+
+
+    // SQL Server bcp native format: little endian values, each with a 
+    // one byte length prefix (0xFF for NULL); a format file (.fmt) 
+    // describing the columns is written next to each data file
+    class PmssBcpWriter : public PmssBulkWriter {
+    private:
+        FILE * fp;
+        std::vector<char> record;
+
+        bool writeFormatFile(std::string fileName);
+
+    protected:
+        bool openFile(std::string fileName);
+        bool writeRow(bulkCell * values, bool * isNull);
+        bool closeFile();
+
+    public:
+        PmssBcpWriter(std::string basePath, long maxFileSize);
+        ~PmssBcpWriter();
+
+        std::string getExtension();
+        std::string getLoadHint(std::string fileName);
+    };
+
+}
+
+#endif
@@ -0,0 +1,480 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "Pmss_Catalog.h"
+#include "Pmss_Reader.h"
+#include "Pmss_BlockIndex.h"
+#include "Pmss_CompressedSource.h"
+
+using namespace std;
+
+namespace Pmss {
+
+    // x, y, z, vx, vy, vz and id
+    static const int numBytesPerRow = 6*sizeof(float) + sizeof(long);
+
+    static double catalogTime() {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        return tv.tv_sec + tv.tv_usec * 1.e-6;
+    }
+
+    static string jsonString(const string & text) {
+        string result = "\"";
+        char code[8];
+        size_t i;
+
+        for (i = 0; i < text.length(); i++) {
+            unsigned char c = (unsigned char) text[i];
+            if (c == '"' || c == '\\') {
+                result += '\\';
+                result += (char) c;
+            } else if (c < 0x20) {
+                snprintf(code, sizeof(code), "\\u%04x", c);
+                result += code;
+            } else {
+                result += (char) c;
+            }
+        }
+
+        return result + "\"";
+    }
+
+    static string csvString(const string & text) {
+        string result = "\"";
+        size_t i;
+
+        if (text.find_first_of(",\"\n") == string::npos) {
+            return text;
+        }
+        for (i = 0; i < text.length(); i++) {
+            if (text[i] == '"') 
+                result += '"';
+            result += text[i];
+        }
+
+        return result + "\"";
+    }
+
+    PmssCatalog::PmssCatalog(vector<string> fileNames, int newBswap) {
+        size_t i;
+
+        bswap = newBswap;
+        validate = false;
+        entries.resize(fileNames.size());
+        for (i = 0; i < fileNames.size(); i++) {
+            pmssCatalogEntry & entry = entries[i];
+            entry.fileName = fileNames[i];
+            entry.scanned = false;
+            entry.fileSize = -1;
+            entry.dataSize = -1;
+            entry.haveHeader = false;
+            entry.markerSize = 4;
+            entry.swap = 0;
+            memset(&entry.header, 0, sizeof(entry.header));
+            memset(entry.boundary, 0, sizeof(entry.boundary));
+            entry.numBlocks = 0;
+            entry.numRows = 0;
+            entry.minRecord = 0;
+            entry.maxRecord = 0;
+            entry.validated = false;
+            entry.numInside = 0;
+            entry.numOnBoundary = 0;
+            memset(&entry.check, 0, sizeof(entry.check));
+            entry.check.firstNonFinite = -1;
+            entry.check.firstOutside = -1;
+            entry.seconds = 0;
+        }
+    }
+
+    PmssCatalog::~PmssCatalog() {
+    }
+
+    void PmssCatalog::setValidate(bool newValidate) {
+        validate = newValidate;
+    }
+
+    void PmssCatalog::addError(pmssCatalogEntry & entry, const char * format, ...) {
+        char message[512];
+        va_list args;
+
+        va_start(args, format);
+        vsnprintf(message, sizeof(message), format, args);
+        va_end(args);
+
+        entry.errors.push_back(message);
+    }
+
+    /* The same checks as when ingesting (record markers, nodeNum, setBoundary), 
+     * but only collecting what is wrong. False if the subbox is unknown. */
+    bool PmssCatalog::checkHeader(pmssCatalogEntry & entry) {
+        pmssHeader & h = entry.header;
+        int markers[8] = { h.ilead1, h.itrail1, h.ilead2, h.itrail2, h.ilead3, h.itrail3, h.ilead4, h.itrail4 };
+        int expected[8] = { 6*4, 6*4, 6*4, 6*4, 6*4, 6*4, 4, 4 };
+        bool bad = false;
+        bool swapped = true;
+        int i;
+
+        for (i = 0; i < 8; i++) {
+            if (markers[i] != expected[i]) 
+                bad = true;
+            if (PmssReader::swapInt(markers[i], 1) != expected[i]) 
+                swapped = false;
+        }
+        if (bad && swapped) {
+            addError(entry, "Record markers of the header are byte swapped, read with swap=%d.", entry.swap ? 0 : 1);
+        } else if (bad) {
+            addError(entry, "Unexpected record markers in the header (%d %d %d %d %d %d %d %d).", 
+                markers[0], markers[1], markers[2], markers[3], markers[4], markers[5], markers[6], markers[7]);
+        }
+
+        if (h.np < 0) {
+            addError(entry, "Np is %d.", h.np);
+        }
+        if (!(h.box > 0)) {
+            addError(entry, "box is %g.", h.box);
+        }
+        if (h.nx <= 0 || h.ny <= 0 || h.nz <= 0 || h.nodeNum < 1 
+                || (long) h.nodeNum > (long) h.nx * (long) h.ny * (long) h.nz) {
+            addError(entry, "nodeNum %d is not a subbox of nx, ny, nz = %d %d %d.", h.nodeNum, h.nx, h.ny, h.nz);
+            return false;
+        }
+
+        if (!PmssReader::computeBoundary(h, entry.boundary)) {
+            addError(entry, "Boundaries in the header (x: %g - %g, y: %g - %g, z: %g - %g) do not agree with "
+                "the subbox of nodeNum %d (x: %g - %g, y: %g - %g, z: %g - %g) and dBuffer %g.", 
+                h.xL, h.xR, h.yL, h.yR, h.zL, h.zR, h.nodeNum, 
+                entry.boundary[0], entry.boundary[1], entry.boundary[2], entry.boundary[3], 
+                entry.boundary[4], entry.boundary[5], h.dBuffer);
+        }
+
+        return true;
+    }
+
+    void PmssCatalog::addBlock(pmssCatalogEntry & entry, long nrecord) {
+        if (entry.numBlocks == 0 || nrecord < entry.minRecord) 
+            entry.minRecord = nrecord;
+        if (entry.numBlocks == 0 || nrecord > entry.maxRecord) 
+            entry.maxRecord = nrecord;
+        if (entry.blockSizes.size() > 0 && entry.blockSizes.back().first == nrecord) {
+            entry.blockSizes.back().second++;
+        } else {
+            entry.blockSizes.push_back(make_pair(nrecord, 1L));
+        }
+        entry.numBlocks++;
+        entry.numRows += nrecord;
+    }
+
+    /* Jump through the nrecord-headers of all blocks */
+    void PmssCatalog::walkBlocks(pmssCatalogEntry & entry, PmssFileSource * source, const PmssRecordFormat & format) {
+        PmssBlockIndex blockIndex;
+        bool ok;
+        long i;
+
+        ok = blockIndex.build(source, format.getHeaderSize(), format, numBytesPerRow);
+        for (i = 0; i < blockIndex.getNumBlocks(); i++) {
+            addBlock(entry, blockIndex.getBlock(i).nrecord);
+        }
+        if (!ok || blockIndex.isTruncated()) {
+            addError(entry, "%s (after %ld good blocks)", blockIndex.getError().c_str(), blockIndex.getNumBlocks());
+        }
+    }
+
+    /* Read all data blocks in sequence: skipints, values and the particles 
+     * inside the subbox (only if it is known) */
+    void PmssCatalog::validateBlocks(pmssCatalogEntry & entry, PmssFileSource * source, const PmssRecordFormat & format, 
+                                     bool haveSubbox) {
+        pmssHeader & h = entry.header;
+        float fileBoundary[6] = { h.xL, h.xR, h.yL, h.yR, h.zL, h.zR };
+        PmssBlockDecoder decoder;
+        PmssParticleBatch batch;
+        vector<char> buffer;
+        const char * blockData;
+        string error;
+        long pos;
+        long nrecord;
+
+        decoder.setup(entry.swap, entry.boundary[0], entry.boundary[1], entry.boundary[2], entry.boundary[3], 
+                      entry.boundary[4], entry.boundary[5], h.nodeNum, 0.);
+
+        while (true) {
+            pos = source->tell();
+            blockData = PmssBlockDecoder::fetchBlock(source, format, &nrecord, buffer, false, &error);
+            if (blockData == NULL) {
+                break;
+            }
+
+            PmssBlockDecoder::check(blockData, nrecord, entry.numRows, entry.swap, fileBoundary, entry.check);
+            if (haveSubbox) {
+                decoder.decode(blockData, nrecord, entry.numRows, batch);
+                entry.numInside += batch.numRows;
+                entry.numOnBoundary += batch.numOnBoundary;
+            }
+            addBlock(entry, nrecord);
+        }
+        entry.validated = true;
+
+        if (error.length() > 0) {
+            addError(entry, "Data block %ld at offset %ld: %s", entry.numBlocks, pos, error.c_str());
+        } else if (entry.dataSize >= 0 && pos != entry.dataSize) {
+            addError(entry, "%ld bytes after the last data block are not a complete block.", entry.dataSize - pos);
+        }
+
+        if (entry.check.numNonFinite > 0) {
+            addError(entry, "NaN or infinite values in %ld particles, the first one in row %ld.", 
+                entry.check.numNonFinite, entry.check.firstNonFinite);
+        }
+        if (entry.check.numOutside > 0) {
+            addError(entry, "Positions outside of the file boundaries for %ld particles, the first one in row %ld.", 
+                entry.check.numOutside, entry.check.firstOutside);
+        }
+    }
+
+    /* Read the header and the data blocks (see walkBlocks, validateBlocks) */
+    void PmssCatalog::scanFile(long index) {
+        pmssCatalogEntry & entry = entries[index];
+        PmssFileSource * source;
+        PmssRecordFormat format(bswap);
+        string error;
+        struct stat st;
+        double startTime;
+        bool haveSubbox;
+
+        startTime = catalogTime();
+        entry.scanned = true;
+
+        if (stat(entry.fileName.c_str(), &st) == 0) {
+            entry.fileSize = (long) st.st_size;
+        }
+
+        if (PmssCompressedSource::getCompression(entry.fileName) != PMSS_COMPRESS_NONE) {
+            source = new PmssCompressedSource();
+        } else {
+            source = new PmssStreamSource();
+        }
+
+        if (!source->open(entry.fileName)) {
+            addError(entry, "Could not open the file.");
+        } else {
+            entry.dataSize = source->size();
+            if (entry.dataSize < 0) {
+                addError(entry, "Could not decompress the whole file.");
+            }
+
+            if (!format.readHeader(source, entry.header, &error)) {
+                addError(entry, "%s", error.c_str());
+            } else {
+                entry.markerSize = format.getMarkerSize();
+                entry.swap = format.getSwap();
+                entry.header = PmssReader::swapPmssHeader(entry.header, entry.swap);
+                entry.haveHeader = true;
+                haveSubbox = checkHeader(entry);
+
+                if (validate) {
+                    validateBlocks(entry, source, format, haveSubbox);
+                } else {
+                    walkBlocks(entry, source, format);
+                }
+
+                if (entry.numRows != (long) entry.header.np) {
+                    addError(entry, "Data blocks hold %ld particles, but Np in the header is %d.", entry.numRows, entry.header.np);
+                }
+            }
+            source->close();
+        }
+
+        delete source;
+        entry.seconds = catalogTime() - startTime;
+    }
+
+    bool PmssCatalog::isFormat(string format) {
+        return (format.compare("json") == 0 || format.compare("csv") == 0);
+    }
+
+    /* One JSON object per file, in an array */
+    void PmssCatalog::writeJson(FILE * fp) {
+        size_t i, j;
+
+        fprintf(fp, "[\n");
+        for (i = 0; i < entries.size(); i++) {
+            pmssCatalogEntry & e = entries[i];
+            pmssHeader & h = e.header;
+
+            fprintf(fp, "{\"file\": %s, \"fileSize\": %ld, \"dataSize\": %ld", jsonString(e.fileName).c_str(), e.fileSize, e.dataSize);
+            if (e.haveHeader) {
+                fprintf(fp, ", \"recordMarker\": %d, \"swap\": %d", e.markerSize, e.swap);
+                fprintf(fp, ", \"nodeNum\": %d, \"nx\": %d, \"ny\": %d, \"nz\": %d, \"np\": %d, \"box\": %.9g, \"dBuffer\": %.9g, \"nBuffer\": %d", 
+                    h.nodeNum, h.nx, h.ny, h.nz, h.np, h.box, h.dBuffer, h.nBuffer);
+                fprintf(fp, ", \"aexpn\": %.9g, \"Omega0\": %.9g, \"OmegaL0\": %.9g, \"hubble\": %.9g, \"particleMass\": %.9g", 
+                    h.aexpn, h.Omega0, h.OmegaL0, h.hubble, h.particleMass);
+                fprintf(fp, ", \"fileBoundary\": [%.9g, %.9g, %.9g, %.9g, %.9g, %.9g]", h.xL, h.xR, h.yL, h.yR, h.zL, h.zR);
+                fprintf(fp, ", \"boundary\": [%.9g, %.9g, %.9g, %.9g, %.9g, %.9g]", 
+                    e.boundary[0], e.boundary[1], e.boundary[2], e.boundary[3], e.boundary[4], e.boundary[5]);
+            }
+            fprintf(fp, ", \"numBlocks\": %ld, \"numRows\": %ld, \"minRecord\": %ld, \"maxRecord\": %ld, \"blockSizes\": [", 
+                e.numBlocks, e.numRows, e.minRecord, e.maxRecord);
+            for (j = 0; j < e.blockSizes.size(); j++) {
+                fprintf(fp, "%s[%ld, %ld]", (j > 0) ? ", " : "", e.blockSizes[j].first, e.blockSizes[j].second);
+            }
+            fprintf(fp, "]");
+            if (e.validated) {
+                fprintf(fp, ", \"numInside\": %ld, \"numOnBoundary\": %ld, \"numNonFinite\": %ld, \"numOutside\": %ld, \"checksum\": \"%016lx\"", 
+                    e.numInside, e.numOnBoundary, e.check.numNonFinite, e.check.numOutside, e.check.checksum);
+            }
+            fprintf(fp, ", \"seconds\": %.3f, \"errors\": [", e.seconds);
+            for (j = 0; j < e.errors.size(); j++) {
+                fprintf(fp, "%s%s", (j > 0) ? ", " : "", jsonString(e.errors[j]).c_str());
+            }
+            fprintf(fp, "]}%s\n", (i + 1 < entries.size()) ? "," : "");
+        }
+        fprintf(fp, "]\n");
+    }
+
+    /* One line per file; block sizes only as minimum and maximum. 
+     * The columns of the validation are only there with validation. */
+    void PmssCatalog::writeCsv(FILE * fp) {
+        string errors;
+        size_t i, j;
+
+        fprintf(fp, "file,fileSize,dataSize,nodeNum,nx,ny,nz,np,box,dBuffer,nBuffer,aexpn,particleMass,"
+            "xL,xR,yL,yR,zL,zR,xLeft,xRight,yLeft,yRight,zLeft,zRight,"
+            "numBlocks,numRows,minRecord,maxRecord,%sseconds,errors\n",
+            validate ? "numInside,numOnBoundary,numNonFinite,numOutside,checksum," : "");
+        for (i = 0; i < entries.size(); i++) {
+            pmssCatalogEntry & e = entries[i];
+            pmssHeader & h = e.header;
+
+            fprintf(fp, "%s,%ld,%ld,", csvString(e.fileName).c_str(), e.fileSize, e.dataSize);
+            if (e.haveHeader) {
+                fprintf(fp, "%d,%d,%d,%d,%d,%.9g,%.9g,%d,%.9g,%.9g,", 
+                    h.nodeNum, h.nx, h.ny, h.nz, h.np, h.box, h.dBuffer, h.nBuffer, h.aexpn, h.particleMass);
+                fprintf(fp, "%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,", h.xL, h.xR, h.yL, h.yR, h.zL, h.zR);
+                fprintf(fp, "%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,", 
+                    e.boundary[0], e.boundary[1], e.boundary[2], e.boundary[3], e.boundary[4], e.boundary[5]);
+            } else {
+                fprintf(fp, ",,,,,,,,,,,,,,,,,,,,,,");
+            }
+
+            errors = "";
+            for (j = 0; j < e.errors.size(); j++) {
+                errors += ((j > 0) ? "; " : "") + e.errors[j];
+            }
+            fprintf(fp, "%ld,%ld,%ld,%ld,", e.numBlocks, e.numRows, e.minRecord, e.maxRecord);
+            if (e.validated) {
+                fprintf(fp, "%ld,%ld,%ld,%ld,%016lx,", e.numInside, e.numOnBoundary, 
+                    e.check.numNonFinite, e.check.numOutside, e.check.checksum);
+            } else if (validate) {
+                fprintf(fp, ",,,,,");
+            }
+            fprintf(fp, "%.3f,%s\n", e.seconds, csvString(errors).c_str());
+        }
+    }
+
+    bool PmssCatalog::write(string fileName, string format) {
+        FILE * fp;
+        bool ok;
+
+        fp = fopen(fileName.c_str(), "w");
+        if (fp == NULL) {
+            printf("PmssCatalog: Could not write %s.\n", fileName.c_str());
+            return false;
+        }
+
+        if (format.compare("csv") == 0) {
+            writeCsv(fp);
+        } else {
+            writeJson(fp);
+        }
+
+        ok = !ferror(fp);
+        ok = (fclose(fp) == 0) && ok;
+        if (!ok) {
+            printf("PmssCatalog: Could not write %s.\n", fileName.c_str());
+        }
+
+        return ok;
+    }
+
+    void PmssCatalog::printSummary() {
+        long numRows = 0;
+        long numBlocks = 0;
+        long dataSize = 0;
+        long numInside = 0;
+        long numOnBoundary = 0;
+        long minRecord = 0;
+        long maxRecord = 0;
+        size_t i;
+        bool first = true;
+
+        printf("\n%s:\n", validate ? "Validation" : "Catalog");
+        for (i = 0; i < entries.size(); i++) {
+            pmssCatalogEntry & e = entries[i];
+
+            numRows += e.numRows;
+            numBlocks += e.numBlocks;
+            numInside += e.numInside;
+            numOnBoundary += e.numOnBoundary;
+            if (e.dataSize > 0) 
+                dataSize += e.dataSize;
+            if (e.numBlocks > 0) {
+                if (first || e.minRecord < minRecord) 
+                    minRecord = e.minRecord;
+                if (first || e.maxRecord > maxRecord) 
+                    maxRecord = e.maxRecord;
+                first = false;
+            }
+            if (e.errors.size() > 0) {
+                printf("%-40s %s%s\n", e.fileName.c_str(), e.errors[0].c_str(), 
+                    (e.errors.size() > 1) ? " (and more)" : "");
+            }
+        }
+
+        printf("Files: %ld, with errors: %ld\n", getNumFiles(), getNumFilesWithErrors());
+        printf("Particles: %ld in %ld data blocks (nrecord %ld - %ld), %.1f GB\n", 
+            numRows, numBlocks, minRecord, maxRecord, dataSize / (1024.*1024.*1024.));
+        if (validate) {
+            printf("Inside the subboxes: %ld particles (not counted: %ld exactly on an upper boundary)\n", 
+                numInside, numOnBoundary);
+        }
+    }
+
+    long PmssCatalog::getNumFiles() {
+        return (long) entries.size();
+    }
+
+    long PmssCatalog::getNumFilesWithErrors() {
+        long count = 0;
+        size_t i;
+
+        for (i = 0; i < entries.size(); i++) {
+            if (entries[i].errors.size() > 0 || !entries[i].scanned) 
+                count++;
+        }
+
+        return count;
+    }
+
+}
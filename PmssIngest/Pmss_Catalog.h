@@ -0,0 +1,106 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <utility>
+#include "Pmss_Header.h"
+#include "Pmss_FileSource.h"
+#include "Pmss_BlockDecoder.h"
+
+#ifndef Pmss_Pmss_Catalog_h
+#define Pmss_Pmss_Catalog_h
+
+namespace Pmss {
+
+    // what is known about one PMss file without ingesting it
+    typedef struct {
+        std::string fileName;
+        bool scanned;
+        long fileSize;      // on disk
+        long dataSize;      // decompressed, for compressed files
+        bool haveHeader;
+        pmssHeader header;
+        int markerSize;     // bytes of each Fortran record marker (4 or 8)
+        int swap;           // byte order of the file is not the native one
+        float boundary[6];  // subbox without overlap: xLeft, xRight, yLeft, yRight, zLeft, zRight
+        long numBlocks;
+        long numRows;       // sum of nrecord over all blocks
+        long minRecord;
+        long maxRecord;
+        std::vector<std::pair<long, long> > blockSizes;  // runs of blocks with the same nrecord
+        // only with validation: all particles were read
+        bool validated;
+        long numInside;     // inside the subbox, i.e. to be ingested
+        long numOnBoundary; // exactly on an upper boundary, ingested from the neighbour
+        pmssBlockCheck check;
+        std::vector<std::string> errors;
+        double seconds;
+    } pmssCatalogEntry;
+
+    // Manifest of many PMss files: header, boundaries and table of data
+    // blocks of each file, and everything that looks inconsistent. Only the 
+    // header and the nrecord-headers of the blocks are read (jumping from one 
+    // to the next), so that a whole snapshot is scanned in seconds.
+    // With validation, all data blocks are read instead, their skipints and 
+    // values are checked, and the particles inside the subbox are counted 
+    // with the same decoder as when ingesting.
+    // Files are scanned by several threads, each writes its own entry.
+    class PmssCatalog {
+    private:
+        std::vector<pmssCatalogEntry> entries;
+        int bswap;
+        bool validate;
+
+        void addError(pmssCatalogEntry & entry, const char * format, ...);
+        bool checkHeader(pmssCatalogEntry & entry);
+        void addBlock(pmssCatalogEntry & entry, long nrecord);
+        void walkBlocks(pmssCatalogEntry & entry, PmssFileSource * source, const PmssRecordFormat & format);
+        void validateBlocks(pmssCatalogEntry & entry, PmssFileSource * source, const PmssRecordFormat & format, 
+                            bool haveSubbox);
+
+        void writeJson(FILE * fp);
+        void writeCsv(FILE * fp);
+
+    public:
+        PmssCatalog(std::vector<std::string> fileNames, int bswap);
+        ~PmssCatalog();
+
+        // read and check all data blocks instead of only their nrecord-headers
+        void setValidate(bool newValidate);
+
+        void scanFile(long index);
+
+        static bool isFormat(std::string format);
+
+        // write the manifest
+        bool write(std::string fileName, std::string format);
+
+        void printSummary();
+
+        long getNumFiles();
+        long getNumFilesWithErrors();
+    };
+
+}
+
+#endif
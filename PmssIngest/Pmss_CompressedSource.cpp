@@ -0,0 +1,900 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef PMSS_ZLIB
+#include <zlib.h>
+#endif
+#ifdef PMSS_LZMA
+#include <lzma.h>
+#endif
+#ifdef PMSS_ZSTD
+#include <zstd.h>
+#endif
+#include "pmssingest_error.h"
+#include "Pmss_Log.h"
+
+#include "Pmss_CompressedSource.h"
+
+using namespace std;
+
+namespace Pmss {
+
+    // size of the chunks when decompressing as a stream
+    static const long streamChunkSize = 4*1024*1024;
+
+    // files with larger frames are decompressed as a stream, so that the ring stays small
+    static const long maxFrameSize = 64*1024*1024;
+
+    int PmssCompressedSource::defaultThreads = 4;
+    int PmssCompressedSource::defaultReadAhead = 4;
+
+
+#ifdef PMSS_ZLIB
+    // gzip, also several concatenated members (pigz, bgzip)
+    class PmssGzipDecompressor : public PmssDecompressor {
+    private:
+        z_stream strm;
+        bool initialized;
+        bool ended;
+        const char * input;
+        long inputSize;
+        long inputFed;      // given to zlib so far (avail_in is only 32 bit)
+
+    public:
+        PmssGzipDecompressor() {
+            initialized = false;
+            ended = false;
+            input = NULL;
+            inputSize = 0;
+            inputFed = 0;
+        }
+
+        ~PmssGzipDecompressor() {
+            if (initialized)
+                inflateEnd(&strm);
+        }
+
+        bool begin(const char * newInput, long newInputSize) {
+            if (initialized)
+                inflateEnd(&strm);
+
+            memset(&strm, 0, sizeof(strm));
+            // 15 bits window, +32 for detecting the gzip header
+            initialized = (inflateInit2(&strm, 15 + 32) == Z_OK);
+
+            input = newInput;
+            inputSize = newInputSize;
+            inputFed = 0;
+            ended = false;
+
+            return initialized;
+        }
+
+        long decompress(char * dest, long size) {
+            long piece;
+            int ret;
+
+            if (ended)
+                return 0;
+
+            strm.next_out = (Bytef *) dest;
+            strm.avail_out = (uInt) ((size < (1L << 30)) ? size : (1L << 30));
+
+            while (strm.avail_out > 0) {
+                if (strm.avail_in == 0 && inputFed < inputSize) {
+                    piece = inputSize - inputFed;
+                    if (piece > (1L << 30))
+                        piece = (1L << 30);
+                    strm.next_in = (Bytef *) (input + inputFed);
+                    strm.avail_in = (uInt) piece;
+                    inputFed += piece;
+                }
+
+                ret = inflate(&strm, Z_NO_FLUSH);
+                if (ret == Z_STREAM_END) {
+                    if (strm.avail_in == 0 && inputFed == inputSize) {
+                        ended = true;
+                        break;
+                    }
+                    // next member
+                    inflateReset(&strm);
+                } else if (ret != Z_OK) {
+                    printf("PmssGzipDecompressor: %s\n", (strm.msg != NULL) ? strm.msg : "unexpected end of file");
+                    return -1;
+                }
+            }
+
+            return (long) ((char *) strm.next_out - dest);
+        }
+
+        long inputPos() {
+            return inputFed - (long) strm.avail_in;
+        }
+    };
+#endif
+
+
+#ifdef PMSS_LZMA
+    // xz, several streams may be concatenated; files with several blocks 
+    // (xz -T) are decompressed with several threads by liblzma 5.4 and later
+    class PmssXzDecompressor : public PmssDecompressor {
+    private:
+        lzma_stream strm;
+        bool initialized;
+        bool ended;
+        int numThreads;
+        long inputSize;
+
+    public:
+        PmssXzDecompressor(int newNumThreads) {
+            lzma_stream init = LZMA_STREAM_INIT;
+            strm = init;
+            initialized = false;
+            ended = false;
+            numThreads = newNumThreads;
+            inputSize = 0;
+        }
+
+        ~PmssXzDecompressor() {
+            if (initialized)
+                lzma_end(&strm);
+        }
+
+        bool begin(const char * input, long newInputSize) {
+            lzma_stream init = LZMA_STREAM_INIT;
+            lzma_ret ret;
+
+            if (initialized)
+                lzma_end(&strm);
+            strm = init;
+
+#if LZMA_VERSION >= 50040002
+            if (numThreads > 1) {
+                lzma_mt mt;
+                memset(&mt, 0, sizeof(mt));
+                mt.flags = LZMA_CONCATENATED;
+                mt.threads = numThreads;
+                mt.memlimit_threading = lzma_physmem() / 4;
+                mt.memlimit_stop = UINT64_MAX;
+                ret = lzma_stream_decoder_mt(&strm, &mt);
+            } else
+#endif
+            ret = lzma_stream_decoder(&strm, UINT64_MAX, LZMA_CONCATENATED);
+
+            initialized = (ret == LZMA_OK);
+            strm.next_in = (const uint8_t *) input;
+            strm.avail_in = (size_t) newInputSize;
+            inputSize = newInputSize;
+            ended = false;
+
+            return initialized;
+        }
+
+        long decompress(char * dest, long size) {
+            lzma_ret ret;
+
+            if (ended)
+                return 0;
+
+            strm.next_out = (uint8_t *) dest;
+            strm.avail_out = (size_t) size;
+
+            while (strm.avail_out > 0) {
+                // all the input is there from the beginning
+                ret = lzma_code(&strm, (strm.avail_in > 0) ? LZMA_RUN : LZMA_FINISH);
+                if (ret == LZMA_STREAM_END) {
+                    ended = true;
+                    break;
+                }
+                if (ret != LZMA_OK) {
+                    printf("PmssXzDecompressor: Decompression failed (lzma error %d).\n", (int) ret);
+                    return -1;
+                }
+            }
+
+            return (long) ((char *) strm.next_out - dest);
+        }
+
+        long inputPos() {
+            return inputSize - (long) strm.avail_in;
+        }
+
+        // the uncompressed size is stored in the index at the end of each stream
+        long outputSize(const char * input, long size) {
+            long result = -1;
+#if LZMA_VERSION >= 50040002
+            lzma_stream info = LZMA_STREAM_INIT;
+            lzma_index * index = NULL;
+            lzma_ret ret;
+
+            if (lzma_file_info_decoder(&info, &index, UINT64_MAX, (uint64_t) size) != LZMA_OK) {
+                return -1;
+            }
+            info.next_in = (const uint8_t *) input;
+            info.avail_in = (size_t) size;
+            while ((ret = lzma_code(&info, LZMA_RUN)) == LZMA_SEEK_NEEDED) {
+                info.next_in = (const uint8_t *) input + info.seek_pos;
+                info.avail_in = (size_t) (size - (long) info.seek_pos);
+            }
+            if (ret == LZMA_STREAM_END && index != NULL) {
+                result = (long) lzma_index_uncompressed_size(index);
+            }
+            if (index != NULL) {
+                lzma_index_end(index, NULL);
+            }
+            lzma_end(&info);
+#endif
+            return result;
+        }
+    };
+#endif
+
+
+#ifdef PMSS_ZSTD
+    // zstd, one or more frames (skippable frames, e.g. the seek table, are ignored)
+    class PmssZstdDecompressor : public PmssDecompressor {
+    private:
+        ZSTD_DStream * dstream;
+        ZSTD_inBuffer in;
+        size_t lastRet;     // 0 after a complete frame
+
+    public:
+        PmssZstdDecompressor() {
+            dstream = ZSTD_createDStream();
+            in.src = NULL;
+            in.size = 0;
+            in.pos = 0;
+            lastRet = 0;
+        }
+
+        ~PmssZstdDecompressor() {
+            if (dstream != NULL)
+                ZSTD_freeDStream(dstream);
+        }
+
+        bool begin(const char * input, long inputSize) {
+            if (dstream == NULL || ZSTD_isError(ZSTD_initDStream(dstream))) {
+                return false;
+            }
+            in.src = input;
+            in.size = (size_t) inputSize;
+            in.pos = 0;
+            lastRet = 0;
+
+            return true;
+        }
+
+        long decompress(char * dest, long size) {
+            ZSTD_outBuffer out;
+            size_t before, ret;
+
+            out.dst = dest;
+            out.size = (size_t) size;
+            out.pos = 0;
+
+            while (out.pos < out.size) {
+                before = out.pos;
+                ret = ZSTD_decompressStream(dstream, &out, &in);
+                if (ZSTD_isError(ret)) {
+                    printf("PmssZstdDecompressor: %s\n", ZSTD_getErrorName(ret));
+                    return -1;
+                }
+                if (in.pos == in.size && out.pos == before) {
+                    if (lastRet != 0) {
+                        printf("PmssZstdDecompressor: Unexpected end of file.\n");
+                        return -1;
+                    }
+                    break;
+                }
+                lastRet = ret;
+            }
+
+            return (long) out.pos;
+        }
+
+        long inputPos() {
+            return (long) in.pos;
+        }
+
+        // only walks through the frame and block headers
+        bool findFrames(const char * input, long inputSize, vector<pmssFrame> & frames) {
+            pmssFrame frame;
+            unsigned int magic;
+            unsigned long long contentSize;
+            size_t frameSize;
+            long offset = 0;
+            long outOffset = 0;
+
+            frames.clear();
+            while (offset < inputSize) {
+                frameSize = ZSTD_findFrameCompressedSize(input + offset, (size_t) (inputSize - offset));
+                if (ZSTD_isError(frameSize)) {
+                    frames.clear();
+                    return false;
+                }
+
+                // skippable frames have the magic numbers 0x184D2A50 to 0x184D2A5F
+                memcpy(&magic, input + offset, sizeof(magic));
+                if ((magic & 0xFFFFFFF0U) != 0x184D2A50U) {
+                    contentSize = ZSTD_getFrameContentSize(input + offset, frameSize);
+                    if (contentSize == ZSTD_CONTENTSIZE_UNKNOWN || contentSize == ZSTD_CONTENTSIZE_ERROR) {
+                        frames.clear();
+                        return false;
+                    }
+                    frame.inOffset = offset;
+                    frame.inSize = (long) frameSize;
+                    frame.outOffset = outOffset;
+                    frame.outSize = (long) contentSize;
+                    frames.push_back(frame);
+                    outOffset += frame.outSize;
+                }
+
+                offset += (long) frameSize;
+            }
+
+            return true;
+        }
+    };
+#endif
+
+
+    PmssDecompressor * PmssDecompressor::create(int format, int numThreads) {
+        switch (format) {
+#ifdef PMSS_ZLIB
+            case PMSS_COMPRESS_GZIP:
+                return new PmssGzipDecompressor();
+#endif
+#ifdef PMSS_LZMA
+            case PMSS_COMPRESS_XZ:
+                return new PmssXzDecompressor(numThreads);
+#endif
+#ifdef PMSS_ZSTD
+            case PMSS_COMPRESS_ZSTD:
+                return new PmssZstdDecompressor();
+#endif
+            default:
+                return NULL;
+        }
+    }
+
+
+    PmssCompressedSource::PmssCompressedSource() {
+        format = PMSS_COMPRESS_NONE;
+        numThreads = defaultThreads;
+        fd = -1;
+        input = NULL;
+        inputSize = 0;
+        inputReleased = 0;
+        chunkSize = 0;
+        outputSize = -1;
+        nextTask = 0;
+        numTasks = -1;
+        currTask = 0;
+        stopping = false;
+        failed = false;
+        workers = NULL;
+        posInChunk = 0;
+        pos = 0;
+        buffer = NULL;
+        bufferSize = 0;
+    }
+
+    PmssCompressedSource::~PmssCompressedSource() {
+        close();
+
+        if (buffer != NULL) {
+            free(buffer);
+        }
+    }
+
+    static bool hasSuffix(string & fileName, const char * suffix) {
+        size_t length = strlen(suffix);
+        return (fileName.length() > length && fileName.compare(fileName.length() - length, length, suffix) == 0);
+    }
+
+    int PmssCompressedSource::getCompression(string fileName) {
+        if (hasSuffix(fileName, ".gz")) 
+            return PMSS_COMPRESS_GZIP;
+        if (hasSuffix(fileName, ".xz")) 
+            return PMSS_COMPRESS_XZ;
+        if (hasSuffix(fileName, ".zst")) 
+            return PMSS_COMPRESS_ZSTD;
+        return PMSS_COMPRESS_NONE;
+    }
+
+    const char * PmssCompressedSource::getCompressionName(int format) {
+        switch (format) {
+            case PMSS_COMPRESS_GZIP:
+                return "gzip";
+            case PMSS_COMPRESS_XZ:
+                return "xz";
+            case PMSS_COMPRESS_ZSTD:
+                return "zstd";
+            default:
+                return "none";
+        }
+    }
+
+    void PmssCompressedSource::setDecompression(int numThreads, int readAhead) {
+        defaultThreads = (numThreads > 1) ? numThreads : 1;
+        defaultReadAhead = (readAhead > 1) ? readAhead : 1;
+    }
+
+    bool PmssCompressedSource::open(string newFileName) {
+        struct stat st;
+        void * addr;
+        PmssDecompressor * probe;
+        long maxOutSize = 0;
+        size_t i;
+        int ringSize;
+
+        close();
+
+        format = getCompression(newFileName);
+        numThreads = defaultThreads;
+        fileName = newFileName;
+
+        probe = PmssDecompressor::create(format, 1);
+        if (probe == NULL) {
+            printf("PmssCompressedSource: Reading %s needs %s support, which was not compiled in.\n", 
+                fileName.c_str(), getCompressionName(format));
+            return false;
+        }
+
+        fd = ::open(fileName.c_str(), O_RDONLY);
+        if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+            delete probe;
+            close();
+            return false;
+        }
+        inputSize = (long) st.st_size;
+
+        addr = mmap(NULL, inputSize, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            printf("PmssCompressedSource: mmap failed for %s\n", fileName.c_str());
+            delete probe;
+            close();
+            return false;
+        }
+        input = (char *) addr;
+        madvise(input, inputSize, MADV_SEQUENTIAL);
+
+        // frames are only worth it, if there are several of them
+        outputSize = probe->outputSize(input, inputSize);
+        if (probe->findFrames(input, inputSize, frames)) {
+            outputSize = 0;
+            for (i = 0; i < frames.size(); i++) {
+                if (frames[i].outSize > maxOutSize) 
+                    maxOutSize = frames[i].outSize;
+                outputSize += frames[i].outSize;
+            }
+            if (frames.size() < 2 || maxOutSize > maxFrameSize) {
+                frames.clear();
+            }
+        }
+        delete probe;
+
+        // the reader holds one chunk, the workers fill the others
+        ringSize = defaultReadAhead + 1;
+        if (frames.size() > 0 && ringSize < numThreads + 1) {
+            ringSize = numThreads + 1;
+        }
+        chunkSize = (frames.size() > 0) ? maxOutSize : streamChunkSize;
+        if (chunkSize < 64) {
+            chunkSize = 64;
+        }
+
+        ring.resize(ringSize);
+        for (i = 0; i < ring.size(); i++) {
+            if (posix_memalign((void **) &ring[i].data, 64, chunkSize) != 0) {
+                PmssIngest_error("PmssCompressedSource: Could not allocate memory for decompressing.\n");
+            }
+            ring[i].capacity = chunkSize;
+            ring[i].size = 0;
+            ring[i].task = -1;
+            ring[i].ready = false;
+        }
+
+        if (frames.size() > 0) {
+            PmssLog(PMSS_LOG_INFO, "Decompressing %s (%s, %ld frames) with %d threads, up to %d frames ahead.\n", 
+                fileName.c_str(), getCompressionName(format), (long) frames.size(), numThreads, ringSize - 1);
+        } else {
+            PmssLog(PMSS_LOG_INFO, "Decompressing %s (%s) as a stream, up to %d chunks of %ld MB ahead.\n", 
+                fileName.c_str(), getCompressionName(format), ringSize - 1, chunkSize / (1024*1024));
+        }
+
+        startWorkers(0);
+
+        return true;
+    }
+
+    void PmssCompressedSource::close() {
+        size_t i;
+
+        stopWorkers();
+
+        for (i = 0; i < ring.size(); i++) {
+            free(ring[i].data);
+        }
+        ring.clear();
+        frames.clear();
+
+        if (input != NULL) {
+            munmap(input, inputSize);
+            input = NULL;
+        }
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+        inputSize = 0;
+        outputSize = -1;
+        posInChunk = 0;
+        pos = 0;
+    }
+
+    bool PmssCompressedSource::isOpen() {
+        return (input != NULL);
+    }
+
+    /* Start decompressing at this chunk (0) or frame */
+    void PmssCompressedSource::startWorkers(long firstTask) {
+        size_t i;
+        int n;
+
+        for (i = 0; i < ring.size(); i++) {
+            ring[i].size = 0;
+            ring[i].task = -1;
+            ring[i].ready = false;
+        }
+
+        nextTask = firstTask;
+        currTask = firstTask;
+        numTasks = (frames.size() > 0) ? (long) frames.size() : -1;
+        stopping = false;
+        failed = false;
+        posInChunk = 0;
+        pos = (frames.size() > 0) ? frames[firstTask].outOffset : 0;
+        inputReleased = 0;
+
+        workers = new boost::thread_group();
+        if (frames.size() > 0) {
+            for (n = 0; n < numThreads; n++) {
+                workers->create_thread(boost::bind(&PmssCompressedSource::frameWorker, this));
+            }
+        } else {
+            workers->create_thread(boost::bind(&PmssCompressedSource::streamWorker, this));
+        }
+    }
+
+    void PmssCompressedSource::stopWorkers() {
+        if (workers == NULL) {
+            return;
+        }
+
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            stopping = true;
+            cond.notify_all();
+        }
+        workers->join_all();
+        delete workers;
+        workers = NULL;
+    }
+
+    /* Give the pages of compressed input between from and to back (as far 
+     * as they are completely inside), returns the end of the released pages */
+    long PmssCompressedSource::releaseInput(long from, long to) {
+        long pageSize, start, end;
+
+        pageSize = sysconf(_SC_PAGESIZE);
+        start = ((from + pageSize - 1) / pageSize) * pageSize;
+        end = (to / pageSize) * pageSize;
+        if (end > start) {
+            madvise(input + start, end - start, MADV_DONTNEED);
+            return end;
+        }
+        return from;
+    }
+
+    /* Decompress the whole file as one stream, chunk by chunk */
+    void PmssCompressedSource::streamWorker() {
+        PmssDecompressor * decompressor;
+        long task, n, got;
+        bool ok;
+
+        decompressor = PmssDecompressor::create(format, numThreads);
+        ok = (decompressor != NULL && decompressor->begin(input, inputSize));
+        if (!ok) {
+            boost::mutex::scoped_lock lock(mutex);
+            printf("PmssCompressedSource: Could not start decompressing %s.\n", fileName.c_str());
+            failed = true;
+            cond.notify_all();
+        }
+
+        while (ok) {
+            {
+                boost::mutex::scoped_lock lock(mutex);
+                while (!stopping && nextTask >= currTask + (long) ring.size()) {
+                    cond.wait(lock);
+                }
+                if (stopping) {
+                    break;
+                }
+                task = nextTask++;
+            }
+
+            pmssChunk & chunk = ring[task % ring.size()];
+            n = 0;
+            got = 1;
+            while (n < chunk.capacity && (got = decompressor->decompress(chunk.data + n, chunk.capacity - n)) > 0) {
+                n += got;
+            }
+            inputReleased = releaseInput(inputReleased, decompressor->inputPos());
+
+            boost::mutex::scoped_lock lock(mutex);
+            chunk.size = n;
+            chunk.task = task;
+            chunk.ready = true;
+            if (got < 0) {
+                printf("PmssCompressedSource: Could not decompress %s.\n", fileName.c_str());
+                failed = true;
+                ok = false;
+            } else if (got == 0) {
+                numTasks = task + 1;
+                ok = false;
+            }
+            cond.notify_all();
+        }
+
+        delete decompressor;
+    }
+
+    /* Decompress one frame after the other, several of these run in parallel */
+    void PmssCompressedSource::frameWorker() {
+        PmssDecompressor * decompressor;
+        long task, n, got;
+
+        decompressor = PmssDecompressor::create(format, 1);
+        if (decompressor == NULL) {
+            boost::mutex::scoped_lock lock(mutex);
+            failed = true;
+            cond.notify_all();
+            return;
+        }
+
+        while (true) {
+            {
+                boost::mutex::scoped_lock lock(mutex);
+                while (!stopping && nextTask < numTasks && nextTask >= currTask + (long) ring.size()) {
+                    cond.wait(lock);
+                }
+                if (stopping || nextTask >= numTasks) {
+                    break;
+                }
+                task = nextTask++;
+            }
+
+            pmssFrame & frame = frames[task];
+            pmssChunk & chunk = ring[task % ring.size()];
+            n = 0;
+            got = decompressor->begin(input + frame.inOffset, frame.inSize) ? 1 : -1;
+            while (got > 0 && n < frame.outSize && (got = decompressor->decompress(chunk.data + n, frame.outSize - n)) > 0) {
+                n += got;
+            }
+            releaseInput(frame.inOffset, frame.inOffset + frame.inSize);
+
+            boost::mutex::scoped_lock lock(mutex);
+            chunk.size = n;
+            chunk.task = task;
+            chunk.ready = true;
+            if (got < 0 || n != frame.outSize) {
+                printf("PmssCompressedSource: Could not decompress frame %ld of %s.\n", task, fileName.c_str());
+                failed = true;
+            }
+            cond.notify_all();
+        }
+
+        delete decompressor;
+    }
+
+    /* Wait until the chunk at the current position is decompressed; a chunk 
+     * that is used up is given back to the workers first. False at the end
+     * of the file or if decompressing failed. */
+    bool PmssCompressedSource::waitChunk() {
+        boost::mutex::scoped_lock lock(mutex);
+
+        while (true) {
+            pmssChunk & chunk = ring[currTask % ring.size()];
+
+            if (chunk.ready && chunk.task == currTask) {
+                if (posInChunk < chunk.size) {
+                    return true;
+                }
+                chunk.ready = false;
+                chunk.task = -1;
+                currTask++;
+                posInChunk = 0;
+                cond.notify_all();
+                continue;
+            }
+
+            if (failed || (numTasks >= 0 && currTask >= numTasks)) {
+                return false;
+            }
+            cond.wait(lock);
+        }
+    }
+
+    /* Copy the next size bytes to dest, or skip them if dest is NULL */
+    bool PmssCompressedSource::take(char * dest, long size) {
+        long n;
+
+        while (size > 0) {
+            if (!waitChunk()) {
+                return false;
+            }
+
+            pmssChunk & chunk = ring[currTask % ring.size()];
+            n = chunk.size - posInChunk;
+            if (n > size) {
+                n = size;
+            }
+            if (dest != NULL) {
+                memcpy(dest, chunk.data + posInChunk, n);
+                dest += n;
+            }
+            posInChunk += n;
+            pos += n;
+            size -= n;
+        }
+
+        return true;
+    }
+
+    bool PmssCompressedSource::read(char * dest, long size) {
+        if (!isOpen()) {
+            return false;
+        }
+        return take(dest, size);
+    }
+
+    const char * PmssCompressedSource::next(long size) {
+        const char * data;
+
+        if (!isOpen() || !waitChunk()) {
+            return NULL;
+        }
+
+        // inside the current chunk: use it in place
+        pmssChunk & chunk = ring[currTask % ring.size()];
+        if (chunk.size - posInChunk >= size) {
+            data = chunk.data + posInChunk;
+            posInChunk += size;
+            pos += size;
+            return data;
+        }
+
+        // crosses the end of the chunk: copy the pieces into the buffer
+        if (size > bufferSize) {
+            if (buffer != NULL) {
+                free(buffer);
+                buffer = NULL;
+            }
+            bufferSize = size;
+            if (posix_memalign((void **) &buffer, 64, bufferSize) != 0) {
+                buffer = NULL;
+                bufferSize = 0;
+                PmssIngest_error("PmssCompressedSource: Could not allocate memory for data block.\n");
+            }
+        }
+
+        if (!take(buffer, size)) {
+            return NULL;
+        }
+
+        return buffer;
+    }
+
+    bool PmssCompressedSource::seek(long newPos) {
+        long lo, hi, mid;
+
+        if (!isOpen() || newPos < 0) {
+            return false;
+        }
+        if (newPos == pos) {
+            return true;
+        }
+
+        if (frames.size() > 0) {
+            // frame containing newPos
+            lo = 0;
+            hi = (long) frames.size() - 1;
+            while (lo < hi) {
+                mid = (lo + hi + 1) / 2;
+                if (frames[mid].outOffset <= newPos) {
+                    lo = mid;
+                } else {
+                    hi = mid - 1;
+                }
+            }
+            if (newPos < pos || lo >= currTask + (long) ring.size()) {
+                stopWorkers();
+                startWorkers(lo);
+            }
+        } else if (newPos < pos) {
+            PmssLog(PMSS_LOG_DEBUG, "PmssCompressedSource: Seeking backwards, decompressing %s again.\n", fileName.c_str());
+            stopWorkers();
+            startWorkers(0);
+        }
+
+        return take(NULL, newPos - pos);
+    }
+
+    long PmssCompressedSource::tell() {
+        return pos;
+    }
+
+    /* Size of the decompressed file; if it is not stored in the file, 
+     * it is decompressed once (without keeping the data) */
+    long PmssCompressedSource::size() {
+        PmssDecompressor * decompressor;
+        char * scratch;
+        long n, total, released;
+
+        if (outputSize >= 0 || !isOpen()) {
+            return outputSize;
+        }
+
+        PmssLog(PMSS_LOG_INFO, "Size of %s is not stored, decompressing it once to count the bytes.\n", fileName.c_str());
+
+        scratch = (char *) malloc(streamChunkSize);
+        if (scratch == NULL) {
+            PmssIngest_error("PmssCompressedSource: Could not allocate memory for decompressing.\n");
+        }
+
+        decompressor = PmssDecompressor::create(format, numThreads);
+        if (decompressor != NULL && decompressor->begin(input, inputSize)) {
+            total = 0;
+            released = 0;
+            while ((n = decompressor->decompress(scratch, streamChunkSize)) > 0) {
+                total += n;
+                released = releaseInput(released, decompressor->inputPos());
+            }
+            if (n == 0) {
+                outputSize = total;
+            }
+        }
+
+        delete decompressor;
+        free(scratch);
+
+        return outputSize;
+    }
+
+}
@@ -0,0 +1,155 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+#include "Pmss_FileSource.h"
+
+#ifndef Pmss_Pmss_CompressedSource_h
+#define Pmss_Pmss_CompressedSource_h
+
+namespace Pmss {
+
+    enum { PMSS_COMPRESS_NONE = 0, PMSS_COMPRESS_GZIP = 1, PMSS_COMPRESS_XZ = 2, PMSS_COMPRESS_ZSTD = 3 };
+
+    // one zstd frame, which can be decompressed independently of the others
+    typedef struct {
+        long inOffset;
+        long inSize;
+        long outOffset;
+        long outSize;
+    } pmssFrame;
+
+    // Decompresses one compressed file (or frame) from memory, piece by piece
+    class PmssDecompressor {
+    public:
+        virtual ~PmssDecompressor() {}
+
+        // start (again) at the beginning of these compressed bytes
+        virtual bool begin(const char * input, long inputSize) = 0;
+
+        // decompress up to size bytes into dest; returns the number of bytes,
+        // 0 at the end of the input and -1 on errors
+        virtual long decompress(char * dest, long size) = 0;
+
+        // compressed bytes consumed so far
+        virtual long inputPos() = 0;
+
+        // size of the decompressed file, if it can be found without 
+        // decompressing everything; -1 otherwise
+        virtual long outputSize(const char * input, long inputSize) { return -1; }
+
+        // split into independent frames with known sizes (which also gives 
+        // the size of the decompressed file); false if not possible
+        virtual bool findFrames(const char * input, long inputSize, std::vector<pmssFrame> & frames) { return false; }
+
+        // NULL if support for this format was not compiled in
+        static PmssDecompressor * create(int format, int numThreads);
+    };
+
+
+    // decompressed piece of the file in the read-ahead ring
+    typedef struct {
+        char * data;
+        long capacity;
+        long size;
+        long task;      // number of the chunk (or frame) in the file, -1 while free
+        bool ready;
+    } pmssChunk;
+
+    // Compressed data file (.gz, .xz or .zst), decompressed while it is read.
+    // The compressed file is mapped into memory and decompressed by worker 
+    // threads into a ring of chunks, at most readAhead chunks ahead of the 
+    // reader. zstd files with several frames (seekable format, zstd -T, pzstd) 
+    // are decompressed frame by frame with several threads; all other files 
+    // by one thread as a stream (xz may use several threads inside liblzma). 
+    // Seeking forward skips, seeking backward starts decompressing again,
+    // at the frame containing the position or at the beginning of the file.
+    class PmssCompressedSource : public PmssFileSource {
+    private:
+        static int defaultThreads;
+        static int defaultReadAhead;
+
+        int format;
+        int numThreads;
+        std::string fileName;
+
+        int fd;
+        char * input;
+        long inputSize;
+        long inputReleased;     // pages before this are given back (streaming)
+
+        std::vector<pmssFrame> frames;  // empty, if decompressed as a stream
+        long chunkSize;
+        long outputSize;        // -1 until known
+
+        // shared with the workers, protected by mutex
+        std::vector<pmssChunk> ring;
+        long nextTask;      // next chunk/frame to be decompressed
+        long numTasks;      // -1 as long as the end of the stream is not reached
+        long currTask;      // chunk/frame the reader is in
+        bool stopping;
+        bool failed;
+        boost::mutex mutex;
+        boost::condition_variable cond;
+        boost::thread_group * workers;
+
+        long posInChunk;
+        long pos;
+
+        // pieces crossing chunk boundaries are copied into this buffer
+        char * buffer;
+        long bufferSize;
+
+        void startWorkers(long firstTask);
+        void stopWorkers();
+        void streamWorker();
+        void frameWorker();
+        long releaseInput(long from, long to);
+        bool waitChunk();
+        bool take(char * dest, long size);
+
+    public:
+        PmssCompressedSource();
+        ~PmssCompressedSource();
+
+        // PMSS_COMPRESS_GZIP, _XZ or _ZSTD from the file name, else PMSS_COMPRESS_NONE
+        static int getCompression(std::string fileName);
+
+        static const char * getCompressionName(int format);
+
+        // used by all compressed sources opened afterwards
+        static void setDecompression(int numThreads, int readAhead);
+
+        bool open(std::string fileName);
+        void close();
+        bool isOpen();
+        bool read(char * dest, long size);
+        const char * next(long size);
+        bool seek(long pos);
+        long tell();
+        long size();
+    };
+
+}
+
+#endif
@@ -0,0 +1,482 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "Pmss_Derived.h"
+
+using namespace std;
+
+namespace Pmss {
+
+    enum { NODE_NUMBER = 0, NODE_FIELD, NODE_CONST, NODE_UNARY, NODE_BINARY };
+
+    enum { OP_ADD = 0, OP_SUB, OP_MUL, OP_DIV, OP_NEG, OP_SQRT, OP_ABS, OP_FLOOR };
+
+    // steps: on two slots, on a slot and a value (C), or on a value and a slot
+    enum { STEP_CONST = 0, STEP_COPY, STEP_ADD, STEP_SUB, STEP_MUL, STEP_DIV, 
+           STEP_ADDC, STEP_SUBC, STEP_CSUB, STEP_MULC, STEP_DIVC, STEP_CDIV,
+           STEP_NEG, STEP_SQRT, STEP_ABS, STEP_FLOOR };
+
+    static const char * fieldNames[] = {"x", "y", "z", "vx", "vy", "vz"};
+    static const int numFieldNames = 6;
+
+    enum { CONST_AEXPN = 0, CONST_REDSHIFT, CONST_OMEGA0, CONST_OMEGAL0, CONST_HUBBLE, 
+           CONST_BOX, CONST_PARTICLEMASS, CONST_HZ, NUM_CONSTS };
+    static const char * constNames[NUM_CONSTS] = {"aexpn", "redshift", "Omega0", "OmegaL0", "hubble", 
+                                                  "box", "particleMass", "Hz"};
+
+    // column names used by the raw columns, not available for derived ones
+    static const char * reservedNames[] = {"x", "y", "z", "vx", "vy", "vz", "particleId", "phkey", "fileRowId"};
+    static const int numReservedNames = 9;
+
+    PmssDerived::PmssDerived() {
+        numTemps = 0;
+        pos = NULL;
+    }
+
+    int PmssDerived::addNode(int type, int op, int left, int right, double value) {
+        node n;
+
+        n.type = type;
+        n.op = op;
+        n.left = left;
+        n.right = right;
+        n.value = value;
+        nodes.push_back(n);
+
+        return (int) nodes.size() - 1;
+    }
+
+    void PmssDerived::skipSpace() {
+        while (*pos == ' ' || *pos == '\t') 
+            pos++;
+    }
+
+    /* sum := product (('+' | '-') product)* */
+    int PmssDerived::parseSum() {
+        int left, right;
+        char c;
+
+        if ((left = parseProduct()) < 0) {
+            return -1;
+        }
+        skipSpace();
+        while (*pos == '+' || *pos == '-') {
+            c = *pos++;
+            if ((right = parseProduct()) < 0) {
+                return -1;
+            }
+            left = addNode(NODE_BINARY, (c == '+') ? OP_ADD : OP_SUB, left, right, 0);
+            skipSpace();
+        }
+
+        return left;
+    }
+
+    /* product := unary (('*' | '/') unary)* */
+    int PmssDerived::parseProduct() {
+        int left, right;
+        char c;
+
+        if ((left = parseUnary()) < 0) {
+            return -1;
+        }
+        skipSpace();
+        while (*pos == '*' || *pos == '/') {
+            c = *pos++;
+            if ((right = parseUnary()) < 0) {
+                return -1;
+            }
+            left = addNode(NODE_BINARY, (c == '*') ? OP_MUL : OP_DIV, left, right, 0);
+            skipSpace();
+        }
+
+        return left;
+    }
+
+    /* unary := '-' unary | primary */
+    int PmssDerived::parseUnary() {
+        int child;
+
+        skipSpace();
+        if (*pos == '-') {
+            pos++;
+            if ((child = parseUnary()) < 0) {
+                return -1;
+            }
+            return addNode(NODE_UNARY, OP_NEG, child, -1, 0);
+        }
+
+        return parsePrimary();
+    }
+
+    /* primary := number | field | constant | function '(' sum ')' | '(' sum ')' */
+    int PmssDerived::parsePrimary() {
+        const char * start;
+        char * end;
+        string name;
+        double value;
+        int child, op, i;
+
+        skipSpace();
+        if (*pos == '(') {
+            pos++;
+            if ((child = parseSum()) < 0) {
+                return -1;
+            }
+            if (*pos != ')') {
+                parseError = "missing )";
+                return -1;
+            }
+            pos++;
+            return child;
+        }
+
+        if (isdigit((unsigned char) *pos) || *pos == '.') {
+            value = strtod(pos, &end);
+            if (end == pos) {
+                parseError = "invalid number";
+                return -1;
+            }
+            pos = end;
+            return addNode(NODE_NUMBER, 0, -1, -1, value);
+        }
+
+        start = pos;
+        while (isalnum((unsigned char) *pos) || *pos == '_') 
+            pos++;
+        name = string(start, pos - start);
+        if (name.length() == 0) {
+            parseError = (*pos == '\0') ? "unexpected end" : string("unexpected character ") + *pos;
+            return -1;
+        }
+
+        skipSpace();
+        if (*pos == '(') {
+            if (name.compare("sqrt") == 0) {
+                op = OP_SQRT;
+            } else if (name.compare("abs") == 0) {
+                op = OP_ABS;
+            } else if (name.compare("floor") == 0) {
+                op = OP_FLOOR;
+            } else {
+                parseError = "unknown function " + name;
+                return -1;
+            }
+            pos++;
+            if ((child = parseSum()) < 0) {
+                return -1;
+            }
+            if (*pos != ')') {
+                parseError = "missing )";
+                return -1;
+            }
+            pos++;
+            return addNode(NODE_UNARY, op, child, -1, 0);
+        }
+
+        for (i = 0; i < numFieldNames; i++) {
+            if (name.compare(fieldNames[i]) == 0) 
+                return addNode(NODE_FIELD, SLOT_X + i, -1, -1, 0);
+        }
+        for (i = 0; i < NUM_CONSTS; i++) {
+            if (name.compare(constNames[i]) == 0) 
+                return addNode(NODE_CONST, i, -1, -1, 0);
+        }
+
+        parseError = "unknown name " + name;
+        return -1;
+    }
+
+    bool PmssDerived::parse(string text, string * error) {
+        size_t start, end, equal;
+        string column, name;
+        char message[256];
+        int root, i;
+
+        names.clear();
+        expressions.clear();
+        nodes.clear();
+        roots.clear();
+        programs.clear();
+
+        start = 0;
+        while (start < text.length()) {
+            end = text.find(';', start);
+            if (end == string::npos) 
+                end = text.length();
+            column = text.substr(start, end - start);
+            start = end + 1;
+
+            equal = column.find('=');
+            if (equal == string::npos) {
+                snprintf(message, sizeof(message), "no name=expression in '%s'", column.c_str());
+                *error = message;
+                return false;
+            }
+
+            // name: letters, digits and _, not a raw column and not twice
+            name = column.substr(0, equal);
+            while (name.length() > 0 && name[0] == ' ') 
+                name.erase(0, 1);
+            while (name.length() > 0 && name[name.length()-1] == ' ') 
+                name.erase(name.length()-1);
+            if (name.length() == 0 || isdigit((unsigned char) name[0])) {
+                *error = "invalid column name '" + name + "'";
+                return false;
+            }
+            for (i = 0; i < (int) name.length(); i++) {
+                if (!isalnum((unsigned char) name[i]) && name[i] != '_') {
+                    *error = "invalid column name '" + name + "'";
+                    return false;
+                }
+            }
+            for (i = 0; i < numReservedNames; i++) {
+                if (name.compare(reservedNames[i]) == 0) {
+                    *error = "column " + name + " exists already";
+                    return false;
+                }
+            }
+            for (i = 0; i < (int) names.size(); i++) {
+                if (name.compare(names[i]) == 0) {
+                    *error = "column " + name + " is given twice";
+                    return false;
+                }
+            }
+
+            parseError = "";
+            pos = column.c_str() + equal + 1;
+            root = parseSum();
+            if (root >= 0 && *pos != '\0') {
+                parseError = (*pos == ')') ? "unexpected )" : string("unexpected character ") + *pos;
+                root = -1;
+            }
+            if (root < 0) {
+                snprintf(message, sizeof(message), "%s in the expression of %s", parseError.c_str(), name.c_str());
+                *error = message;
+                return false;
+            }
+
+            names.push_back(name);
+            expressions.push_back(column.substr(equal + 1));
+            roots.push_back(root);
+        }
+
+        return true;
+    }
+
+    size_t PmssDerived::size() const {
+        return names.size();
+    }
+
+    const string & PmssDerived::getName(size_t i) const {
+        return names[i];
+    }
+
+    const string & PmssDerived::getExpression(size_t i) const {
+        return expressions[i];
+    }
+
+    /* Turn the subtree into steps writing to dest (a new temporary if -1);
+     * subtrees without fields are folded into a constant */
+    PmssDerived::operand PmssDerived::compile(int index, int dest, const double * constants, vector<step> & program) {
+        const node & n = nodes[index];
+        operand result, a, b;
+        step s;
+
+        result.isConst = false;
+        result.value = 0;
+        result.slot = -1;
+
+        switch (n.type) {
+            case NODE_NUMBER:
+                result.isConst = true;
+                result.value = n.value;
+                return result;
+            case NODE_CONST:
+                result.isConst = true;
+                result.value = constants[n.op];
+                return result;
+            case NODE_FIELD:
+                result.slot = n.op;
+                return result;
+        }
+
+        a = compile(n.left, -1, constants, program);
+        if (n.type == NODE_BINARY) {
+            b = compile(n.right, -1, constants, program);
+        } else {
+            b = a;
+        }
+
+        if (a.isConst && b.isConst) {
+            result.isConst = true;
+            switch (n.op) {
+                case OP_ADD: result.value = a.value + b.value; break;
+                case OP_SUB: result.value = a.value - b.value; break;
+                case OP_MUL: result.value = a.value * b.value; break;
+                case OP_DIV: result.value = a.value / b.value; break;
+                case OP_NEG: result.value = -a.value; break;
+                case OP_SQRT: result.value = sqrt(a.value); break;
+                case OP_ABS: result.value = fabs(a.value); break;
+                case OP_FLOOR: result.value = floor(a.value); break;
+            }
+            return result;
+        }
+
+        if (dest < 0) {
+            dest = SLOT_TEMP + numTemps++;
+        }
+        s.dest = dest;
+        s.left = a.slot;
+        s.right = b.slot;
+        s.value = 0;
+
+        if (n.type == NODE_UNARY) {
+            switch (n.op) {
+                case OP_NEG: s.op = STEP_NEG; break;
+                case OP_SQRT: s.op = STEP_SQRT; break;
+                case OP_ABS: s.op = STEP_ABS; break;
+                default: s.op = STEP_FLOOR; break;
+            }
+        } else if (!a.isConst && !b.isConst) {
+            s.op = STEP_ADD + n.op;
+        } else if (b.isConst) {
+            s.value = (float) b.value;
+            switch (n.op) {
+                case OP_ADD: s.op = STEP_ADDC; break;
+                case OP_SUB: s.op = STEP_SUBC; break;
+                case OP_MUL: s.op = STEP_MULC; break;
+                default: s.op = STEP_DIVC; break;
+            }
+        } else {
+            s.value = (float) a.value;
+            s.left = b.slot;
+            switch (n.op) {
+                case OP_ADD: s.op = STEP_ADDC; break;
+                case OP_SUB: s.op = STEP_CSUB; break;
+                case OP_MUL: s.op = STEP_MULC; break;
+                default: s.op = STEP_CDIV; break;
+            }
+        }
+        program.push_back(s);
+
+        result.slot = dest;
+        return result;
+    }
+
+    void PmssDerived::bind(const pmssHeader & header) {
+        double constants[NUM_CONSTS];
+        double a;
+        operand result;
+        step s;
+        size_t i;
+
+        a = header.aexpn;
+        constants[CONST_AEXPN] = a;
+        constants[CONST_REDSHIFT] = 1.0/a - 1.0;
+        constants[CONST_OMEGA0] = header.Omega0;
+        constants[CONST_OMEGAL0] = header.OmegaL0;
+        constants[CONST_HUBBLE] = header.hubble;
+        constants[CONST_BOX] = header.box;
+        constants[CONST_PARTICLEMASS] = header.particleMass;
+        // H(a) in units of h km/s/Mpc, with curvature if Omega0 + OmegaL0 != 1
+        constants[CONST_HZ] = 100. * sqrt(header.Omega0/(a*a*a) + (1. - header.Omega0 - header.OmegaL0)/(a*a) + header.OmegaL0);
+
+        programs.clear();
+        numTemps = 0;
+        for (i = 0; i < roots.size(); i++) {
+            programs.push_back(vector<step>());
+            result = compile(roots[i], SLOT_RESULT, constants, programs[i]);
+            if (result.isConst || result.slot != SLOT_RESULT) {
+                s.op = result.isConst ? STEP_CONST : STEP_COPY;
+                s.dest = SLOT_RESULT;
+                s.left = result.slot;
+                s.right = -1;
+                s.value = (float) result.value;
+                programs[i].push_back(s);
+            }
+        }
+    }
+
+    /* Run the steps of each column, one simple loop per step, so that the 
+     * compiler can vectorize them */
+    void PmssDerived::evaluate(const float * const * fields, long n, vector<vector<float> > & results) const {
+        vector<float> temps;
+        float * slots[SLOT_TEMP];
+        float * d;
+        const float * l;
+        const float * r;
+        float v;
+        size_t i, j;
+        long k;
+
+        results.resize(names.size());
+        for (i = 0; i < names.size(); i++) {
+            results[i].resize(n);
+        }
+        if (n == 0) {
+            return;
+        }
+
+        temps.resize((size_t) numTemps * n);
+        for (k = 0; k < SLOT_RESULT; k++) {
+            slots[k] = const_cast<float *>(fields[k]);
+        }
+
+        for (i = 0; i < programs.size(); i++) {
+            slots[SLOT_RESULT] = &results[i][0];
+            for (j = 0; j < programs[i].size(); j++) {
+                const step & s = programs[i][j];
+
+                d = (s.dest < SLOT_TEMP) ? slots[s.dest] : &temps[(size_t) (s.dest - SLOT_TEMP) * n];
+                l = (s.left < 0) ? NULL : (s.left < SLOT_TEMP) ? slots[s.left] : &temps[(size_t) (s.left - SLOT_TEMP) * n];
+                r = (s.right < 0) ? NULL : (s.right < SLOT_TEMP) ? slots[s.right] : &temps[(size_t) (s.right - SLOT_TEMP) * n];
+                v = s.value;
+
+                switch (s.op) {
+                    case STEP_CONST: for (k = 0; k < n; k++) d[k] = v; break;
+                    case STEP_COPY: for (k = 0; k < n; k++) d[k] = l[k]; break;
+                    case STEP_ADD: for (k = 0; k < n; k++) d[k] = l[k] + r[k]; break;
+                    case STEP_SUB: for (k = 0; k < n; k++) d[k] = l[k] - r[k]; break;
+                    case STEP_MUL: for (k = 0; k < n; k++) d[k] = l[k] * r[k]; break;
+                    case STEP_DIV: for (k = 0; k < n; k++) d[k] = l[k] / r[k]; break;
+                    case STEP_ADDC: for (k = 0; k < n; k++) d[k] = l[k] + v; break;
+                    case STEP_SUBC: for (k = 0; k < n; k++) d[k] = l[k] - v; break;
+                    case STEP_CSUB: for (k = 0; k < n; k++) d[k] = v - l[k]; break;
+                    case STEP_MULC: for (k = 0; k < n; k++) d[k] = l[k] * v; break;
+                    case STEP_DIVC: for (k = 0; k < n; k++) d[k] = l[k] / v; break;
+                    case STEP_CDIV: for (k = 0; k < n; k++) d[k] = v / l[k]; break;
+                    case STEP_NEG: for (k = 0; k < n; k++) d[k] = -l[k]; break;
+                    case STEP_SQRT: for (k = 0; k < n; k++) d[k] = sqrtf(l[k]); break;
+                    case STEP_ABS: for (k = 0; k < n; k++) d[k] = fabsf(l[k]); break;
+                    case STEP_FLOOR: for (k = 0; k < n; k++) d[k] = floorf(l[k]); break;
+                }
+            }
+        }
+    }
+
+}
@@ -0,0 +1,111 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+
+#include <string>
+#include <vector>
+#include "Pmss_Header.h"
+
+#ifndef Pmss_Pmss_Derived_h
+#define Pmss_Pmss_Derived_h
+
+namespace Pmss {
+
+    // Extra columns computed while decoding, declared on the command line as
+    //   name=expression;name=expression;...
+    // An expression uses + - * / and parentheses, numbers, the functions 
+    // sqrt, abs and floor, the particle fields x, y, z, vx, vy, vz and the 
+    // header constants aexpn, redshift, Omega0, OmegaL0, hubble, box, 
+    // particleMass and Hz (Hubble parameter at aexpn, 100 E(a) km/s per Mpc/h).
+    // For each file the constants are filled in and folded, and each expression
+    // becomes a short list of steps, each of them one loop over a whole batch.
+    class PmssDerived {
+    private:
+        // node of an expression tree, children are indices into nodes
+        typedef struct {
+            int type;
+            int op;         // operator or function, field or constant index
+            int left;
+            int right;
+            double value;   // numbers
+        } node;
+
+        // one loop over the batch: slot dest = slot left <op> slot right or value
+        typedef struct {
+            int op;
+            int dest;
+            int left;
+            int right;
+            float value;
+        } step;
+
+        std::vector<std::string> names;
+        std::vector<std::string> expressions;
+        std::vector<node> nodes;
+        std::vector<int> roots;
+
+        // per column, after bind
+        std::vector<std::vector<step> > programs;
+        int numTemps;
+
+        // parsing state
+        const char * pos;
+        std::string parseError;
+
+        int addNode(int type, int op, int left, int right, double value);
+        void skipSpace();
+        int parseSum();
+        int parseProduct();
+        int parseUnary();
+        int parsePrimary();
+
+        // result of compiling a subtree: a slot or a folded constant
+        typedef struct {
+            bool isConst;
+            double value;
+            int slot;
+        } operand;
+
+        operand compile(int index, int dest, const double * constants, std::vector<step> & program);
+
+    public:
+        // slots of the arrays a step works on: fields, result, temporaries
+        enum { SLOT_X = 0, SLOT_Y, SLOT_Z, SLOT_VX, SLOT_VY, SLOT_VZ, SLOT_RESULT, SLOT_TEMP };
+
+        PmssDerived();
+
+        // parse the command line form; false (and the reason in error) if it is not valid
+        bool parse(std::string text, std::string * error);
+
+        size_t size() const;
+        const std::string & getName(size_t i) const;
+        const std::string & getExpression(size_t i) const;
+
+        // fill in the constants of this file; must be called before evaluate
+        void bind(const pmssHeader & header);
+
+        // compute all columns for n particles; fields are x, y, z, vx, vy, vz
+        void evaluate(const float * const * fields, long n, std::vector<std::vector<float> > & results) const;
+    };
+
+}
+
+#endif
@@ -0,0 +1,156 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <glob.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <algorithm>
+
+#include "Pmss_FileQueue.h"
+
+using namespace std;
+
+namespace Pmss {
+
+    PmssFileQueue::PmssFileQueue() {
+        nextIndex = 0;
+        numParts = 1;
+    }
+
+    PmssFileQueue::~PmssFileQueue() {
+    }
+
+    static bool isIndexFile(string fileName) {
+        return (fileName.length() > 4 && fileName.compare(fileName.length() - 4, 4, ".idx") == 0);
+    }
+
+    void PmssFileQueue::addPath(string path) {
+        struct stat st;
+        glob_t globResult;
+        DIR * dir;
+        struct dirent * entry;
+        vector<string> dirFiles;
+        string name;
+        size_t i;
+
+        if (stat(path.c_str(), &st) == 0) {
+            if (S_ISDIR(st.st_mode)) {
+                // all regular files in the directory, sorted by name
+                dir = opendir(path.c_str());
+                if (dir == NULL) {
+                    printf("Could not open directory %s, skipping it.\n", path.c_str());
+                    return;
+                }
+                while ((entry = readdir(dir)) != NULL) {
+                    name = path + "/" + entry->d_name;
+                    if (entry->d_name[0] != '.' && stat(name.c_str(), &st) == 0 
+                        && S_ISREG(st.st_mode) && !isIndexFile(name)) {
+                        dirFiles.push_back(name);
+                    }
+                }
+                closedir(dir);
+
+                sort(dirFiles.begin(), dirFiles.end());
+                files.insert(files.end(), dirFiles.begin(), dirFiles.end());
+            } else {
+                files.push_back(path);
+            }
+            return;
+        }
+
+        // not an existing file, so try it as a pattern (already sorted by glob)
+        if (glob(path.c_str(), 0, NULL, &globResult) == 0) {
+            for (i = 0; i < globResult.gl_pathc; i++) {
+                name = globResult.gl_pathv[i];
+                if (!isIndexFile(name)) {
+                    files.push_back(name);
+                }
+            }
+        } else {
+            printf("No file matches %s, skipping it.\n", path.c_str());
+        }
+        globfree(&globResult);
+    }
+
+    void PmssFileQueue::addPaths(vector<string> paths) {
+        size_t i;
+
+        for (i = 0; i < paths.size(); i++) {
+            addPath(paths[i]);
+        }
+    }
+
+    void PmssFileQueue::addListFile(string listFileName) {
+        ifstream listFile;
+        string line;
+
+        listFile.open(listFileName.c_str());
+        if (!listFile.is_open()) {
+            printf("Could not open file list %s.\n", listFileName.c_str());
+            return;
+        }
+
+        while (getline(listFile, line)) {
+            // ignore empty lines and comments
+            if (line.length() == 0 || line[0] == '#') {
+                continue;
+            }
+            addPath(line);
+        }
+    }
+
+    bool PmssFileQueue::nextFile(string & fileName, long & index, int & part) {
+        boost::mutex::scoped_lock lock(queueMutex);
+
+        if (nextIndex >= numTasks()) {
+            return false;
+        }
+
+        index = nextIndex;
+        fileName = files[nextIndex / numParts];
+        part = nextIndex % numParts;
+        nextIndex++;
+
+        return true;
+    }
+
+    void PmssFileQueue::setNumParts(int newNumParts) {
+        numParts = (newNumParts > 1) ? newNumParts : 1;
+    }
+
+    int PmssFileQueue::getNumParts() {
+        return numParts;
+    }
+
+    long PmssFileQueue::size() {
+        return (long) files.size();
+    }
+
+    long PmssFileQueue::numTasks() {
+        return (long) files.size() * numParts;
+    }
+
+    string PmssFileQueue::getFile(long index) {
+        return files[index];
+    }
+
+}
@@ -0,0 +1,67 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
+#ifndef Pmss_Pmss_FileQueue_h
+#define Pmss_Pmss_FileQueue_h
+
+namespace Pmss {
+
+    // List of PMss files to be processed, shared by several worker threads.
+    // Each call of nextFile hands out a file that no other worker got yet.
+    // If files are split into parts, each part of a file is handed out separately.
+    class PmssFileQueue {
+    private:
+        std::vector<std::string> files;
+        long nextIndex;
+        int numParts;
+
+        boost::mutex queueMutex;
+
+        void addPath(std::string path);
+
+    public:
+        PmssFileQueue();
+        ~PmssFileQueue();
+
+        // each argument may be a file, a directory (all files in it are used,
+        // except block index sidecars) or a glob pattern like "PMss.*"
+        void addPaths(std::vector<std::string> paths);
+
+        // add all paths given in a text file, one per line
+        void addListFile(std::string listFileName);
+
+        // index counts the tasks, i.e. index = fileIndex*numParts + part
+        bool nextFile(std::string & fileName, long & index, int & part);
+
+        void setNumParts(int numParts);
+        int getNumParts();
+
+        long size();
+        long numTasks();
+        std::string getFile(long index);
+    };
+
+}
+
+#endif
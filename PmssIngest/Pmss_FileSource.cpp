@@ -0,0 +1,270 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pmssingest_error.h"
+
+#include "Pmss_FileSource.h"
+
+using namespace std;
+
+namespace Pmss {
+
+    PmssStreamSource::PmssStreamSource() {
+        buffer = NULL;
+        bufferSize = 0;
+    }
+
+    PmssStreamSource::~PmssStreamSource() {
+        close();
+
+        if (buffer != NULL) {
+            free(buffer);
+        }
+    }
+
+    bool PmssStreamSource::open(string fileName) {
+        if (fileStream.is_open())
+            fileStream.close();
+
+        // open binary file
+        fileStream.open(fileName.c_str(), ios::in | ios::binary);
+
+        return fileStream.is_open();
+    }
+
+    void PmssStreamSource::close() {
+        if (fileStream.is_open())
+            fileStream.close();
+    }
+
+    bool PmssStreamSource::isOpen() {
+        return fileStream.is_open();
+    }
+
+    bool PmssStreamSource::read(char * dest, long size) {
+        if (!fileStream.read(dest, size)) {
+            return false;
+        }
+        return true;
+    }
+
+    const char * PmssStreamSource::next(long size) {
+        // (re)allocate the buffer, if this chunk is larger than all previous ones;
+        // align it, so that the rows can be accessed efficiently
+        if (size > bufferSize) {
+            if (buffer != NULL) {
+                free(buffer);
+                buffer = NULL;
+            }
+            bufferSize = size;
+            if (posix_memalign((void **) &buffer, 64, bufferSize) != 0) {
+                buffer = NULL;
+                bufferSize = 0;
+                PmssIngest_error("PmssStreamSource: Could not allocate memory for data block.\n");
+            }
+        }
+
+        if (!read(buffer, size)) {
+            return NULL;
+        }
+
+        return buffer;
+    }
+
+    bool PmssStreamSource::seek(long pos) {
+        fileStream.clear();
+        fileStream.seekg((streamoff) pos, ios::beg);
+        return !fileStream.fail();
+    }
+
+    long PmssStreamSource::tell() {
+        return (long) fileStream.tellg();
+    }
+
+    long PmssStreamSource::size() {
+        streampos curr;
+        long fileSize;
+
+        curr = fileStream.tellg();
+        fileStream.seekg(0, ios::end);
+        fileSize = (long) fileStream.tellg();
+        fileStream.seekg(curr, ios::beg);
+
+        return fileSize;
+    }
+
+
+    PmssMmapSource::PmssMmapSource() {
+        fd = -1;
+        mapData = NULL;
+        mapSize = 0;
+        pos = 0;
+        window = 64*1024*1024;
+    }
+
+    PmssMmapSource::PmssMmapSource(long newWindow) {
+        fd = -1;
+        mapData = NULL;
+        mapSize = 0;
+        pos = 0;
+        window = newWindow;
+    }
+
+    PmssMmapSource::~PmssMmapSource() {
+        close();
+    }
+
+    bool PmssMmapSource::open(string fileName) {
+        struct stat st;
+        void * addr;
+
+        close();
+
+        fd = ::open(fileName.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close();
+            return false;
+        }
+        mapSize = (long) st.st_size;
+
+        addr = mmap(NULL, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            printf("PmssMmapSource: mmap failed for %s\n", fileName.c_str());
+            close();
+            return false;
+        }
+        mapData = (char *) addr;
+
+        madvise(mapData, mapSize, MADV_SEQUENTIAL);
+
+        pos = 0;
+        adviseAhead = 0;
+        adviseBehind = 0;
+        advise(pos);
+
+        return true;
+    }
+
+    void PmssMmapSource::close() {
+        if (mapData != NULL) {
+            munmap(mapData, mapSize);
+            mapData = NULL;
+        }
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+        mapSize = 0;
+        pos = 0;
+    }
+
+    bool PmssMmapSource::isOpen() {
+        return (mapData != NULL);
+    }
+
+    /* Prefetch the window ahead of the current chunk and give pages back 
+     * that lie before it. Only done when the cursor moved by at least half
+     * a window, so that there are not too many syscalls. */
+    void PmssMmapSource::advise(long chunkStart) {
+        long pageSize, start, end;
+
+        pageSize = sysconf(_SC_PAGESIZE);
+
+        if (pos + window/2 >= adviseAhead && adviseAhead < mapSize) {
+            start = (chunkStart / pageSize) * pageSize;
+            end = pos + window;
+            if (end > mapSize) 
+                end = mapSize;
+            madvise(mapData + start, end - start, MADV_WILLNEED);
+            adviseAhead = end;
+        }
+
+        end = (chunkStart / pageSize) * pageSize;
+        if (end - adviseBehind >= window/2) {
+            madvise(mapData + adviseBehind, end - adviseBehind, MADV_DONTNEED);
+            // also remove these pages from page cache
+            posix_fadvise(fd, adviseBehind, end - adviseBehind, POSIX_FADV_DONTNEED);
+            adviseBehind = end;
+        }
+    }
+
+    bool PmssMmapSource::read(char * dest, long size) {
+        const char * chunk;
+
+        chunk = next(size);
+        if (chunk == NULL) {
+            return false;
+        }
+
+        memcpy(dest, chunk, size);
+        return true;
+    }
+
+    const char * PmssMmapSource::next(long size) {
+        const char * chunk;
+
+        if (mapData == NULL || size < 0 || pos + size > mapSize) {
+            return NULL;
+        }
+
+        chunk = mapData + pos;
+        pos += size;
+        advise(chunk - mapData);
+
+        return chunk;
+    }
+
+    bool PmssMmapSource::seek(long newPos) {
+        if (newPos < 0 || newPos > mapSize) {
+            return false;
+        }
+
+        // jumping back would access released pages again, 
+        // so start the bookkeeping anew
+        if (newPos < adviseBehind) {
+            adviseBehind = 0;
+        }
+        pos = newPos;
+        adviseAhead = pos;
+        advise(pos);
+
+        return true;
+    }
+
+    long PmssMmapSource::tell() {
+        return pos;
+    }
+
+    long PmssMmapSource::size() {
+        return mapSize;
+    }
+
+}
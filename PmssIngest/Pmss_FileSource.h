@@ -0,0 +1,116 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string>
+#include <fstream>
+
+#ifndef Pmss_Pmss_FileSource_h
+#define Pmss_Pmss_FileSource_h
+
+namespace Pmss {
+
+    // Byte source for the PmssReader. The reader only ever asks for
+    // consecutive chunks of the file (header records, data blocks), so
+    // a source either copies them into a buffer or hands out a pointer 
+    // into memory where the file already is (mmap).
+    class PmssFileSource {
+    public:
+        virtual ~PmssFileSource() {}
+
+        virtual bool open(std::string fileName) = 0;
+
+        virtual void close() = 0;
+
+        virtual bool isOpen() = 0;
+
+        // copy the next size bytes to dest
+        virtual bool read(char * dest, long size) = 0;
+
+        // return pointer to the next size bytes; only valid until the 
+        // next call of read/next/seek. Returns NULL if not enough bytes are left.
+        virtual const char * next(long size) = 0;
+
+        // absolute positioning in the file
+        virtual bool seek(long pos) = 0;
+
+        virtual long tell() = 0;
+
+        // total size of the file in bytes
+        virtual long size() = 0;
+    };
+
+
+    // the classic way: read from std::ifstream into an aligned buffer
+    class PmssStreamSource : public PmssFileSource {
+    private:
+        std::ifstream fileStream;
+
+        char * buffer;
+        long bufferSize;
+
+    public:
+        PmssStreamSource();
+        ~PmssStreamSource();
+
+        bool open(std::string fileName);
+        void close();
+        bool isOpen();
+        bool read(char * dest, long size);
+        const char * next(long size);
+        bool seek(long pos);
+        long tell();
+        long size();
+    };
+
+
+    // map the whole file into memory; data blocks are used in place.
+    // Pages ahead of the cursor are prefetched, pages behind it are
+    // released again, so memory use stays bounded also for huge files.
+    class PmssMmapSource : public PmssFileSource {
+    private:
+        int fd;
+        char * mapData;
+        long mapSize;
+        long pos;
+
+        long window;        // size of prefetch window in bytes
+        long adviseAhead;   // prefetched up to here
+        long adviseBehind;  // released up to here
+
+        void advise(long chunkStart);
+
+    public:
+        PmssMmapSource();
+        PmssMmapSource(long newWindow);
+        ~PmssMmapSource();
+
+        bool open(std::string fileName);
+        void close();
+        bool isOpen();
+        bool read(char * dest, long size);
+        const char * next(long size);
+        bool seek(long pos);
+        long tell();
+        long size();
+    };
+
+}
+
+#endif
@@ -0,0 +1,62 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#ifndef Pmss_Pmss_Header_h
+#define Pmss_Pmss_Header_h
+
+// structure for header: four Fortran records, each with leading and 
+// trailing skipint (number of bytes in the record); read at once by 
+// PmssReader, written by the generator
+typedef struct {
+    int ilead1;
+    float aexpn;    // expansion factor of universe
+    float Omega0;   // density parameter for matter at z=0
+    float OmegaL0;  // density parameter for dark energy at z=0
+    float hubble;   // Hubble constant at z=0 (h)
+    float box;      // side length of cosmological box
+    float particleMass;     // mass of one particle
+    int itrail1;
+
+    int ilead2;
+    int nodeNum;        // number of node/file/subbox
+    int nx;         // number of subboxes in x direction
+    int ny;         // number of subboxes in y direction
+    int nz;         // number of subboxes in z direction
+    float dBuffer;  // overlap at boundary in Mpc/h 
+    int nBuffer;    
+    int itrail2;
+
+    int ilead3;
+    float xL;       // left border in x-direction in file
+    float xR;       // right border in x-direction in file
+    float yL;
+    float yR;
+    float zL;
+    float zR;
+    int itrail3;
+
+    int ilead4;
+    int np;         // total number of particles in this file
+    int itrail4;
+
+} pmssHeader;
+
+#endif
@@ -0,0 +1,255 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include <math.h>
+#include <stdio.h>
+#include <fstream>
+#include <sstream>
+#include <boost/thread/once.hpp>
+
+#include "Pmss_Hilbert.h"
+
+namespace Pmss {
+
+    unsigned int PmssHilbert::spreadTable[1024];
+    unsigned char PmssHilbert::levelTable[12][8];
+    bool PmssHilbert::haveTables = false;
+
+    static boost::once_flag hilbertTablesOnce = BOOST_ONCE_INIT;
+
+    static unsigned long onesMask(unsigned k) {
+        return (k >= 64) ? ~0UL : ((1UL << k) - 1);
+    }
+
+    static unsigned long rotateRight(unsigned long arg, unsigned nRots, unsigned nDims) {
+        if (nRots == 0) 
+            return arg;
+        return ((arg >> nRots) | (arg << (nDims - nRots))) & onesMask(nDims);
+    }
+
+    /* rotation = (rotation + 1 + number of trailing zeros of bits) % nDims,
+     * not counting the highest bit; bits is changed like in hilbert.c */
+    static void adjustRotation(unsigned & rotation, unsigned nDims, unsigned long & bits) {
+        bits &= (0UL - bits) & (onesMask(nDims) >> 1);
+        while (bits) {
+            bits >>= 1;
+            ++rotation;
+        }
+        if (++rotation >= nDims) 
+            rotation -= nDims;
+    }
+
+    unsigned long PmssHilbert::c2i(unsigned nDims, unsigned nBits, const unsigned long * coord) {
+        unsigned long coords, index, bits, flipBit;
+        unsigned long nthbits;
+        unsigned nDimsBits, rotation, b, d, j;
+
+        if (nDims <= 1) 
+            return coord[0];
+
+        nDimsBits = nDims * nBits;
+
+        // transpose: bit j of coordinate d goes to bit j*nDims + d
+        coords = 0;
+        for (j = 0; j < nBits; j++) {
+            for (d = 0; d < nDims; d++) {
+                coords |= ((coord[d] >> j) & 1UL) << (j * nDims + d);
+            }
+        }
+
+        if (nBits > 1) {
+            nthbits = onesMask(nDimsBits) / onesMask(nDims);
+            coords ^= coords >> nDims;
+            index = 0;
+            rotation = 0;
+            flipBit = 0;
+            b = nDimsBits;
+            do {
+                b -= nDims;
+                bits = (coords >> b) & onesMask(nDims);
+                bits = rotateRight(flipBit ^ bits, rotation, nDims);
+                index <<= nDims;
+                index |= bits;
+                flipBit = 1UL << rotation;
+                adjustRotation(rotation, nDims, bits);
+            } while (b);
+            index ^= nthbits >> 1;
+        } else {
+            index = coords;
+        }
+
+        for (d = 1; d < nDimsBits; d *= 2) 
+            index ^= index >> d;
+
+        return index;
+    }
+
+    void PmssHilbert::initTables() {
+        unsigned long bits, flipBit;
+        unsigned rotation, flip, t, i, j;
+
+        for (i = 0; i < 1024; i++) {
+            spreadTable[i] = 0;
+            for (j = 0; j < 10; j++) {
+                spreadTable[i] |= ((i >> j) & 1) << (3 * j);
+            }
+        }
+
+        // state = 4*rotation + flip, flip is 0 (start) or 1 + log2(flipBit)
+        for (rotation = 0; rotation < 3; rotation++) {
+            for (flip = 0; flip < 4; flip++) {
+                flipBit = (flip == 0) ? 0 : (1UL << (flip - 1));
+                for (t = 0; t < 8; t++) {
+                    unsigned newRotation = rotation;
+                    bits = rotateRight(flipBit ^ t, rotation, 3);
+                    unsigned char out = (unsigned char) bits;
+                    adjustRotation(newRotation, 3, bits);
+                    // output bits in 0..2, next state in 3..7
+                    levelTable[4 * rotation + flip][t] = out | ((4 * newRotation + 1 + rotation) << 3);
+                }
+            }
+        }
+
+        haveTables = true;
+    }
+
+    PmssHilbert::PmssHilbert() {
+        level = 0;
+        box = 0;
+        cellsPerUnit = 0;
+        maxCell = 0;
+    }
+
+    void PmssHilbert::setup(int newLevel, float newBox) {
+        boost::call_once(&PmssHilbert::initTables, hilbertTablesOnce);
+
+        if (newLevel < 0)
+            newLevel = 0;
+        if (newLevel > maxLevel)
+            newLevel = maxLevel;
+        level = newLevel;
+        box = newBox;
+        maxCell = (1 << level) - 1;
+        cellsPerUnit = (box > 0) ? (1 << level) / (double) box : 0;
+    }
+
+    int PmssHilbert::getLevel() const {
+        return level;
+    }
+
+    int PmssHilbert::getCell(float x) const {
+        double cell = floor(x * cellsPerUnit);
+        if (cell < 0)
+            return 0;
+        if (cell > maxCell)
+            return maxCell;
+        return (int) cell;
+    }
+
+    int PmssHilbert::getKey(float x, float y, float z) const {
+        unsigned long coords, index;
+        unsigned state;
+        int b;
+
+        if (level == 0) 
+            return 0;
+
+        coords = spreadTable[getCell(x)] | (spreadTable[getCell(y)] << 1) | (spreadTable[getCell(z)] << 2);
+
+        if (level == 1) {
+            index = coords;
+        } else {
+            coords ^= coords >> 3;
+            index = 0;
+            state = 0;
+            for (b = 3 * (level - 1); b >= 0; b -= 3) {
+                unsigned char entry = levelTable[state][(coords >> b) & 7];
+                index = (index << 3) | (entry & 7);
+                state = entry >> 3;
+            }
+            // nthbits >> 1
+            index ^= (0x9249249249249249UL & onesMask(3 * level)) >> 1;
+        }
+
+        index ^= index >> 1;
+        index ^= index >> 2;
+        index ^= index >> 4;
+        index ^= index >> 8;
+        index ^= index >> 16;
+
+        return (int) index;
+    }
+
+    void PmssHilbert::getKeys(const float * x, const float * y, const float * z, long n, int * keys) const {
+        for (long i = 0; i < n; i++) {
+            keys[i] = getKey(x[i], y[i], z[i]);
+        }
+    }
+
+    long PmssHilbert::checkReference(std::string fileName) {
+        std::ifstream in(fileName.c_str());
+        std::string line;
+        PmssHilbert hilbert;
+        int level, key, expected;
+        float box, x, y, z;
+        long numKeys, numWrong, lineNum;
+
+        if (!in) {
+            printf("PmssHilbert: Could not open %s.\n", fileName.c_str());
+            return -1;
+        }
+
+        numKeys = 0;
+        numWrong = 0;
+        lineNum = 0;
+        while (std::getline(in, line)) {
+            lineNum++;
+            if (line.find('#') != std::string::npos) 
+                line = line.substr(0, line.find('#'));
+            std::istringstream fields(line);
+            if (!(fields >> level)) 
+                continue;
+            if (!(fields >> box >> x >> y >> z >> expected) || level < 1 || level > maxLevel || !(box > 0)) {
+                printf("PmssHilbert: Cannot parse line %ld of %s.\n", lineNum, fileName.c_str());
+                return -1;
+            }
+
+            hilbert.setup(level, box);
+            key = hilbert.getKey(x, y, z);
+            numKeys++;
+            if (key != expected) {
+                if (numWrong < 10) 
+                    printf("PmssHilbert: level %d, box %g, (%g, %g, %g): key %d, reference %d\n", 
+                        level, box, x, y, z, key, expected);
+                numWrong++;
+            }
+        }
+
+        if (numKeys == 0) {
+            printf("PmssHilbert: No reference keys in %s.\n", fileName.c_str());
+            return -1;
+        }
+        printf("PmssHilbert: %ld of %ld reference keys differ.\n", numWrong, numKeys);
+
+        return numWrong;
+    }
+
+}
@@ -0,0 +1,83 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include <string>
+
+#ifndef Pmss_Pmss_Hilbert_h
+#define Pmss_Pmss_Hilbert_h
+
+namespace Pmss {
+
+    // Peano-Hilbert keys of the grid cells of the particles, following 
+    // hilbert_c2i from Doug Moore's hilbert.c (used by libhilbert) for 
+    // 3 dimensions and level bits per dimension. The box is divided into 
+    // 2^level cells per dimension, cell = (int) (x/box * 2^level).
+    // Agreement with libhilbert is checked with checkReference, against 
+    // keys computed by libhilbert (e.g. by the phkey UPDATE on the server).
+    // Instead of going through the bits one by one, the interleaved bits 
+    // are looked up in tables, 3 bits (one level) at a time.
+    class PmssHilbert {
+    private:
+        int level;
+        float box;
+        double cellsPerUnit;    // 2^level/box
+        int maxCell;
+
+        // bits of a 10-bit number spread to every third bit
+        static unsigned int spreadTable[1024];
+        // state machine for one level: index bits and next state for each 
+        // state (rotation, flip) and 3 input bits
+        static unsigned char levelTable[12][8];
+        static bool haveTables;
+
+        static void initTables();
+
+        int getCell(float x) const;
+
+    public:
+        // level is the number of bits per dimension, keys must fit into an int
+        static const int maxLevel = 10;
+
+        PmssHilbert();
+
+        void setup(int level, float box);
+
+        int getLevel() const;
+
+        // key of one particle
+        int getKey(float x, float y, float z) const;
+
+        // keys of n particles
+        void getKeys(const float * x, const float * y, const float * z, long n, int * keys) const;
+
+        // straightforward transcription of hilbert_c2i (any number of
+        // dimensions, nDims*nBits <= 64), as reference for the tables
+        static unsigned long c2i(unsigned nDims, unsigned nBits, const unsigned long * coord);
+
+        // compare getKey with reference keys, one per line: level box x y z key
+        // ('#' starts a comment); returns the number of keys that differ, 
+        // -1 if the file could not be read or has no keys
+        static long checkReference(std::string fileName);
+    };
+
+}
+
+#endif
@@ -0,0 +1,193 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "Pmss_Journal.h"
+
+namespace Pmss {
+
+    PmssJournal::PmssJournal(std::string journalDir, std::string newDataFile, int part, long newLagRows) {
+        size_t pos;
+        char partStr[16];
+
+        dataFile = newDataFile;
+        lagRows = (newLagRows > 0) ? newLagRows : 1;
+        rowsBase = 0;
+
+        // named after the data file (and part), like the export files
+        pos = dataFile.find_last_of('/');
+        journalFile = journalDir + "/" + ((pos == std::string::npos) ? dataFile : dataFile.substr(pos + 1));
+        if (part > 0) {
+            snprintf(partStr, sizeof(partStr), "_p%d", part);
+            journalFile += partStr;
+        }
+        journalFile += ".journal";
+
+        checkpoint.dataFile = dataFile;
+        checkpoint.blockOffset = -1;
+        checkpoint.row = 0;
+        checkpoint.fileRowId = 0;
+        checkpoint.rowsBefore = 0;
+        checkpoint.done = false;
+    }
+
+    std::string PmssJournal::getJournalFile() {
+        return journalFile;
+    }
+
+    /* Last checkpoint of an earlier run; false if there is none (or it is for another file) */
+    bool PmssJournal::read(pmssCheckpoint & lastCheckpoint) {
+        char line[4096];
+        char key[64];
+        char value[4000];
+        int done = 0;
+        int numFields = 0;
+        FILE * fp;
+
+        fp = fopen(journalFile.c_str(), "r");
+        if (fp == NULL) {
+            return false;
+        }
+
+        lastCheckpoint.blockOffset = -1;
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            if (sscanf(line, "%63s %3999[^\n]", key, value) != 2) 
+                continue;
+            numFields++;
+            if (strcmp(key, "file") == 0) {
+                lastCheckpoint.dataFile = value;
+            } else if (strcmp(key, "offset") == 0) {
+                lastCheckpoint.blockOffset = atol(value);
+            } else if (strcmp(key, "row") == 0) {
+                lastCheckpoint.row = atol(value);
+            } else if (strcmp(key, "fileRowId") == 0) {
+                lastCheckpoint.fileRowId = atol(value);
+            } else if (strcmp(key, "rowsBefore") == 0) {
+                lastCheckpoint.rowsBefore = atol(value);
+            } else if (strcmp(key, "done") == 0) {
+                done = atoi(value);
+            } else {
+                numFields--;
+            }
+        }
+        fclose(fp);
+        lastCheckpoint.done = (done != 0);
+
+        if (numFields != 6 || lastCheckpoint.blockOffset < 0) {
+            printf("PmssJournal: %s is incomplete, ignoring it.\n", journalFile.c_str());
+            return false;
+        }
+        if (lastCheckpoint.dataFile.compare(dataFile) != 0) {
+            printf("PmssJournal: %s belongs to %s, not to %s.\n", journalFile.c_str(), lastCheckpoint.dataFile.c_str(), dataFile.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+    /* Start journaling (again) at this checkpoint, it is written immediately */
+    void PmssJournal::begin(pmssCheckpoint & startCheckpoint) {
+        rowsBase = startCheckpoint.rowsBefore;
+        pending.clear();
+        write(startCheckpoint);
+    }
+
+    /* Called by the reader, before handing out the first row of a data block;
+     * rowsIngested is the number of rows handed out before. */
+    void PmssJournal::blockStarted(long blockOffset, long row, long fileRowId, long rowsIngested) {
+        pmssCheckpoint blockStart;
+        bool haveSafe = false;
+        pmssCheckpoint safe;
+
+        blockStart.dataFile = dataFile;
+        blockStart.blockOffset = blockOffset;
+        blockStart.row = row;
+        blockStart.fileRowId = fileRowId;
+        blockStart.rowsBefore = rowsBase + rowsIngested;
+        blockStart.done = false;
+        pending.push_back(blockStart);
+
+        // all rows before a block start are committed, once lagRows more rows were sent
+        while (pending.size() > 0 && pending.front().rowsBefore <= rowsBase + rowsIngested - lagRows) {
+            safe = pending.front();
+            haveSafe = true;
+            pending.pop_front();
+        }
+
+        if (haveSafe && safe.rowsBefore > checkpoint.rowsBefore) {
+            write(safe);
+        }
+    }
+
+    /* All rows were ingested (and committed); the last checkpoint stays 
+     * consistent, it is only marked as done */
+    void PmssJournal::finish() {
+        pmssCheckpoint last = checkpoint;
+
+        last.done = true;
+        pending.clear();
+        write(last);
+    }
+
+    /* Replace the journal file: write a temporary file, fsync and rename it */
+    bool PmssJournal::write(pmssCheckpoint & newCheckpoint) {
+        std::string tmpFile = journalFile + ".tmp";
+        FILE * fp;
+        bool ok;
+
+        fp = fopen(tmpFile.c_str(), "w");
+        if (fp == NULL) {
+            printf("PmssJournal: Could not write %s.\n", tmpFile.c_str());
+            return false;
+        }
+
+        fprintf(fp, "file %s\noffset %ld\nrow %ld\nfileRowId %ld\nrowsBefore %ld\ndone %d\n", 
+            newCheckpoint.dataFile.c_str(), newCheckpoint.blockOffset, newCheckpoint.row, 
+            newCheckpoint.fileRowId, newCheckpoint.rowsBefore, newCheckpoint.done ? 1 : 0);
+
+        ok = (fflush(fp) == 0 && fsync(fileno(fp)) == 0);
+        ok = (fclose(fp) == 0) && ok;
+        ok = ok && (rename(tmpFile.c_str(), journalFile.c_str()) == 0);
+
+        // the rename itself is only durable once the directory is synced
+        if (ok) {
+            size_t pos = journalFile.find_last_of('/');
+            int dirFd = open((pos == std::string::npos) ? "." : journalFile.substr(0, pos + 1).c_str(), O_RDONLY);
+            if (dirFd >= 0) {
+                fsync(dirFd);
+                close(dirFd);
+            }
+        }
+        if (!ok) {
+            printf("PmssJournal: Could not write %s.\n", journalFile.c_str());
+            return false;
+        }
+
+        checkpoint = newCheckpoint;
+        return true;
+    }
+
+}
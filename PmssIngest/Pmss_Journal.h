@@ -0,0 +1,74 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include <string>
+#include <deque>
+
+#ifndef Pmss_Pmss_Journal_h
+#define Pmss_Pmss_Journal_h
+
+namespace Pmss {
+
+    // a point in a data file from where ingesting can be resumed
+    typedef struct {
+        std::string dataFile;
+        long blockOffset;   // file offset of a data block (its nrecord-record)
+        long row;           // row number in file of the first particle of this block
+        long fileRowId;     // fileRowId of this row; all rows from here on are (re-)ingested
+        long rowsBefore;    // number of rows ingested from this file before this block
+        bool done;          // the whole file was ingested
+    } pmssCheckpoint;
+
+    // Journal of the progress of ingesting one data file, in a small text file
+    // in the journal directory that is replaced (written, fsync'd, renamed) for
+    // each checkpoint. The reader reports the start of each data block when its
+    // first row is handed out; a block start becomes a checkpoint once at least 
+    // lagRows more rows were handed out, i.e. when the database must have 
+    // committed all rows before it (DBIngestor sends at most lagRows rows at once).
+    class PmssJournal {
+    private:
+        std::string journalFile;
+        std::string dataFile;
+        long lagRows;
+        long rowsBase;      // rows ingested in an earlier run, when resuming
+
+        pmssCheckpoint checkpoint;
+        std::deque<pmssCheckpoint> pending;     // block starts, not yet safely committed
+
+        bool write(pmssCheckpoint & newCheckpoint);
+
+    public:
+        PmssJournal(std::string journalDir, std::string newDataFile, int part, long newLagRows);
+
+        std::string getJournalFile();
+
+        bool read(pmssCheckpoint & lastCheckpoint);
+
+        void begin(pmssCheckpoint & startCheckpoint);
+
+        void blockStarted(long blockOffset, long row, long fileRowId, long rowsIngested);
+
+        void finish();
+    };
+
+}
+
+#endif
@@ -0,0 +1,36 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include "Pmss_Log.h"
+
+namespace Pmss {
+
+    int pmssLogLevel = PMSS_LOG_INFO;
+
+    void setLogLevel(int level) {
+        if (level < PMSS_LOG_ERROR) 
+            level = PMSS_LOG_ERROR;
+        if (level > PMSS_LOG_DEBUG) 
+            level = PMSS_LOG_DEBUG;
+        pmssLogLevel = level;
+    }
+
+}
@@ -0,0 +1,43 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include <stdio.h>
+
+#ifndef Pmss_Pmss_Log_h
+#define Pmss_Pmss_Log_h
+
+namespace Pmss {
+
+    // Log levels for messages that are not errors; messages on the hot path 
+    // (per data block or batch) use PMSS_LOG_DEBUG, so that they are not
+    // printed (nor formatted) by default.
+    enum { PMSS_LOG_ERROR = 0, PMSS_LOG_WARN = 1, PMSS_LOG_INFO = 2, PMSS_LOG_DEBUG = 3 };
+
+    extern int pmssLogLevel;
+
+    void setLogLevel(int level);
+
+}
+
+// printf, if the given level is enabled; the arguments are only evaluated then
+#define PmssLog(level, ...) do { if ((level) <= Pmss::pmssLogLevel) printf(__VA_ARGS__); } while (0)
+
+#endif
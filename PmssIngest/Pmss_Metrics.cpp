@@ -0,0 +1,357 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include <stdio.h>
+#include <sys/time.h>
+
+#include "Pmss_Metrics.h"
+
+namespace Pmss {
+
+    static const char * counterNames[METRIC_NUM_COUNTERS] = {
+        "bytesRead", "blocksRead", "rowsDecoded", "rowsInside", "rowsRejected", "rowsOnBoundary", "rowsIngested", "filesDone"
+    };
+
+    static const char * counterPromNames[METRIC_NUM_COUNTERS] = {
+        "pmss_bytes_read_total", "pmss_blocks_read_total", "pmss_rows_decoded_total", "pmss_rows_inside_total", 
+        "pmss_rows_rejected_total", "pmss_rows_on_boundary_total", "pmss_rows_ingested_total", "pmss_files_done_total"
+    };
+
+    static const char * timerNames[TIMER_NUM_TIMERS] = {
+        "readSeconds", "decodeSeconds", "waitDbSeconds", "waitReadSeconds"
+    };
+
+    static const char * timerPromNames[TIMER_NUM_TIMERS] = {
+        "pmss_read_seconds_total", "pmss_decode_seconds_total", "pmss_wait_db_seconds_total", "pmss_wait_read_seconds_total"
+    };
+
+    std::vector<pmssThreadMetrics *> PmssMetrics::registry;
+    pmssRetiredMetrics PmssMetrics::retired;
+    boost::mutex PmssMetrics::registryMutex;
+    boost::thread_specific_ptr<pmssThreadMetrics> PmssMetrics::local(&PmssMetrics::retire);
+
+    double PmssMetrics::now() {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        return tv.tv_sec + 1.e-6 * tv.tv_usec;
+    }
+
+    pmssThreadMetrics * PmssMetrics::getLocal() {
+        pmssThreadMetrics * metrics = local.get();
+        int i;
+
+        if (metrics == NULL) {
+            metrics = new pmssThreadMetrics;
+            for (i = 0; i < METRIC_NUM_COUNTERS; i++) 
+                metrics->counters[i].store(0);
+            for (i = 0; i < TIMER_NUM_TIMERS; i++) 
+                metrics->timers[i].store(0);
+            for (i = 0; i < METRIC_NUM_LATENCY_BUCKETS; i++) 
+                metrics->latency[i].store(0);
+            metrics->latencySum.store(0);
+
+            boost::mutex::scoped_lock lock(registryMutex);
+            registry.push_back(metrics);
+            local.reset(metrics);
+        }
+        return metrics;
+    }
+
+    /* Called when a thread ends: its counters are added to the totals of the 
+       ended threads, so that the registry only holds the running threads */
+    void PmssMetrics::retire(pmssThreadMetrics * metrics) {
+        int i;
+
+        if (metrics == NULL) {
+            return;
+        }
+
+        boost::mutex::scoped_lock lock(registryMutex);
+        for (i = 0; i < METRIC_NUM_COUNTERS; i++) 
+            retired.counters[i] += metrics->counters[i].load(boost::memory_order_relaxed);
+        for (i = 0; i < TIMER_NUM_TIMERS; i++) 
+            retired.timers[i] += metrics->timers[i].load(boost::memory_order_relaxed);
+        for (i = 0; i < METRIC_NUM_LATENCY_BUCKETS; i++) 
+            retired.latency[i] += metrics->latency[i].load(boost::memory_order_relaxed);
+        retired.latencySum += metrics->latencySum.load(boost::memory_order_relaxed);
+
+        for (size_t t = 0; t < registry.size(); t++) {
+            if (registry[t] == metrics) {
+                registry[t] = registry.back();
+                registry.pop_back();
+                break;
+            }
+        }
+        delete metrics;
+    }
+
+    // only this thread writes, so no atomic read-modify-write is needed
+    static inline void addRelaxed(boost::atomic<long> & value, long n) {
+        value.store(value.load(boost::memory_order_relaxed) + n, boost::memory_order_relaxed);
+    }
+
+    void PmssMetrics::count(int counter, long value) {
+        addRelaxed(getLocal()->counters[counter], value);
+    }
+
+    void PmssMetrics::addTime(int timer, double seconds) {
+        addRelaxed(getLocal()->timers[timer], (long) (seconds * 1.e6));
+    }
+
+    void PmssMetrics::addLatency(double seconds) {
+        pmssThreadMetrics * metrics = getLocal();
+        int bucket = 0;
+
+        while (bucket < METRIC_NUM_LATENCY_BUCKETS - 1 && seconds > getLatencyBound(bucket)) {
+            bucket++;
+        }
+        addRelaxed(metrics->latency[bucket], 1);
+        addRelaxed(metrics->latencySum, (long) (seconds * 1.e6));
+    }
+
+    double PmssMetrics::getLatencyBound(int bucket) {
+        return 1.e-4 * (1L << bucket);
+    }
+
+    pmssMetricsSnapshot PmssMetrics::snapshot() {
+        pmssMetricsSnapshot snap;
+        long timers[TIMER_NUM_TIMERS];
+        long latencySum;
+        int i;
+
+        boost::mutex::scoped_lock lock(registryMutex);
+        snap.time = now();
+        for (i = 0; i < METRIC_NUM_COUNTERS; i++) 
+            snap.counters[i] = retired.counters[i];
+        for (i = 0; i < TIMER_NUM_TIMERS; i++) 
+            timers[i] = retired.timers[i];
+        for (i = 0; i < METRIC_NUM_LATENCY_BUCKETS; i++) 
+            snap.latency[i] = retired.latency[i];
+        latencySum = retired.latencySum;
+
+        for (size_t t = 0; t < registry.size(); t++) {
+            pmssThreadMetrics * metrics = registry[t];
+            for (i = 0; i < METRIC_NUM_COUNTERS; i++) 
+                snap.counters[i] += metrics->counters[i].load(boost::memory_order_relaxed);
+            for (i = 0; i < TIMER_NUM_TIMERS; i++) 
+                timers[i] += metrics->timers[i].load(boost::memory_order_relaxed);
+            for (i = 0; i < METRIC_NUM_LATENCY_BUCKETS; i++) 
+                snap.latency[i] += metrics->latency[i].load(boost::memory_order_relaxed);
+            latencySum += metrics->latencySum.load(boost::memory_order_relaxed);
+        }
+        for (i = 0; i < TIMER_NUM_TIMERS; i++) 
+            snap.timers[i] = 1.e-6 * timers[i];
+        snap.latencySum = 1.e-6 * latencySum;
+
+        return snap;
+    }
+
+
+    static std::string jsonString(const std::string & text) {
+        std::string result = "\"";
+        char code[8];
+        size_t i;
+
+        for (i = 0; i < text.length(); i++) {
+            unsigned char c = (unsigned char) text[i];
+            if (c == '"' || c == '\\') {
+                result += '\\';
+                result += (char) c;
+            } else if (c < 0x20) {
+                snprintf(code, sizeof(code), "\\u%04x", c);
+                result += code;
+            } else {
+                result += (char) c;
+            }
+        }
+
+        return result + "\"";
+    }
+
+
+    // label values of the Prometheus text format escape backslash, quote and newline
+    static std::string promString(const std::string & text) {
+        std::string result;
+        size_t i;
+
+        for (i = 0; i < text.length(); i++) {
+            if (text[i] == '"' || text[i] == '\\') {
+                result += '\\';
+                result += text[i];
+            } else if (text[i] == '\n') {
+                result += "\\n";
+            } else {
+                result += text[i];
+            }
+        }
+
+        return result;
+    }
+
+
+    PmssMetricsExporter::PmssMetricsExporter(std::string newFileName, std::string newFormat, double newInterval, std::string newLabel) {
+        fileName = newFileName;
+        format = newFormat;
+        interval = (newInterval > 0) ? newInterval : 10.;
+        label = newLabel;
+        thread = NULL;
+        stopping = false;
+        first = PmssMetrics::snapshot();
+        previous = first;
+    }
+
+    PmssMetricsExporter::~PmssMetricsExporter() {
+        stop();
+    }
+
+    bool PmssMetricsExporter::isFormat(std::string name) {
+        return (name.compare("json") == 0 || name.compare("prom") == 0);
+    }
+
+    void PmssMetricsExporter::start() {
+        if (thread == NULL) {
+            stopping = false;
+            thread = new boost::thread(boost::bind(&PmssMetricsExporter::run, this));
+        }
+    }
+
+    /* Stop the periodic export and write the final numbers */
+    void PmssMetricsExporter::stop() {
+        if (thread != NULL) {
+            {
+                boost::mutex::scoped_lock lock(mutex);
+                stopping = true;
+                cond.notify_all();
+            }
+            thread->join();
+            delete thread;
+            thread = NULL;
+            write();
+        }
+    }
+
+    void PmssMetricsExporter::run() {
+        boost::mutex::scoped_lock lock(mutex);
+
+        while (!stopping) {
+            cond.timed_wait(lock, boost::posix_time::milliseconds((long) (interval * 1000)));
+            if (!stopping) {
+                lock.unlock();
+                write();
+                lock.lock();
+            }
+        }
+    }
+
+    bool PmssMetricsExporter::write() {
+        pmssMetricsSnapshot current = PmssMetrics::snapshot();
+        bool ok;
+
+        if (format.compare("prom") == 0) {
+            ok = writePrometheus(current);
+        } else {
+            ok = writeJson(current);
+        }
+        if (!ok) {
+            printf("PmssMetricsExporter: Could not write metrics to %s.\n", fileName.c_str());
+        }
+
+        previous = current;
+        return ok;
+    }
+
+    /* One line per snapshot, with totals and the rates since the last snapshot */
+    bool PmssMetricsExporter::writeJson(pmssMetricsSnapshot & current) {
+        double seconds = current.time - previous.time;
+        FILE * fp;
+        int i;
+
+        fp = fopen(fileName.c_str(), "a");
+        if (fp == NULL) {
+            return false;
+        }
+
+        fprintf(fp, "{\"time\": %.3f, \"label\": %s, \"elapsed\": %.3f", current.time, jsonString(label).c_str(), current.time - first.time);
+        for (i = 0; i < METRIC_NUM_COUNTERS; i++) {
+            fprintf(fp, ", \"%s\": %ld", counterNames[i], current.counters[i] - first.counters[i]);
+        }
+        for (i = 0; i < TIMER_NUM_TIMERS; i++) {
+            fprintf(fp, ", \"%s\": %.3f", timerNames[i], current.timers[i] - first.timers[i]);
+        }
+        fprintf(fp, ", \"rowsPerSec\": %.0f, \"bytesPerSec\": %.0f", 
+            seconds > 0 ? (current.counters[METRIC_ROWS_INGESTED] - previous.counters[METRIC_ROWS_INGESTED]) / seconds : 0., 
+            seconds > 0 ? (current.counters[METRIC_BYTES_READ] - previous.counters[METRIC_BYTES_READ]) / seconds : 0.);
+
+        fprintf(fp, ", \"batchLatency\": {\"le\": [");
+        for (i = 0; i < METRIC_NUM_LATENCY_BUCKETS - 1; i++) {
+            fprintf(fp, "%s%g", i > 0 ? ", " : "", PmssMetrics::getLatencyBound(i));
+        }
+        fprintf(fp, ", \"+Inf\"], \"count\": [");
+        for (i = 0; i < METRIC_NUM_LATENCY_BUCKETS; i++) {
+            fprintf(fp, "%s%ld", i > 0 ? ", " : "", current.latency[i] - first.latency[i]);
+        }
+        fprintf(fp, "], \"sum\": %.6f}}\n", current.latencySum - first.latencySum);
+
+        return (fclose(fp) == 0);
+    }
+
+    /* Whole file is written to a temporary file and renamed, so that it is never read half-written */
+    bool PmssMetricsExporter::writePrometheus(pmssMetricsSnapshot & current) {
+        std::string tmpName = fileName + ".tmp";
+        std::string labels = "ingest=\"" + promString(label) + "\"";
+        long cumulative;
+        FILE * fp;
+        int i;
+
+        fp = fopen(tmpName.c_str(), "w");
+        if (fp == NULL) {
+            return false;
+        }
+
+        for (i = 0; i < METRIC_NUM_COUNTERS; i++) {
+            fprintf(fp, "# TYPE %s counter\n%s{%s} %ld\n", counterPromNames[i], counterPromNames[i], labels.c_str(), 
+                current.counters[i] - first.counters[i]);
+        }
+        for (i = 0; i < TIMER_NUM_TIMERS; i++) {
+            fprintf(fp, "# TYPE %s counter\n%s{%s} %.6f\n", timerPromNames[i], timerPromNames[i], labels.c_str(), 
+                current.timers[i] - first.timers[i]);
+        }
+
+        fprintf(fp, "# TYPE pmss_batch_latency_seconds histogram\n");
+        cumulative = 0;
+        for (i = 0; i < METRIC_NUM_LATENCY_BUCKETS; i++) {
+            cumulative += current.latency[i] - first.latency[i];
+            if (i < METRIC_NUM_LATENCY_BUCKETS - 1) {
+                fprintf(fp, "pmss_batch_latency_seconds_bucket{%s,le=\"%g\"} %ld\n", labels.c_str(), PmssMetrics::getLatencyBound(i), cumulative);
+            } else {
+                fprintf(fp, "pmss_batch_latency_seconds_bucket{%s,le=\"+Inf\"} %ld\n", labels.c_str(), cumulative);
+            }
+        }
+        fprintf(fp, "pmss_batch_latency_seconds_sum{%s} %.6f\n", labels.c_str(), current.latencySum - first.latencySum);
+        fprintf(fp, "pmss_batch_latency_seconds_count{%s} %ld\n", labels.c_str(), cumulative);
+
+        if (fclose(fp) != 0) {
+            return false;
+        }
+        return (rename(tmpName.c_str(), fileName.c_str()) == 0);
+    }
+
+}
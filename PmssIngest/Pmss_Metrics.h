@@ -0,0 +1,141 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+
+#ifndef Pmss_Pmss_Metrics_h
+#define Pmss_Pmss_Metrics_h
+
+namespace Pmss {
+
+    enum pmssCounter {
+        METRIC_BYTES_READ = 0,      // data blocks incl. nrecord-records and skipints
+        METRIC_BLOCKS_READ,
+        METRIC_ROWS_DECODED,        // all particles, also the ones in the overlap region
+        METRIC_ROWS_INSIDE,         // passed the boundary check
+        METRIC_ROWS_REJECTED,       // outside the subbox (incl. the ones on a shared boundary)
+        METRIC_ROWS_ON_BOUNDARY,    // rejected, because they are ingested from the neighbouring file
+        METRIC_ROWS_INGESTED,       // handed out to the database (or export)
+        METRIC_FILES_DONE,
+        METRIC_NUM_COUNTERS
+    };
+
+    enum pmssTimer {
+        TIMER_READ = 0,     // fetching data blocks from the file
+        TIMER_DECODE,       // byteswap, boundary check, phkey
+        TIMER_WAIT_DB,      // reading side blocked, because the database is slower
+        TIMER_WAIT_READ,    // database side blocked, because reading is slower
+        TIMER_NUM_TIMERS
+    };
+
+    // upper bounds of the batch latency histogram: 100us * 2^i, the last bucket is +Inf
+    enum { METRIC_NUM_LATENCY_BUCKETS = 17 };
+
+    // sum of the counters of all threads at one point in time
+    typedef struct {
+        double time;
+        long counters[METRIC_NUM_COUNTERS];
+        double timers[TIMER_NUM_TIMERS];
+        long latency[METRIC_NUM_LATENCY_BUCKETS];
+        double latencySum;
+    } pmssMetricsSnapshot;
+
+    // counters of one thread, only written by this thread (but read by the exporter)
+    typedef struct {
+        boost::atomic<long> counters[METRIC_NUM_COUNTERS];
+        boost::atomic<long> timers[TIMER_NUM_TIMERS];      // microseconds
+        boost::atomic<long> latency[METRIC_NUM_LATENCY_BUCKETS];
+        boost::atomic<long> latencySum;                     // microseconds
+    } pmssThreadMetrics;
+
+    // counters of the threads that have ended, added up (guarded by the registry mutex)
+    typedef struct {
+        long counters[METRIC_NUM_COUNTERS];
+        long timers[TIMER_NUM_TIMERS];                      // microseconds
+        long latency[METRIC_NUM_LATENCY_BUCKETS];
+        long latencySum;                                    // microseconds
+    } pmssRetiredMetrics;
+
+    // Performance counters and timers of the reading and ingesting threads.
+    // Each thread updates its own counters without locking (per data block
+    // or batch, not per row); snapshot() adds up the counters of all threads.
+    class PmssMetrics {
+    private:
+        static std::vector<pmssThreadMetrics *> registry;
+        static pmssRetiredMetrics retired;
+        static boost::mutex registryMutex;
+        static boost::thread_specific_ptr<pmssThreadMetrics> local;
+
+        static pmssThreadMetrics * getLocal();
+        static void retire(pmssThreadMetrics * metrics);
+
+    public:
+        static double now();
+
+        static void count(int counter, long value);
+        static void addTime(int timer, double seconds);
+        static void addLatency(double seconds);
+
+        static double getLatencyBound(int bucket);
+
+        static pmssMetricsSnapshot snapshot();
+    };
+
+    // Writes snapshots of the metrics every interval seconds (and at the end)
+    // into a file, either appended as JSON lines ("json") or as Prometheus
+    // text format ("prom", replaced each time, for the node exporter's 
+    // textfile collector).
+    class PmssMetricsExporter {
+    private:
+        std::string fileName;
+        std::string format;
+        std::string label;
+        double interval;
+
+        pmssMetricsSnapshot first;
+        pmssMetricsSnapshot previous;
+
+        boost::thread * thread;
+        boost::mutex mutex;
+        boost::condition_variable cond;
+        bool stopping;
+
+        void run();
+        bool writeJson(pmssMetricsSnapshot & current);
+        bool writePrometheus(pmssMetricsSnapshot & current);
+
+    public:
+        PmssMetricsExporter(std::string fileName, std::string format, double interval, std::string label);
+        ~PmssMetricsExporter();
+
+        static bool isFormat(std::string format);
+
+        void start();
+        void stop();
+        bool write();
+    };
+
+}
+
+#endif
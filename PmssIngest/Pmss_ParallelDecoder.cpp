@@ -0,0 +1,221 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include "Pmss_ParallelDecoder.h"
+
+using namespace std;
+
+namespace Pmss {
+
+    PmssParallelDecoder::PmssParallelDecoder(int newNumThreads, int newQueueDepth) {
+        numThreads = newNumThreads;
+        queueDepth = newQueueDepth;
+        if (numThreads < 1)
+            numThreads = 1;
+        if (queueDepth < 1)
+            queueDepth = 1;
+
+        decoder = NULL;
+        blockIndex = NULL;
+        numBlocks = 0;
+        nextBlock = 0;
+        lastSlot = 0;
+    }
+
+    PmssParallelDecoder::~PmssParallelDecoder() {
+        stop();
+    }
+
+    void PmssParallelDecoder::start(string newFileName, bool newUseMmap, const PmssRecordFormat & newFormat, const PmssBlockDecoder * newDecoder, 
+                                    PmssBlockIndex * newBlockIndex, long newFirstRow, long newLastRow, 
+                                    const vector<bool> * skipBlock) {
+        long firstBlock, lastBlock, b;
+        int i;
+
+        stop();
+
+        fileName = newFileName;
+        useMmap = newUseMmap;
+        format = newFormat;
+        decoder = newDecoder;
+        blockIndex = newBlockIndex;
+        firstRow = newFirstRow;
+        lastRow = newLastRow;
+        if (lastRow > blockIndex->getNumRows()) 
+            lastRow = blockIndex->getNumRows();
+
+        nextBlock = 0;
+        blockNums.clear();
+        if (firstRow < lastRow) {
+            firstBlock = blockIndex->findBlock(firstRow);
+            lastBlock = blockIndex->findBlock(lastRow - 1);
+            for (b = firstBlock; b <= lastBlock; b++) {
+                if (skipBlock == NULL || !(*skipBlock)[b]) 
+                    blockNums.push_back(b);
+            }
+        }
+        numBlocks = (long) blockNums.size();
+
+        for (i = 0; i < numThreads; i++) {
+            decodeSlot * slot = new decodeSlot;
+            slot->queue = new PmssBatchQueue(queueDepth);
+            slots.push_back(slot);
+        }
+        for (i = 0; i < numThreads; i++) {
+            slots[i]->thread = new boost::thread(boost::bind(&PmssParallelDecoder::decodeLoop, this, i));
+        }
+    }
+
+    /* Work of one thread: read and decode every numThreads-th block */
+    void PmssParallelDecoder::decodeLoop(int thread) {
+        PmssFileSource * source;
+        PmssParticleBatch * batch;
+        decodeSlot * slot;
+        vector<char> buffer;
+        const char * blockData;
+        string reason;
+        long nrecord;
+        long k, startRow, endRow;
+        bool error;
+
+        slot = slots[thread];
+
+        if (useMmap) {
+            source = new PmssMmapSource();
+        } else {
+            source = new PmssStreamSource();
+        }
+        error = !source->open(fileName);
+        if (error) {
+            printf("PmssParallelDecoder: Could not open %s in thread %d.\n", fileName.c_str(), thread);
+        }
+
+        for (k = thread; k < numBlocks; k += numThreads) {
+            const pmssBlockInfo & info = blockIndex->getBlock(blockNums[k]);
+
+            // wait for a free batch
+            batch = slot->queue->getFree();
+            if (batch == NULL) {
+                break;
+            }
+
+            blockData = NULL;
+            reason = "";
+            if (!error && source->seek(info.offset)) {
+                blockData = PmssBlockDecoder::fetchBlock(source, format, &nrecord, buffer, false, &reason);
+            }
+
+            if (blockData == NULL || nrecord != info.nrecord) {
+                printf("PmssParallelDecoder: Could not read block %ld at offset %ld%s%s\n", blockNums[k], info.offset, 
+                    reason.length() > 0 ? ": " : ".", reason.c_str());
+                error = true;
+                batch->clear();
+                batch->error = true;
+            } else {
+                // only rows between firstRow and lastRow
+                startRow = info.firstRow;
+                endRow = info.firstRow + info.nrecord;
+                if (startRow < firstRow)
+                    startRow = firstRow;
+                if (endRow > lastRow)
+                    endRow = lastRow;
+
+                decoder->decode(blockData + (startRow - info.firstRow) * PmssBlockDecoder::numBytesPerRow,
+                                endRow - startRow, startRow, *batch);
+                if (startRow == info.firstRow) 
+                    batch->blockOffset = info.offset;
+            }
+
+            slot->queue->push();
+
+            if (error) {
+                break;
+            }
+        }
+        slot->queue->finish();
+
+        source->close();
+        delete source;
+    }
+
+    PmssParticleBatch * PmssParallelDecoder::nextBatch() {
+        PmssParticleBatch * batch;
+
+        if (nextBlock >= numBlocks || slots.size() == 0) {
+            return NULL;
+        }
+
+        lastSlot = nextBlock % numThreads;
+        batch = slots[lastSlot]->queue->pop();
+        if (batch == NULL) {
+            nextBlock = numBlocks;
+            return NULL;
+        }
+
+        nextBlock++;
+
+        // after an error, nothing else comes 
+        if (batch->error) {
+            nextBlock = numBlocks;
+        }
+
+        return batch;
+    }
+
+    void PmssParallelDecoder::releaseBatch(PmssParticleBatch * batch) {
+        // give it back to the thread it came from
+        if (batch != NULL && slots.size() > 0) {
+            slots[lastSlot]->queue->release();
+        }
+    }
+
+    void PmssParallelDecoder::stop() {
+        size_t i;
+
+        for (i = 0; i < slots.size(); i++) {
+            slots[i]->queue->stop();
+        }
+
+        for (i = 0; i < slots.size(); i++) {
+            slots[i]->thread->join();
+            delete slots[i]->thread;
+            delete slots[i]->queue;
+            delete slots[i];
+        }
+        slots.clear();
+    }
+
+    double PmssParallelDecoder::getProducerWait() {
+        double wait = 0;
+        for (size_t i = 0; i < slots.size(); i++) 
+            wait += slots[i]->queue->getProducerWait();
+        return wait;
+    }
+
+    double PmssParallelDecoder::getConsumerWait() {
+        double wait = 0;
+        for (size_t i = 0; i < slots.size(); i++) 
+            wait += slots[i]->queue->getConsumerWait();
+        return wait;
+    }
+
+}
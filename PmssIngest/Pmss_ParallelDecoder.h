@@ -0,0 +1,90 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+#include "Pmss_BlockDecoder.h"
+#include "Pmss_BlockIndex.h"
+#include "Pmss_BatchQueue.h"
+
+#ifndef Pmss_Pmss_ParallelDecoder_h
+#define Pmss_Pmss_ParallelDecoder_h
+
+namespace Pmss {
+
+    // Decodes the data blocks of one file with several threads.
+    // Block number k (counted from the first block) is decoded by thread
+    // k % numThreads, each thread reads through its own file handle.
+    // Batches are handed out by nextBatch() in file order.
+    class PmssParallelDecoder {
+    private:
+        // one decoding thread with its queue of finished batches
+        typedef struct {
+            boost::thread * thread;
+            PmssBatchQueue * queue;
+        } decodeSlot;
+
+        std::vector<decodeSlot *> slots;
+        int numThreads;
+        int queueDepth;     // max. number of finished batches per thread
+
+        std::string fileName;
+        bool useMmap;
+        PmssRecordFormat format;
+        const PmssBlockDecoder * decoder;
+        PmssBlockIndex * blockIndex;
+
+        std::vector<long> blockNums;    // blocks to be decoded, in file order
+        long firstRow;      // first row to decode (may be inside the first block)
+        long lastRow;       // stop before this row
+        long nextBlock;     // counter for nextBatch, position in blockNums
+        int lastSlot;       // thread that decoded the batch handed out last
+        long numBlocks;     // number of blocks to be decoded
+
+        void decodeLoop(int thread);
+
+    public:
+        PmssParallelDecoder(int numThreads, int queueDepth);
+        ~PmssParallelDecoder();
+
+        // decode rows firstRow .. lastRow-1 of the file, except for the blocks 
+        // marked in skipBlock (by block number), if given
+        void start(std::string fileName, bool useMmap, const PmssRecordFormat & format, const PmssBlockDecoder * decoder, 
+                   PmssBlockIndex * blockIndex, long firstRow, long lastRow, 
+                   const std::vector<bool> * skipBlock = NULL);
+
+        // next batch in file order, NULL if all blocks are done;
+        // give it back with releaseBatch when it is not needed anymore
+        PmssParticleBatch * nextBatch();
+
+        void releaseBatch(PmssParticleBatch * batch);
+
+        void stop();
+
+        // seconds the decoding threads waited for free batches (summed over threads),
+        // and seconds nextBatch waited for decoded ones
+        double getProducerWait();
+        double getConsumerWait();
+    };
+
+}
+
+#endif
@@ -22,17 +22,57 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>	// sqrt, pow
+#include <sys/time.h>
 #include "pmssingest_error.h"
 
 #include "Pmss_Reader.h"
+#include "Pmss_Metrics.h"
+#include "Pmss_Log.h"
 
 namespace Pmss {
+
+    static double readerTime() {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        return tv.tv_sec + 1.e-6 * tv.tv_usec;
+    }
+
     PmssReader::PmssReader() {
         //counter = 0;
         //currRow = -1;
+        source = NULL;
+        useMmap = false;
+        compressed = false;
+        blockData = NULL;
+        haveBlockIndex = false;
+        batch = NULL;
+        posInBatch = 0;
+        numDecodeThreads = 1;
+        parallelDecoder = NULL;
+        queueDepth = 0;
+        batchQueue = NULL;
+        readThread = NULL;
+        rowsDecoded = 0;
+        readTime = 0;
+        decodeTime = 0;
+        nextBoundItem = 0;
+        havePhkey = false;
+        sortBy = PmssSorter::SORT_NONE;
+        sortMemory = 0;
+        sortThreads = 1;
+        sorter = NULL;
+        partIndex = 0;
+        numParts = 1;
+        nextPartBlock = 0;
+        withOverlap = false;
+        numBlocksSkipped = 0;
+        numDerived = 0;
+        feed = NULL;
+        currBlockOffset = -1;
+        journal = NULL;
     }
     
-    PmssReader::PmssReader(std::string newFileName, int newSwap, int newSnapnum, double newIdfactor, int newNrecord, int newStartRow, int newMaxRows) {          
+    PmssReader::PmssReader(std::string newFileName, int newSwap, int newSnapnum, double newIdfactor, long newNrecord, long newStartRow, long newMaxRows, bool newUseMmap) {          
              // this->box = box;     
         bswap = newSwap;
         snapnum = newSnapnum;
@@ -40,51 +80,145 @@ namespace Pmss {
         nrecord = newNrecord;
         startRow = newStartRow;
         maxRows = newMaxRows;
+        useMmap = newUseMmap;
+        compressed = false;
         
         currRow = 0;
         counter = 0; // counts all particles
         countInBlock = 0; // counts particles in each data block
+        countInside = 0;  // counts particles inside the boundaries
+        countOnBoundary = 0;  // counts particles exactly on an upper boundary, which are skipped
         
         numBytesPerRow = 6*sizeof(float)+1*sizeof(long);
+
+        source = NULL;
+        blockData = NULL;
+        haveBlockIndex = false;
+        batch = NULL;
+        posInBatch = 0;
+        numDecodeThreads = 1;
+        parallelDecoder = NULL;
+        queueDepth = 0;
+        batchQueue = NULL;
+        readThread = NULL;
+        rowsDecoded = 0;
+        readTime = 0;
+        decodeTime = 0;
+        nextBoundItem = 0;
+        havePhkey = false;
+        sortBy = PmssSorter::SORT_NONE;
+        sortMemory = 0;
+        sortThreads = 1;
+        sorter = NULL;
+        partIndex = 0;
+        numParts = 1;
+        nextPartBlock = 0;
+        withOverlap = false;
+        numBlocksSkipped = 0;
+        numDerived = 0;
+        feed = NULL;
+        currBlockOffset = -1;
+        journal = NULL;
        
         openFile(newFileName);
         readPmssHeader();
         setBoundary();
-        //offsetFileStream();
+        decoder.setup(bswap, xLeft, xRight, yLeft, yRight, zLeft, zRight, fileNum, idfactor);
+        selection[0] = xLeft;
+        selection[1] = xRight;
+        selection[2] = yLeft;
+        selection[3] = yRight;
+        selection[4] = zLeft;
+        selection[5] = zRight;
+        if (startRow > 0) {
+            offsetFileStream();
+        }
         //exit(0);  // only enable, if checking header etc.
     }
     
     
     PmssReader::~PmssReader() {
+        // the splitter does not wait for us anymore
+        if (feed != NULL) {
+            feed->stop();
+        }
+
+        if (sorter != NULL) {
+            delete sorter;
+        }
+
+        if (batchQueue != NULL) {
+            batchQueue->stop();
+            readThread->join();
+            delete readThread;
+            delete batchQueue;
+        }
+
+        if (parallelDecoder != NULL) {
+            if (batch != NULL) {
+                parallelDecoder->releaseBatch(batch);
+            }
+            delete parallelDecoder;
+        }
+
         closeFile();
+
+        if (source != NULL) {
+            delete source;
+        }
     }
     
     void PmssReader::openFile(string newFileName) {
-        if (fileStream.is_open())
-            fileStream.close();
+        if (source != NULL) {
+            delete source;
+        }
 
-        // open binary file
-        fileStream.open(newFileName.c_str(), ios::in | ios::binary);
+        // open binary file, either decompressed while reading, mapped into memory or as a stream
+        compressed = (PmssCompressedSource::getCompression(newFileName) != PMSS_COMPRESS_NONE);
+        if (compressed) {
+            source = new PmssCompressedSource();
+        } else if (useMmap) {
+            source = new PmssMmapSource();
+        } else {
+            source = new PmssStreamSource();
+        }
         
-        if (!(fileStream.is_open())) {
+        if (!(source->open(newFileName))) {
             PmssIngest_error("PmssReader: Error in opening file.\n");
         }
         
         fileName = newFileName;
+        blockData = NULL;
+        haveBlockIndex = false;
     }
     
     void PmssReader::closeFile() {
-        if (fileStream.is_open())
-            fileStream.close();
+        if (source != NULL)
+            source->close();
     }
 
 
     /* Read header into one global structure at once, byteswap (if needed) */
     void PmssReader::readPmssHeader() {
         
-        assert(fileStream.is_open());
+        string error;
+
+        assert(source->isOpen());
         
-        fileStream.read(reinterpret_cast<char *>(&header), sizeof(header));
+        // take the header directly from the file (or mapped memory), 
+        // this also tells the size of the record markers and the byte order
+        format = PmssRecordFormat(bswap);
+        if (!format.readHeader(source, header, &error)) {
+            printf("%s\n", error.c_str());
+            PmssIngest_error("PmssReader: Could not read header.\n");
+        }
+        if (bswap == PmssRecordFormat::swapAuto && format.getSwap()) {
+            printf("File is byte swapped (detected from the record markers).\n");
+        }
+        bswap = format.getSwap();
+        if (format.getMarkerSize() != 4) {
+            printf("File has %d-byte record markers.\n", format.getMarkerSize());
+        }
         
         // byteswap header (if needed)
         header = swapPmssHeader(header, bswap);
@@ -107,11 +241,42 @@ namespace Pmss {
     
     /* Set the "true" boundary (without overlap) for the given fileNum */
     void PmssReader::setBoundary() {
+        float boundary[6];
+        bool consistent;
+
+        consistent = computeBoundary(header, boundary);
+        xLeft = boundary[0];
+        xRight = boundary[1];
+        yLeft = boundary[2];
+        yRight = boundary[3];
+        zLeft = boundary[4];
+        zRight = boundary[5];
+        
+        printf("Boundary set to: x: %.2f - %.2f, y: %.2f - %.2f, z: %.2f - %.2f\n", 
+            xLeft,xRight,yLeft,yRight,zLeft,zRight);
+
+        if (!consistent) {
+            printf("Problem: Mismatch between boundaries!\n");
+            printf("One or more calculated boundary values vary more than dBuffer=%f [units] from boundary in file. Maybe check your header?\n", header.dBuffer);
+            fflush(stdout);
+        }
+    }
+
+    /* Boundary without overlap (xLeft, xRight, yLeft, yRight, zLeft, zRight) 
+     * of the subbox given by nodeNum in the header; returns false if this 
+     * does not agree with the boundaries in the header, minus dBuffer */
+    bool PmssReader::computeBoundary(const pmssHeader & header, float * boundary) {
 
         int i,j,k;
         //int ifile;
         float qx, qy, qz;
         float tolerance; // tolerance
+        float box = header.box;
+        int nx = header.nx;
+        int ny = header.ny;
+        int nz = header.nz;
+        int fileNum = header.nodeNum;
+        float xLeft, xRight, yLeft, yRight, zLeft, zRight;
 
 
         k = (fileNum-1)/(nx*ny)+1;
@@ -135,9 +300,26 @@ namespace Pmss {
         yRight = j*qy;
         zLeft = (k-1)*qz;
         zRight = k*qz;
-        
-        printf("Boundary set to: x: %.2f - %.2f, y: %.2f - %.2f, z: %.2f - %.2f\n", 
-            xLeft,xRight,yLeft,yRight,zLeft,zRight);
+
+        // The boundary between two neighbouring subboxes is calculated the same
+        // way (i*qx) in both files, so a particle lying exactly on it is inside
+        // [left, right) of only one of them: the one to the right/top owns it.
+        // The last subbox in each direction ends exactly at the box size, 
+        // a particle there is the periodic image of one at 0 (owned by the 
+        // first subbox), and nothing is lost if i*qx is rounded below box.
+        if (i == nx) 
+            xRight = box;
+        if (j == ny) 
+            yRight = box;
+        if (k == nz) 
+            zRight = box;
+
+        boundary[0] = xLeft;
+        boundary[1] = xRight;
+        boundary[2] = yLeft;
+        boundary[3] = yRight;
+        boundary[4] = zLeft;
+        boundary[5] = zRight;
 
         // cross check, if this seems OK:
         tolerance = 0.001;
@@ -147,186 +329,699 @@ namespace Pmss {
             || fabs(yRight+header.dBuffer  - header.yR) > tolerance
             || fabs(zLeft-header.dBuffer  - header.zL) > tolerance
             || fabs(zRight+header.dBuffer  - header.zR) > tolerance ) {
+            return false;
+        }
 
-            printf("Problem: Mismatch between boundaries!\n");
-            printf("One or more calculated boundary values vary more than dBuffer=%f [units] from boundary in file. Maybe check your header?\n", header.dBuffer);
-            fflush(stdout);
+        return true;
+    }
+
+    /* Get positions of all data blocks, from the sidecar index file 
+     * if it exists and still matches the data file, otherwise by jumping
+     * through the file from one nrecord-header to the next. */
+    bool PmssReader::buildBlockIndex() {
+        long currPos;
+
+        // for a region, the bounds of the blocks are needed as well
+        if (haveBlockIndex && (!region.isSet() || blockIndex.hasBounds())) {
+            return true;
         }
+
+        assert(source->isOpen());
+
+        currPos = source->tell();
+        haveBlockIndex = blockIndex.loadOrBuild(fileName, source, format.getHeaderSize(), format, numBytesPerRow, region.isSet());
+        source->seek(currPos);
+
+        return haveBlockIndex;
     }
 
     /* Offset to the desired row and start ingesting from there on.
-     * NOT FULLY IMPLEMENTED YET (just use for testing) */
+     * Uses the block index, so data blocks may have different sizes. */
     void PmssReader::offsetFileStream() {
-        streamoff ipos;
-        int iblock;
+        long iblock;
         
-        assert(fileStream.is_open());
+        assert(source->isOpen());
+
+        if (!buildBlockIndex()) {
+            PmssIngest_error("PmssReader: Could not build block index, cannot offset to startRow.\n");
+        }
+
+        iblock = blockIndex.findBlock(startRow);
+        if (iblock < 0) {
+            printf("startRow %ld is beyond the last row in file (%ld rows).\n", startRow, blockIndex.getNumRows());
+            PmssIngest_error("PmssReader: Cannot offset to startRow.\n");
+        }
+
+        // position pointer at beginning of the block containing the row 
+        // where ingestion should start, load it and go to the row inside it
+        currBlockOffset = blockIndex.getBlock(iblock).offset;
+        source->seek(currBlockOffset);
+        if (!readDataBlock()) {
+            PmssIngest_error("PmssReader: Could not read data block at startRow.\n");
+        }
+        countInBlock = startRow - blockIndex.getBlock(iblock).firstRow;
 
-        // position pointer at beginning of the row where ingestion should start
-        numBytesPerRow = 6*sizeof(float)+1*sizeof(long);
-       
-        // skip 264 data blocks after header, assuming that nrecord is the same for all blocks:
-        // TODO: Would need to jump from block to block, always reading nrecord beforehand
-        // so variable lengths for data blocks can be supported.
-        iblock = 264;
-        nrecord = 500000;
-        ipos = (streamoff) (   iblock * ( (long) nrecord * (long) numBytesPerRow + 5*sizeof(int) )  );
-
-        fileStream.seekg(ipos, ios::cur);
-        
         // update currow
-        startRow = iblock*nrecord;
         currRow = startRow;
 
-        cout<<"offset currRow: "<<currRow<<endl;
+        PmssLog(PMSS_LOG_DEBUG, "offset currRow: %ld (block %ld, row in block %ld)\n", currRow, iblock, countInBlock);
     }
     
-    // read one line
-    int PmssReader::getNextRow() {
-        
-        assert(fileStream.is_open());
-        
-        char memchunk[numBytesPerRow];
-        int skipsize, iskip; 
-        int datasize;
-        int particleInside;
-        
-        //cout<<"reader: currRow: "<<currRow<<endl;
-        skipsize = 4;
-        datasize = 4;
+    /* Fetch the next complete data block (nrecord-record and data record)
+     * from the source, check the record markers around it. */
+    int PmssReader::readDataBlock() {
 
-        particleInside = 0;
+        assert(source->isOpen());
 
-        // read values until a particle inside the boundaries is found
-        while (!particleInside) {
+        std::string error;
 
-            if (countInBlock == nrecord || counter == 0) {
-                // end of data block/start of new one is reached!
+        blockData = PmssBlockDecoder::fetchBlock(source, format, &nrecord, recordBuffer, true, &error);
+        if (blockData == NULL) {
+            // reading stops here, the complete blocks before were ingested
+            if (error.length() > 0) {
+                printf("Error: %s Stop reading %s after the last complete data block.\n", error.c_str(), fileName.c_str());
+            }
+            return false;
+        }
 
-                // need to skip the integer that ends the previous block,
-                // if not very first block
-                if (counter > 0) {
-                    printf("Reached end of data block.\n");
-                    fileStream.read(memchunk,skipsize);
-                }
-                printf("Skipping nrecord-header for next data block.\n");
+        // reset countInBlock:
+        countInBlock = 0;
 
-                // skip+read block with "nrecord"
-                // -- skip (4)
-                if (!fileStream.read(memchunk,skipsize)) {
-                    printf("End of file reached.\n");
-                    return false;
-                }
+        return true;
+    }
 
-                // -- nrecord
-                fileStream.read(memchunk,datasize); // nrecord
-                assignInt(&nrecord, &memchunk[0], bswap);
-                printf("nrecord: %d\n", nrecord);
-                if (nrecord <= 0) {
-                    printf("Problem: nrecord is %d and not > 0\n", nrecord);
-                    return false;
-                }
+    /* Can the block have particles to be ingested: its bounds touch the 
+     * region and the boundaries of the file (only known with a region) */
+    bool PmssReader::blockSelected(long block) {
+        const pmssBlockInfo & info = blockIndex.getBlock(block);
 
-                // -- skip (4)
-                fileStream.read(memchunk,skipsize);
-                assignInt(&iskip, &memchunk[0], bswap);
-                // check if this integer is 4. If not, something went wrong
-                // and it would be better to just stop here.
-                if (iskip != 4) {
-                    printf("Error: trailing integer after nrecord is not 4, but %d. Exit.\n",
-                        iskip);
-                    return false;
-                }
+        if (!region.isSet() || !blockIndex.hasBounds()) {
+            return true;
+        }
 
-                // also need to skip integer that starts 
-                // the next data block 
-                fileStream.read(memchunk,skipsize);
-                assignInt(&iskip, &memchunk[0], bswap);
-                // include one more check here:
-                if (iskip != (nrecord*numBytesPerRow)) {
-                    printf("Error: block size (%d) does not agree with nrecord*numBytesPerRow (%d). Exit.\n",
-                        iskip, nrecord*numBytesPerRow);
-                    return false;
-                }
+        return (info.bounds[0] <= selection[1] && info.bounds[1] >= selection[0]
+             && info.bounds[2] <= selection[3] && info.bounds[3] >= selection[2]
+             && info.bounds[4] <= selection[5] && info.bounds[5] >= selection[4]
+             && region.intersects(info.bounds));
+    }
+
+    /* When reading only a part of the blocks or a region: jump to the next 
+     * block of this part that may have particles in the region */
+    bool PmssReader::seekNextBlock() {
+
+        if (!buildBlockIndex()) {
+            PmssIngest_error("PmssReader: Could not build block index, cannot read part of the file.\n");
+        }
 
-                // reset countInBlock:
-                countInBlock = 0;
+        // the whole file: continue after the last row (also after startRow or resuming)
+        if (numParts == 1) {
+            nextPartBlock = blockIndex.findBlock(currRow);
+            if (nextPartBlock < 0) {
+                nextPartBlock = blockIndex.getNumBlocks();
+            }
+        }
 
+        while (nextPartBlock < blockIndex.getNumBlocks() && !blockSelected(nextPartBlock)) {
+            PmssLog(PMSS_LOG_DEBUG, "Skipping data block %ld, outside of the region.\n", nextPartBlock);
+            numBlocksSkipped++;
+            nextPartBlock += numParts;
+        }
+
+        if (nextPartBlock >= blockIndex.getNumBlocks()) {
+            if (numParts > 1) {
+                printf("Last data block of part %d reached.\n", partIndex);
+            } else {
+                printf("Last data block in the region reached.\n");
             }
+            return false;
+        }
+
+        const pmssBlockInfo & info = blockIndex.getBlock(nextPartBlock);
+        source->seek(info.offset);
+        currRow = info.firstRow;
+        nextPartBlock += numParts;
+
+        return true;
+    }
+
+    /* Decode the (rest of the) next data block into a batch of particles.
+     * Stops after reading maxRows rows, but only if it is not -1 */
+    bool PmssReader::decodeNextBlock(PmssParticleBatch & newBatch) {
+        long numRows;
+        double startTime, blockStartTime, seconds;
 
-            /*if (counter > 1000000) {
-                exit(0);
+        if (maxRows != -1 && rowsDecoded >= maxRows) {
+            printf("Maximum number of rows to be ingested is reached (%ld).\n", maxRows);
+            return false;
+        }
+
+        blockStartTime = readerTime();
+
+        if (blockData == NULL || countInBlock == nrecord) {
+            // end of data block/start of new one is reached!
+            if (blockData != NULL) {
+                PmssLog(PMSS_LOG_DEBUG, "Reached end of data block.\n");
             }
-            */
-            
-            // read the line (one particle) at once
-            // TODO: Could also read all nrecord-lines, i.e. the whole datablock
-            // at once, then always use the next value in array
-            // or, if at end of array, read the next data block.
-            if (!fileStream.read(memchunk,numBytesPerRow)) {
+
+            if ((numParts > 1 || region.isSet()) && !seekNextBlock()) {
                 return false;
             }
 
-            // now parse the line and assign it to the proper variables
-            assignFloat(&x, &memchunk[0], bswap);
-            assignFloat(&y, &memchunk[sizeof(float)], bswap);
-            assignFloat(&z, &memchunk[2*sizeof(float)], bswap);
-            assignFloat(&vx, &memchunk[3*sizeof(float)], bswap);
-            assignFloat(&vy, &memchunk[4*sizeof(float)], bswap);
-            assignFloat(&vz, &memchunk[5*sizeof(float)], bswap);
-            assignLong(&id, &memchunk[6*sizeof(float)], bswap);
-            
+            startTime = readerTime();
+            currBlockOffset = source->tell();
+            if (!readDataBlock()) {
+                return false;
+            }
+            seconds = readerTime() - startTime;
+            readTime += seconds;
+            PmssMetrics::addTime(TIMER_READ, seconds);
+        }
 
-            // Create another id from number of file and row.
-            // This helps to check ingestions and remove particles from the
-            // database that were ingested from the same file, if something
-            // went wrong during ingestion process (e.g. connection was lost).
-            // 
-            fileRowId = (long int) (fileNum * idfactor + currRow);
+        numRows = nrecord - countInBlock;
+        if (maxRows != -1 && rowsDecoded + numRows > maxRows) {
+            numRows = maxRows - rowsDecoded;
+        }
 
-            if (counter % 100000 == 0) 
-                printf("   check: counter, fileRowId, id, x,y,z, vx,vy,vz: %d, %ld %ld, %f %f %f, %f %f %f\n", 
-                    counter, fileRowId, id, x,y,z, vx,vy,vz);
+        startTime = readerTime();
+        decoder.decode(&blockData[countInBlock * (long) numBytesPerRow], numRows, currRow, newBatch);
+        if (countInBlock == 0) 
+            newBatch.blockOffset = currBlockOffset;
+        seconds = readerTime() - startTime;
+        decodeTime += seconds;
+        PmssMetrics::addTime(TIMER_DECODE, seconds);
+        PmssMetrics::addLatency(readerTime() - blockStartTime);
 
-            currRow++;
-            counter++;
-            countInBlock++;
+        currRow += numRows;
+        rowsDecoded += numRows;
+        countInBlock += numRows;
 
+        return true;
+    }
 
-            // Check, if values are inside of boundary.
-            // If not: skip this line, i.e. read the next line, until a valid
-            // line was foúnd.
+    /* Work of the reading thread: fill the queue until the file is done */
+    void PmssReader::readLoop() {
+        PmssParticleBatch * nextBatch;
 
-            // include "=="" on both sides, since we don't want to miss particles at box boundary
-            // rather have duplicates and correct for them later on than have missing particles. 
+        while ((nextBatch = batchQueue->getFree()) != NULL) {
+            if (!decodeNextBlock(*nextBatch)) {
+                break;
+            }
+            batchQueue->push();
+        }
+        batchQueue->finish();
+    }
 
-            if (x >= xLeft && x < xRight 
-             && y >= yLeft && y < yRight
-             && z >= zLeft && z < zRight) {
-                // fine
-                particleInside = 1;
-            } else {
-                 // read again
-                particleInside = 0;
+    /* Get the next batch of particles, sorted or as they come from the file */
+    bool PmssReader::nextBatch() {
+        bool haveBatch;
+
+        if (sortBy != PmssSorter::SORT_NONE) {
+            haveBatch = nextSortedBatch();
+        } else {
+            haveBatch = nextFileBatch();
+        }
+
+        if (haveBatch) {
+            PmssMetrics::count(METRIC_ROWS_INGESTED, batch->numRows - posInBatch);
+
+            // all rows before this block were handed out
+            if (journal != NULL && batch->blockOffset >= 0) {
+                journal->blockStarted(batch->blockOffset, batch->firstRow, 
+                    (long) (fileNum * idfactor + batch->firstRow), countInside);
             }
         }
+        return haveBatch;
+    }
+
+    /* Continue reading at the data block starting at this file offset (from 
+     * a journal), without building the block index. Must be called before 
+     * the first row is read. */
+    bool PmssReader::seekBlock(long offset, long row) {
+        if (batch != NULL || offset < format.getHeaderSize() || offset >= source->size()) {
+            return false;
+        }
+        if (!source->seek(offset)) {
+            return false;
+        }
+
+        blockData = NULL;
+        countInBlock = 0;
+        currRow = row;
+
+        PmssLog(PMSS_LOG_DEBUG, "resume at currRow: %ld (block at offset %ld)\n", currRow, offset);
+        return true;
+    }
 
-	    // stop after reading maxRows, but only if it is not -1
-	    // Note: Could this be accelerated? It's unnecessary most of the time,
-	    // but now it is evaluated for each row ...
-        // (But doesn't affect performance that much. Bottle-neck is rather
-        // sending of data to database server)
-        if (maxRows != -1) {
-            if (counter > maxRows) {
-                printf("Maximum number of rows to be ingested is reached (%d).\n", maxRows);
+    /* Report the start of each data block to the journal, as a possible checkpoint */
+    void PmssReader::setJournal(PmssJournal * newJournal) {
+        journal = newJournal;
+    }
+
+    /* Get the next batch of particles from the file, either decoded here or 
+     * by the reading/decoding thread(s) */
+    bool PmssReader::nextFileBatch() {
+
+        if (feed != NULL) {
+            if (batch != NULL) {
+                feed->release();
+            }
+            batch = feed->pop();
+            if (batch == NULL) {
                 return false;
-	       }
+            }
+            posInBatch = 0;
+            counter += batch->numRowsRead;
+            countOnBoundary += batch->numOnBoundary;
+            return true;
+        }
+
+        if (numDecodeThreads > 1 && numParts == 1) {
+            return nextParallelBatch();
+        }
+
+        if (queueDepth > 0) {
+            return nextQueuedBatch();
+        }
+
+        if (!decodeNextBlock(serialBatch)) {
+            return false;
+        }
+        batch = &serialBatch;
+        posInBatch = 0;
+        counter += batch->numRowsRead;
+        countOnBoundary += batch->numOnBoundary;
+
+        return true;
+    }
+
+    /* Get the next batch from the decoding threads; they are started 
+     * at the first call, beginning at the current row */
+    bool PmssReader::nextParallelBatch() {
+        long lastRow;
+
+        if (maxRows != -1 && counter >= maxRows) {
+            printf("Maximum number of rows to be ingested is reached (%ld).\n", maxRows);
+            return false;
+        }
+
+        if (parallelDecoder == NULL) {
+            if (!buildBlockIndex()) {
+                PmssIngest_error("PmssReader: Could not build block index, cannot decode in parallel.\n");
+            }
+
+            lastRow = blockIndex.getNumRows();
+            if (maxRows != -1) {
+                lastRow = currRow + (maxRows - counter);
+            }
+
+            vector<bool> skipBlock(blockIndex.getNumBlocks(), false);
+            for (long i = 0; i < blockIndex.getNumBlocks(); i++) {
+                skipBlock[i] = !blockSelected(i);
+                if (skipBlock[i] && blockIndex.getBlock(i).firstRow + blockIndex.getBlock(i).nrecord > currRow) 
+                    numBlocksSkipped++;
+            }
+
+            printf("Decoding data blocks with %d threads.\n", numDecodeThreads);
+            parallelDecoder = new PmssParallelDecoder(numDecodeThreads, (queueDepth > 0) ? queueDepth : 1);
+            parallelDecoder->start(fileName, useMmap, format, &decoder, &blockIndex, currRow, lastRow, &skipBlock);
+        } else if (batch != NULL) {
+            parallelDecoder->releaseBatch(batch);
+        }
+
+        batch = parallelDecoder->nextBatch();
+        if (batch == NULL) {
+            printf("End of file reached.\n");
+            return false;
+        }
+        if (batch->error) {
+            parallelDecoder->releaseBatch(batch);
+            batch = NULL;
+            return false;
+        }
+
+        posInBatch = 0;
+        currRow += batch->numRowsRead;
+        counter += batch->numRowsRead;
+        countOnBoundary += batch->numOnBoundary;
+
+        return true;
+    }
+
+    /* Get the next batch from the reading thread, which is started at the first call */
+    bool PmssReader::nextQueuedBatch() {
+
+        if (batchQueue == NULL) {
+            printf("Reading data blocks in a separate thread, up to %d batches ahead.\n", queueDepth);
+            batchQueue = new PmssBatchQueue(queueDepth);
+            readThread = new boost::thread(boost::bind(&PmssReader::readLoop, this));
+        } else if (batch != NULL) {
+            batchQueue->release();
+        }
+
+        batch = batchQueue->pop();
+        if (batch == NULL) {
+            return false;
+        }
+
+        posInBatch = 0;
+        counter += batch->numRowsRead;
+        countOnBoundary += batch->numOnBoundary;
 
-	    }
+        return true;
+    }
+
+    /* Get the next batch of sorted particles; at the first call, all particles 
+     * are read from the file and sorted */
+    bool PmssReader::nextSortedBatch() {
+
+        if (sorter == NULL) {
+            sorter = new PmssSorter(sortBy, sortMemory, sortDir, sortThreads);
+            while (nextFileBatch()) {
+                sorter->add(*batch);
+            }
+            if (!sorter->finish()) {
+                printf("PmssSorter: %s\n", sorter->getError().c_str());
+                PmssIngest_error("PmssReader: Could not sort the particles.\n");
+            }
+        }
+
+        batch = &sortedBatch;
+        posInBatch = 0;
+
+        if (!sorter->nextBatch(sortedBatch, 65536)) {
+            if (sorter->getError().length() > 0) {
+                printf("PmssSorter: %s\n", sorter->getError().c_str());
+                PmssIngest_error("PmssReader: Could not merge the sorted particles.\n");
+            }
+            return false;
+        }
+        // the sorter only keeps the raw columns
+        decoder.derive(sortedBatch);
+
+        return true;
+    }
+
+    // number of threads for decoding, must be set before the first row is read
+    void PmssReader::setDecodeThreads(int numThreads) {
+        numDecodeThreads = (numThreads > 1) ? numThreads : 1;
+
+        // the decoding threads open the file themselves and jump to their
+        // blocks, which would mean decompressing it again for each of them
+        if (compressed && numDecodeThreads > 1) {
+            printf("Compressed file: data blocks are decoded by the reading thread only.\n");
+            numDecodeThreads = 1;
+        }
+    }
+
+    // number of decoded batches waiting for getNextRow, 0 for reading in the same thread;
+    // must be set before the first row is read
+    void PmssReader::setQueueDepth(int newQueueDepth) {
+        queueDepth = (newQueueDepth > 0) ? newQueueDepth : 0;
+    }
+
+    // compute phkey from x,y,z with level bits per dimension (0: NULL);
+    // must be set before the first row is read
+    void PmssReader::setPhkeyLevel(int level) {
+        if (level > PmssHilbert::maxLevel) {
+            printf("phkey level %d is too large, using %d.\n", level, PmssHilbert::maxLevel);
+        }
+        decoder.setPhkey(level, box);
+    }
+
+    // sort the particles (PmssSorter::SORT_PHKEY or SORT_ID) using at most memoryBytes 
+    // and writing runs to scratchDir with numThreads; must be set before the first row is read
+    void PmssReader::setSort(int newSortBy, long memoryBytes, string scratchDir, int numThreads) {
+        sortBy = newSortBy;
+        sortMemory = memoryBytes;
+        sortDir = scratchDir;
+        sortThreads = numThreads;
+    }
+
+    /* Only read blocks newPartIndex, newPartIndex+newNumParts, ... of the file,
+     * so that several readers can share a file. Set before the first row is read. */
+    void PmssReader::setBlockPartition(int newPartIndex, int newNumParts) {
+        partIndex = newPartIndex;
+        numParts = (newNumParts > 1) ? newNumParts : 1;
+        nextPartBlock = partIndex;
+    }
+    
+    /* Only hand out particles inside the region. With overlap, the particles in 
+     * the overlap region around the subbox (dBuffer) are included, which are 
+     * in the neighbouring files as well. Set before the first row is read. */
+    void PmssReader::setRegion(const PmssRegion & newRegion, bool newWithOverlap) {
+        region = newRegion;
+        withOverlap = newWithOverlap;
+
+        if (withOverlap) {
+            selection[0] = header.xL;
+            selection[1] = header.xR;
+            selection[2] = header.yL;
+            selection[3] = header.yR;
+            selection[4] = header.zL;
+            selection[5] = header.zR;
+            decoder.setup(bswap, header.xL, header.xR, header.yL, header.yR, header.zL, header.zR, fileNum, idfactor);
+            printf("Boundary extended by the overlap region to: x: %.2f - %.2f, y: %.2f - %.2f, z: %.2f - %.2f\n", 
+                header.xL, header.xR, header.yL, header.yR, header.zL, header.zR);
+        }
+        decoder.setRegion(region);
+    }
+
+    /* Only hand out the particles of this subsample. Set before the first row is read. */
+    void PmssReader::setSample(const PmssSample & sample) {
+        decoder.setSample(sample);
+    }
+
+    /* Compute these extra columns for each particle, with the constants from
+     * the header of this file. Set before the first row is read. */
+    void PmssReader::setDerived(const PmssDerived & newDerived) {
+        PmssDerived bound = newDerived;
+
+        bound.bind(header);
+        decoder.setDerived(bound);
+        numDerived = bound.size();
+    }
+
+    /* Take the batches from this queue, filled by a PmssSampleSplitter, instead 
+     * of reading the file; only the header is read from the file, which is 
+     * closed here. Set before the first row is read. */
+    void PmssReader::setFeed(PmssBatchQueue * newFeed) {
+        feed = newFeed;
+        closeFile();
+    }
+
+    /* Check from the header only if a file can have particles in the region */
+    bool PmssReader::fileInRegion(string fileName, int swap, const PmssRegion & region, bool withOverlap, int * fileNum) {
+        PmssFileSource * headerSource;
+        PmssRecordFormat fileFormat(swap);
+        pmssHeader fileHeader;
+        string error;
+        float bounds[6];
+        bool inRegion;
+
+        *fileNum = 0;
+        if (PmssCompressedSource::getCompression(fileName) != PMSS_COMPRESS_NONE) {
+            headerSource = new PmssCompressedSource();
+        } else {
+            headerSource = new PmssStreamSource();
+        }
+
+        // if the header can not be read, the reader will tell
+        inRegion = true;
+        if (headerSource->open(fileName) && fileFormat.readHeader(headerSource, fileHeader, &error)) {
+            fileHeader = swapPmssHeader(fileHeader, fileFormat.getSwap());
+            *fileNum = fileHeader.nodeNum;
+
+            if (withOverlap) {
+                bounds[0] = fileHeader.xL;
+                bounds[1] = fileHeader.xR;
+                bounds[2] = fileHeader.yL;
+                bounds[3] = fileHeader.yR;
+                bounds[4] = fileHeader.zL;
+                bounds[5] = fileHeader.zR;
+                inRegion = region.intersects(bounds);
+            } else if (fileHeader.nx > 0 && fileHeader.ny > 0 && fileHeader.nz > 0) {
+                computeBoundary(fileHeader, bounds);
+                inRegion = region.intersects(bounds);
+            }
+        }
+        headerSource->close();
+        delete headerSource;
+
+        return inRegion;
+    }
+
+    // read one line
+    int PmssReader::getNextRow() {
+        
+        assert(feed != NULL || source->isOpen());
+
+        // get the next batch, if all particles of the current one are used;
+        // a batch can also be empty, if all its particles are outside the boundaries
+        while (batch == NULL || posInBatch >= batch->numRows) {
+            if (!nextBatch()) {
+                return false;
+            }
+        }
+
+        x = batch->x[posInBatch];
+        y = batch->y[posInBatch];
+        z = batch->z[posInBatch];
+        vx = batch->vx[posInBatch];
+        vy = batch->vy[posInBatch];
+        vz = batch->vz[posInBatch];
+        id = batch->id[posInBatch];
+        fileRowId = batch->fileRowId[posInBatch];
+        havePhkey = batch->havePhkey;
+        phkey = havePhkey ? batch->phkey[posInBatch] : 0;
+
+        if (posInBatch == 0) 
+            PmssLog(PMSS_LOG_DEBUG, "   check: counter, fileRowId, id, x,y,z, vx,vy,vz: %ld, %ld %ld, %f %f %f, %f %f %f\n", 
+                counter, fileRowId, id, x,y,z, vx,vy,vz);
+
+        posInBatch++;
+        countInside++;
 	
         return true;       
     }
 
+
+    /* Hand out the next rows (at most maxNumRows, 0 for no limit) at once, as one 
+     * array per schema item in the order of bindSchema: columns[i] points to the 
+     * values of item i (float or long, see getColumnDType), or is NULL for constants
+     * and NULL columns. The arrays are valid until the next call.
+     * Returns the number of rows, 0 at the end. */
+    long PmssReader::getNextRows(long maxNumRows, const void ** columns) {
+        long numRows;
+        size_t i;
+
+        assert(feed != NULL || source->isOpen());
+
+        while (batch == NULL || posInBatch >= batch->numRows) {
+            if (!nextBatch()) {
+                return 0;
+            }
+        }
+
+        numRows = batch->numRows - posInBatch;
+        if (maxNumRows > 0 && numRows > maxNumRows) {
+            numRows = maxNumRows;
+        }
+
+        for (i = 0; i < boundItems.size(); i++) {
+            columns[i] = (boundColumns[i] >= 0) ? batch->getColumn(boundColumns[i], posInBatch) : NULL;
+        }
+
+        if (posInBatch == 0) 
+            PmssLog(PMSS_LOG_DEBUG, "   check: counter, fileRowId, id, x,y,z, vx,vy,vz: %ld, %ld %ld, %f %f %f, %f %f %f\n", 
+                counter, batch->fileRowId[0], batch->id[0], batch->x[0], batch->y[0], batch->z[0], 
+                batch->vx[0], batch->vy[0], batch->vz[0]);
+
+        posInBatch += numRows;
+        countInside += numRows;
+
+        return numRows;
+    }
+
+    /* Hand out all remaining particles of the next batch at once (for 
+     * PmssSampleSplitter); the batch is valid until the next call. 
+     * Returns NULL at the end. */
+    const PmssParticleBatch * PmssReader::nextRowBatch() {
+
+        assert(source->isOpen());
+
+        if (sortBy != PmssSorter::SORT_NONE) {
+            if (!nextSortedBatch()) {
+                return NULL;
+            }
+        } else if (!nextFileBatch()) {
+            return NULL;
+        }
+
+        countInside += batch->numRows - posInBatch;
+        posInBatch = batch->numRows;
+
+        return batch;
+    }
+
+    /* Resolve the columns of all items of the schema, in schema order */
+    void PmssReader::bindSchema(DBDataSchema::Schema * schema) {
+        vector<DBDataSchema::SchemaItem *> items = schema->getArrSchemaItems();
+
+        boundItems.clear();
+        boundColumns.clear();
+        nextBoundItem = 0;
+        for (size_t i = 0; i < items.size(); i++) {
+            bindItem(items[i]->getDataDesc());
+        }
+    }
+
+    int PmssReader::bindItem(DBDataSchema::DataObjDesc * thisItem) {
+        int column;
+
+        column = -1;
+        if (thisItem->getIsConstItem() == false) {
+            column = getColumnOf(thisItem->getDataObjName());
+            if (column < 0 || column >= PMSS_NUM_COLUMNS + (int) numDerived) {
+                printf("Unknown data object %s.\n", thisItem->getDataObjName().c_str());
+                PmssIngest_error("PmssReader: Cannot bind schema.\n");
+            }
+            if (thisItem->getDataObjDType() != getColumnDType(column)) {
+                printf("Data object %s has the wrong type.\n", thisItem->getDataObjName().c_str());
+                PmssIngest_error("PmssReader: Cannot bind schema.\n");
+            }
+        }
+
+        boundItems.push_back(thisItem);
+        boundColumns.push_back(column);
+
+        return column;
+    }
+
+    /* Column of a schema item; items come in the same order for every row,
+     * so usually this is just the next one */
+    int PmssReader::findColumn(DBDataSchema::DataObjDesc * thisItem) {
+        size_t i;
+
+        if (nextBoundItem >= boundItems.size() || boundItems[nextBoundItem] != thisItem) {
+            for (i = 0; i < boundItems.size(); i++) {
+                if (boundItems[i] == thisItem) 
+                    break;
+            }
+            if (i == boundItems.size()) {
+                bindItem(thisItem);
+            }
+            nextBoundItem = i;
+        }
+
+        return boundColumns[nextBoundItem++];
+    }
+
+    // "Col1" ... "Col9" are the raw columns, "Col10" ... the derived ones
+    int PmssReader::getColumnOf(string dataObjName) {
+        char * end;
+        long number;
+
+        if (dataObjName.compare(0, 3, "Col") != 0 || dataObjName.length() < 4) {
+            return -1;
+        }
+        number = strtol(dataObjName.c_str() + 3, &end, 10);
+        if (*end != '\0' || number < 1 || dataObjName[3] == '0' || dataObjName[3] == '+' || dataObjName[3] == '-') {
+            return -1;
+        }
+
+        return (int) number - 1;
+    }
+
+    DBDataSchema::DType PmssReader::getColumnDType(int column) {
+        switch (column) {
+            case PMSS_COL_ID:
+            case PMSS_COL_FILEROWID:
+                return DBDataSchema::DT_INT8;
+            case PMSS_COL_PHKEY:
+                return DBDataSchema::DT_INT4;
+        }
+        return DBDataSchema::DT_REAL4;
+    }
     
     bool PmssReader::getItemInRow(DBDataSchema::DataObjDesc * thisItem, bool applyAsserters, bool applyConverters, void* result) {
         
@@ -355,41 +1050,58 @@ namespace Pmss {
     
     bool PmssReader::getDataItem(DBDataSchema::DataObjDesc * thisItem, void* result) {
 
-        //check if this is "Col1" etc. and if yes, assign corresponding value
+        //check which column ("Col1" etc.) this is and assign corresponding value
         //the variables are declared already in Pmss_Reader.h 
         //and the values were read in getNextRow()
         bool isNull;
+        int column;
 
         //printf("   counter: fileRowId, id, x,y,z, vx,vy,vz: %d: %ld %ld %f %f %f, %f %f %f\n", 
         //            counter, fileRowId, id, x,y,z, vx,vy,vz);
 
         isNull = false;
-        if(thisItem->getDataObjName().compare("Col1") == 0) {           
-            *(float*)(result) = x;
-        } else if (thisItem->getDataObjName().compare("Col2") == 0) {
-            *(float*)(result) = y;
-        } else if (thisItem->getDataObjName().compare("Col3") == 0) {
-            *(float*)(result) = z;
-        } else if (thisItem->getDataObjName().compare("Col4") == 0) {
-            *(float*)(result) = vx;
-        } else if (thisItem->getDataObjName().compare("Col5") == 0) {
-            *(float*)(result) = vy;
-        } else if (thisItem->getDataObjName().compare("Col6") == 0) {
-            *(float*)(result) = vz;
-        } else if (thisItem->getDataObjName().compare("Col7") == 0) {
-            //particleId = (long int) ( (snapnum)*idfactor + id );
-            *(long*)(result) = id;
-        } else if (thisItem->getDataObjName().compare("Col8") == 0) {
-            phkey = 0;
-            *(int*)(result) = phkey;
-            // better: let DBIngestor insert Null at this column
-            // => need to return 1, so that Null will be written.
-            isNull = true;
-        } else if (thisItem->getDataObjName().compare("Col9") == 0) {
-            *(long*)(result) = fileRowId;
-        } else {
-            printf("Something went wrong...\n");
-            exit(EXIT_FAILURE);
+        column = findColumn(thisItem);
+        switch (column) {
+            case PMSS_COL_X:
+                *(float*)(result) = x;
+                break;
+            case PMSS_COL_Y:
+                *(float*)(result) = y;
+                break;
+            case PMSS_COL_Z:
+                *(float*)(result) = z;
+                break;
+            case PMSS_COL_VX:
+                *(float*)(result) = vx;
+                break;
+            case PMSS_COL_VY:
+                *(float*)(result) = vy;
+                break;
+            case PMSS_COL_VZ:
+                *(float*)(result) = vz;
+                break;
+            case PMSS_COL_ID:
+                //particleId = (long int) ( (snapnum)*idfactor + id );
+                *(long*)(result) = id;
+                break;
+            case PMSS_COL_PHKEY:
+                *(int*)(result) = phkey;
+                // without level, let DBIngestor insert Null at this column
+                // => need to return 1, so that Null will be written.
+                isNull = !havePhkey;
+                break;
+            case PMSS_COL_FILEROWID:
+                *(long*)(result) = fileRowId;
+                break;
+            default:
+                // derived columns are not copied by getNextRow, take them from
+                // the batch (posInBatch is already at the next row)
+                if (column >= PMSS_NUM_COLUMNS) {
+                    *(float*)(result) = batch->derived[column - PMSS_NUM_COLUMNS][posInBatch - 1];
+                    break;
+                }
+                printf("Something went wrong...\n");
+                exit(EXIT_FAILURE);
         }
 
         return isNull;
@@ -401,93 +1113,62 @@ namespace Pmss {
     }
 
 
-    // write part from memoryblock to integer; byteswap, if necessary (TODO: use global 'swap' or locally submit?)
-    int PmssReader::assignInt(int *n, char *memblock, int bswap) {
-        
-        unsigned char *cptr,tmp;
-
-        if (sizeof(int) != 4) {
-            fprintf(stderr,"assignInt: sizeof(int)=%ld and not 4. Can't handle that.\n",sizeof(int));
-            return 0;
-        }
+    int PmssReader::getFileNum() {
+        return fileNum;
+    }
 
-        if (!memcpy(n,  memblock, sizeof(int))) {
-            fprintf(stderr,"Error: Encountered end of memory block or other trouble when reading the memory block.\n");
-            return 0;
-        }
+    // byte offset of the first data block, behind the header records
+    long PmssReader::getDataStart() {
+        return format.getHeaderSize();
+    }
 
-        if (bswap) {
-            cptr = (unsigned char *) n;
-            tmp     = cptr[0];
-            cptr[0] = cptr[3];    
-            cptr[3] = tmp;
-            tmp     = cptr[1];
-            cptr[1] = cptr[2];
-            cptr[2] = tmp;
-        }
+    // number of rows read from file so far, including those outside of the boundaries
+    long PmssReader::getNumRowsRead() {
+        return counter;
+    }
 
-        return 1;
+    // number of rows inside of the boundaries, i.e. handed over for ingestion
+    long PmssReader::getNumRowsInside() {
+        return countInside;
     }
 
-    // write part from memoryblock to long; byteswap, if necessary
-    int PmssReader::assignLong(long *n, char *memblock, int bswap) {
-        
-        unsigned char *cptr,tmp;
+    // number of data blocks not read, because they are outside of the region
+    long PmssReader::getNumBlocksSkipped() {
+        return numBlocksSkipped;
+    }
 
-        if (sizeof(long) != 8) {
-            fprintf(stderr,"assignLong: sizeof(long)=%ld and not 8. Can't handle that.\n",sizeof(long));
-            return 0;
-        }
+    // number of rows skipped, because they lie exactly on an upper boundary 
+    // and are ingested from the neighbouring file
+    long PmssReader::getNumRowsOnBoundary() {
+        return countOnBoundary;
+    }
 
-        if (!memcpy(n,  memblock, sizeof(long))) {
-            fprintf(stderr,"Error: Encountered end of memory block or other trouble when reading the memory block.\n");
-            return 0;
-        }
+    // seconds spent fetching data blocks from the file (not counted with decodeThreads)
+    double PmssReader::getReadTime() {
+        return readTime;
+    }
 
-        if (bswap) {
-            cptr = (unsigned char *) n;
-            tmp     = cptr[0];
-            cptr[0] = cptr[7];
-            cptr[7] = tmp;
-            tmp     = cptr[1];
-            cptr[1] = cptr[6];
-            cptr[6] = tmp;
-            tmp     = cptr[2];
-            cptr[2] = cptr[5];
-            cptr[5] = tmp;
-            tmp     = cptr[3];
-            cptr[3] = cptr[4];
-            cptr[4] = tmp;
-        }
+    // seconds spent decoding data blocks (byteswap, boundary check, phkey)
+    double PmssReader::getDecodeTime() {
+        return decodeTime;
+    }
 
-        return 1;
+    // seconds the reading side waited, because the queue was full (i.e. the database was slower)
+    double PmssReader::getReaderWait() {
+        if (parallelDecoder != NULL) 
+            return parallelDecoder->getProducerWait();
+        if (batchQueue != NULL) 
+            return batchQueue->getProducerWait();
+        return 0;
     }
 
-    // write part from memoryblock to float; byteswap, if necessary
-    int PmssReader::assignFloat(float *n, char *memblock, int bswap) {
-        
-        unsigned char *cptr,tmp;
-        
-        if (sizeof(float) != 4) {
-            fprintf(stderr,"assignFloat: sizeof(float)=%ld and not 4. Can't handle that.\n",sizeof(float));
-            return 0;
-        }
-        
-        if (!memcpy(n, memblock, sizeof(float))) {
-            printf("Error: Encountered end of memory block or other trouble when reading the memory block.\n");
-            return 0;
-        }
-        
-        if (bswap) {
-            cptr = (unsigned char *) n;
-            tmp     = cptr[0];
-            cptr[0] = cptr[3];    
-            cptr[3] = tmp;
-            tmp     = cptr[1];
-            cptr[1] = cptr[2];
-            cptr[2] = tmp;
-        }
-        return 1;
+    // seconds getNextRow waited for the reading side (i.e. reading/decoding was slower)
+    double PmssReader::getIngestWait() {
+        if (parallelDecoder != NULL) 
+            return parallelDecoder->getConsumerWait();
+        if (batchQueue != NULL) 
+            return batchQueue->getConsumerWait();
+        return 0;
     }
 
     // swap each header item
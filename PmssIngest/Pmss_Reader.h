@@ -19,10 +19,23 @@
  */
 
 #include <Reader.h>
+#include <Schema.h>
 #include <string>
 #include <fstream>
 #include <stdio.h>
 #include <assert.h>
+#include "Pmss_Header.h"
+#include "Pmss_FileSource.h"
+#include "Pmss_CompressedSource.h"
+#include "Pmss_BlockIndex.h"
+#include "Pmss_BlockDecoder.h"
+#include "Pmss_ParallelDecoder.h"
+#include "Pmss_BatchQueue.h"
+#include "Pmss_Sorter.h"
+#include "Pmss_Journal.h"
+#include "Pmss_Region.h"
+#include "Pmss_Sample.h"
+#include "Pmss_Derived.h"
 
 #ifndef Pmss_Pmss_Reader_h
 #define Pmss_Pmss_Reader_h
@@ -31,52 +44,18 @@ using namespace DBReader;
 using namespace DBDataSchema;
 using namespace std;
 
-
-// structure for header
-typedef struct {
-    int ilead1;
-    float aexpn;    // expansion factor of universe
-    float Omega0;   // density parameter for matter at z=0
-    float OmegaL0;  // density parameter for dark energy at z=0
-    float hubble;   // Hubble constant at z=0 (h)
-    float box;      // side length of cosmological box
-    float particleMass;     // mass of one particle
-    int itrail1;
-
-    int ilead2;
-    int nodeNum;        // number of node/file/subbox
-    int nx;         // number of subboxes in x direction
-    int ny;         // number of subboxes in y direction
-    int nz;         // number of subboxes in z direction
-    float dBuffer;  // overlap at boundary in Mpc/h 
-    int nBuffer;    
-    int itrail2;
-
-    int ilead3;
-    float xL;       // left border in x-direction in file
-    float xR;       // right border in x-direction in file
-    float yL;
-    float yR;
-    float zL;
-    float zR;
-    int itrail3;
-
-    int ilead4;
-    int np;         // total number of particles in this file
-    int itrail4;
-
-} pmssHeader;
-
-
 namespace Pmss {
     
     class PmssReader : public Reader {
     private:
         std::string fileName;
         
-        std::ifstream fileStream;
+        // where the bytes come from (file stream or memory map)
+        PmssFileSource * source;
+        bool useMmap;
+        bool compressed;    // .gz, .xz or .zst, decompressed while reading
         
-        int currRow;
+        long currRow;
         unsigned long numFieldPerRow;
         
         std::string buffer;
@@ -89,11 +68,83 @@ namespace Pmss {
         std::string tmpStr;
               
         string pmssString;
-        int counter;
-        int countInBlock;   // counter for particles in each data block
+        long counter;
+        long countInBlock;  // counter for particles in each data block
+        long countInside;   // counter for particles inside the boundaries
+        long countOnBoundary;   // counter for particles skipped on a shared boundary
 
         int numBytesPerRow;	
 
+        // framing of the Fortran records (marker size, detected from the header)
+        PmssRecordFormat format;
+
+        // points to the nrecord rows of one complete data block (in the file, 
+        // the mapped memory or recordBuffer), rows are served from here 
+        // instead of reading each of them from the file
+        const char * blockData;
+        std::vector<char> recordBuffer;
+
+        // table of all data blocks, only built when needed (e.g. for offsetting)
+        PmssBlockIndex blockIndex;
+        bool haveBlockIndex;
+
+        // converts data blocks to batches of particles inside the boundaries,
+        // getNextRow hands out the rows of the current batch one by one
+        PmssBlockDecoder decoder;
+        PmssParticleBatch serialBatch;
+        PmssParticleBatch * batch;
+        long posInBatch;
+
+        // decode blocks with several threads (still handed out in file order)
+        int numDecodeThreads;
+        PmssParallelDecoder * parallelDecoder;
+
+        // read and decode blocks in a separate thread, up to queueDepth batches
+        // ahead of getNextRow, so that reading overlaps with sending to the database
+        int queueDepth;
+        PmssBatchQueue * batchQueue;
+        boost::thread * readThread;
+        long rowsDecoded;   // counter for the reading side, counter is for the rows handed out
+        double readTime;    // seconds spent in readDataBlock and in decoding, on the reading side
+        double decodeTime;
+
+        // hand out the particles sorted by phkey or id instead of in file order;
+        // all particles are read (and sorted) with the first batch
+        int sortBy;
+        long sortMemory;
+        std::string sortDir;
+        int sortThreads;
+        PmssSorter * sorter;
+        PmssParticleBatch sortedBatch;
+
+        // file offset of the current data block, and where to report block starts
+        long currBlockOffset;
+        PmssJournal * journal;
+
+        // only read every numParts-th block, starting with block partIndex
+        int partIndex;
+        int numParts;
+        long nextPartBlock;
+        // only particles in this region (and blocks whose bounds touch it and
+        // the selected boundaries), optionally including the overlap region
+        PmssRegion region;
+        bool withOverlap;
+        float selection[6];     // xLeft ... zRight, or the file boundaries with overlap
+        long numBlocksSkipped;
+
+        // number of derived columns (computed by the decoder), after the raw ones
+        size_t numDerived;
+
+        // batches come from this queue (see PmssSampleSplitter) instead of the file
+        PmssBatchQueue * feed;
+
+        // schema items and the column (pmssColumn, -1 for constants) each of them
+        // is filled from; resolved once (bindSchema or with the first row), so that
+        // getItemInRow does not need to compare the item names for every value
+        std::vector<DBDataSchema::DataObjDesc *> boundItems;
+        std::vector<int> boundColumns;
+        size_t nextBoundItem;
+
         // items from file
         pmssHeader header;
 
@@ -111,7 +162,8 @@ namespace Pmss {
         int snapnum;
         long int particleId;
         int phkey;
-        int nrecord;
+        bool havePhkey;
+        long nrecord;
         float box;
 
         float xLeft, xRight, yLeft, yRight, zLeft, zRight;
@@ -120,13 +172,13 @@ namespace Pmss {
         int bswap;
 
         // to be passed on from main
-        int startRow;   // at which row should we start ingesting
-        int maxRows;    // max. number of rows to ingest
+        long startRow;  // at which row should we start ingesting
+        long maxRows;   // max. number of rows to ingest
 
 
     public:
         PmssReader();
-        PmssReader(std::string newFileName, int swap, int snapnum, double idfactor, int nrecord, int startRow, int maxRows);          
+        PmssReader(std::string newFileName, int swap, int snapnum, double idfactor, long nrecord, long startRow, long maxRows, bool useMmap = false);          
         ~PmssReader();
 
         void openFile(std::string newFileName);
@@ -136,23 +188,87 @@ namespace Pmss {
         void readPmssHeader();
 
         void setBoundary();
+
+        static bool computeBoundary(const pmssHeader & header, float * boundary);
         
+        bool buildBlockIndex();
+
         void offsetFileStream();
         
+        int readDataBlock();
+
+        bool blockSelected(long block);
+        bool seekNextBlock();
+
+        bool decodeNextBlock(PmssParticleBatch & newBatch);
+
+        void readLoop();
+
+        bool nextBatch();
+
+        bool nextFileBatch();
+
+        bool nextParallelBatch();
+
+        bool nextSortedBatch();
+
+        bool nextQueuedBatch();
+
+        void setDecodeThreads(int numThreads);
+
+        void setQueueDepth(int newQueueDepth);
+
+        void setPhkeyLevel(int level);
+
+        void setSort(int sortBy, long memoryBytes, std::string scratchDir, int numThreads);
+
+        void setBlockPartition(int partIndex, int numParts);
+        void setRegion(const PmssRegion & region, bool withOverlap);
+        static bool fileInRegion(std::string fileName, int swap, const PmssRegion & region, bool withOverlap, int * fileNum);
+        void setSample(const PmssSample & sample);
+        void setDerived(const PmssDerived & derived);
+        void setFeed(PmssBatchQueue * feed);
+
+        bool seekBlock(long offset, long row);
+
+        void setJournal(PmssJournal * newJournal);
+
         int getNextRow();
+
+        long getNextRows(long maxNumRows, const void ** columns);
+
+        const PmssParticleBatch * nextRowBatch();
+
+        void bindSchema(DBDataSchema::Schema * schema);
+
+        int bindItem(DBDataSchema::DataObjDesc * thisItem);
+
+        int findColumn(DBDataSchema::DataObjDesc * thisItem);
+
+        static int getColumnOf(std::string dataObjName);
+
+        static DBDataSchema::DType getColumnDType(int column);
         
-        int assignInt(int *n, char *memblock, int bswap);
-        int assignLong(long int *n, char *memblock, int bswap);
-        int assignFloat(float *n, char *memblock, int bswap);   
-        int swapInt(int i, int swap);
-        float swapFloat(float f, int swap);
-        pmssHeader swapPmssHeader(pmssHeader header, int bswap);
+        static int swapInt(int i, int swap);
+        static float swapFloat(float f, int swap);
+        static pmssHeader swapPmssHeader(pmssHeader header, int bswap);
         
         bool getItemInRow(DBDataSchema::DataObjDesc * thisItem, bool applyAsserters, bool applyConverters, void* result);
 
         bool getDataItem(DBDataSchema::DataObjDesc * thisItem, void* result);
 
         void getConstItem(DBDataSchema::DataObjDesc * thisItem, void* result);
+
+        int getFileNum();
+        long getDataStart();
+        long getNumRowsRead();
+        long getNumRowsInside();
+        long getNumRowsOnBoundary();
+        long getNumBlocksSkipped();
+        double getReadTime();
+        double getDecodeTime();
+        double getReaderWait();
+        double getIngestWait();
     };
     
 }
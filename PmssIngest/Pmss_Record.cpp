@@ -0,0 +1,286 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+
+#include <stdio.h>
+#include <string.h>
+#include "Pmss_Record.h"
+
+using namespace std;
+
+namespace Pmss {
+
+    // payload sizes of the four header records and where they go in pmssHeader
+    static const long headerRecordSize[4] = {6*sizeof(float), 4*sizeof(int) + sizeof(float) + sizeof(int), 6*sizeof(float), sizeof(int)};
+
+    static long readSwapped(const char * data, int size, int bswap) {
+        char bytes[8] = {0};
+        int i;
+
+        for (i = 0; i < size; i++) 
+            bytes[i] = bswap ? data[size-1-i] : data[i];
+
+        if (size == 8) {
+            long value;
+            memcpy(&value, bytes, sizeof(value));
+            return value;
+        } else {
+            int value;
+            memcpy(&value, bytes, sizeof(value));
+            return value;
+        }
+    }
+
+    static void formatError(string * error, const char * format, long a, long b = 0) {
+        char message[256];
+
+        snprintf(message, sizeof(message), format, a, b);
+        *error = message;
+    }
+
+    /* Is the first marker of the header as expected (with 4 or 8 bytes) in this byte order? */
+    bool PmssRecordFormat::detectFirstMarker(const char * first, int swap) {
+        return readSwapped(first, 8, swap) == headerRecordSize[0] || readSwapped(first, 4, swap) == headerRecordSize[0];
+    }
+
+    PmssRecordFormat::PmssRecordFormat(int newSwap, int newMarkerSize) {
+        bswap = newSwap;
+        markerSize = (newMarkerSize == 8) ? 8 : 4;
+    }
+
+    int PmssRecordFormat::getSwap() const {
+        return bswap;
+    }
+
+    int PmssRecordFormat::getMarkerSize() const {
+        return markerSize;
+    }
+
+    long PmssRecordFormat::getMarker(const char * data) const {
+        return readSwapped(data, markerSize, bswap);
+    }
+
+    long PmssRecordFormat::getHeaderSize() const {
+        return headerRecordSize[0] + headerRecordSize[1] + headerRecordSize[2] + headerRecordSize[3] + 8 * markerSize;
+    }
+
+    bool PmssRecordFormat::readHeader(PmssFileSource * source, pmssHeader & header, string * error) {
+        char first[8];
+        char * fields;
+        const char * data;
+        vector<char> buffer;
+        long lead, length, offset;
+        int marker, i;
+
+        *error = "";
+        data = source->next(sizeof(first));
+        if (data == NULL) {
+            *error = "File is too short for the header.";
+            return false;
+        }
+        memcpy(first, data, sizeof(first));
+
+        // the first marker must be the length of the first record: an 8-byte 
+        // marker, else the 4-byte marker (and the start of aexpn); in native 
+        // or swapped byte order, unless the byte order is given
+        if (bswap == swapAuto) {
+            bswap = 0;
+            if (!detectFirstMarker(first, 0) && detectFirstMarker(first, 1)) {
+                bswap = 1;
+            }
+        } else if (!detectFirstMarker(first, bswap) && detectFirstMarker(first, bswap ? 0 : 1)) {
+            formatError(error, "Record markers of the header are byte swapped, read with swap=%ld.", bswap ? 0 : 1);
+            return false;
+        }
+        markerSize = (readSwapped(first, 8, bswap) == headerRecordSize[0]) ? 8 : 4;
+
+        if (markerSize == 4) {
+            data = source->next(sizeof(pmssHeader) - sizeof(first));
+            if (data == NULL) {
+                *error = "File is too short for the header.";
+                return false;
+            }
+            memcpy(&header, first, sizeof(first));
+            memcpy((char *) &header + sizeof(first), data, sizeof(pmssHeader) - sizeof(first));
+            return true;
+        }
+
+        // copy the fields of each record to where they are with 4-byte markers, 
+        // with the record lengths as markers
+        fields = (char *) &header;
+        offset = 0;
+        lead = readSwapped(first, 8, bswap);
+        for (i = 0; i < 4; i++) {
+            if (i > 0) {
+                if ((data = source->next(markerSize)) == NULL) {
+                    *error = "File is too short for the header.";
+                    return false;
+                }
+                lead = getMarker(data);
+            }
+            if ((data = readPayload(source, lead, buffer, &length, error)) == NULL) {
+                if (error->length() == 0) 
+                    *error = "File is too short for the header.";
+                return false;
+            }
+            if (length < headerRecordSize[i]) {
+                formatError(error, "Header record %ld is too short (%ld bytes).", i + 1, length);
+                return false;
+            }
+
+            marker = (int) length;
+            if (bswap) 
+                marker = (int) readSwapped((const char *) &marker, sizeof(int), 1);
+            memcpy(fields + offset, &marker, sizeof(int));
+            memcpy(fields + offset + sizeof(int), data, headerRecordSize[i]);
+            memcpy(fields + offset + sizeof(int) + headerRecordSize[i], &marker, sizeof(int));
+            offset += 2*sizeof(int) + headerRecordSize[i];
+        }
+
+        return true;
+    }
+
+    /* The rest of a record whose leading marker lead was read already */
+    const char * PmssRecordFormat::readPayload(PmssFileSource * source, long lead, vector<char> & buffer, long * length, 
+                                               string * error) const {
+        const char * data;
+        long len, trail, expected;
+        bool first, more;
+
+        if (lead >= 0) {
+            data = source->next(lead + markerSize);
+            if (data == NULL) {
+                *error = "Record is incomplete, file seems to be truncated.";
+                return NULL;
+            }
+            trail = getMarker(data + lead);
+            if (trail != lead) {
+                formatError(error, "Trailing record marker (%ld) does not agree with leading one (%ld).", trail, lead);
+                return NULL;
+            }
+            *length = lead;
+            return data;
+        }
+
+        if (markerSize != 4) {
+            formatError(error, "Negative record marker (%ld).", lead);
+            return NULL;
+        }
+
+        // subrecords, joined in buffer
+        buffer.clear();
+        first = true;
+        more = true;
+        while (more) {
+            more = (lead < 0);
+            len = more ? -lead : lead;
+
+            data = source->next(len + markerSize);
+            if (data == NULL) {
+                *error = "Subrecord is incomplete, file seems to be truncated.";
+                return NULL;
+            }
+            trail = getMarker(data + len);
+            expected = first ? len : -len;
+            if (trail != expected) {
+                formatError(error, "Trailing subrecord marker (%ld) does not agree with leading one (%ld).", trail, 
+                            more ? -len : len);
+                return NULL;
+            }
+            buffer.insert(buffer.end(), data, data + len);
+            first = false;
+
+            if (more) {
+                data = source->next(markerSize);
+                if (data == NULL) {
+                    *error = "Subrecord is incomplete, file seems to be truncated.";
+                    return NULL;
+                }
+                lead = getMarker(data);
+            }
+        }
+
+        *length = (long) buffer.size();
+        return buffer.size() > 0 ? &buffer[0] : "";
+    }
+
+    const char * PmssRecordFormat::readRecord(PmssFileSource * source, vector<char> & buffer, long * length, string * error) const {
+        const char * data;
+
+        *error = "";
+        data = source->next(markerSize);
+        if (data == NULL) {
+            return NULL;
+        }
+
+        return readPayload(source, getMarker(data), buffer, length, error);
+    }
+
+    bool PmssRecordFormat::readCount(PmssFileSource * source, vector<char> & buffer, long * count, string * error) const {
+        const char * data;
+        long length;
+
+        data = readRecord(source, buffer, &length, error);
+        if (data == NULL) {
+            return false;
+        }
+        if (length != 4 && length != 8) {
+            formatError(error, "Record has %ld bytes instead of one integer (4 or 8).", length);
+            return false;
+        }
+
+        *count = readSwapped(data, (int) length, bswap);
+        return true;
+    }
+
+    bool PmssRecordFormat::skipRecord(PmssFileSource * source, long * pos, long * length, string * error) const {
+        char marker[8];
+        long lead;
+        bool more;
+
+        *error = "";
+        *length = 0;
+        do {
+            if (source->size() >= 0 && *pos + markerSize > source->size()) {
+                *error = "Record is incomplete, file seems to be truncated.";
+                return false;
+            }
+            if (!source->seek(*pos) || !source->read(marker, markerSize)) {
+                formatError(error, "Could not read record marker at offset %ld.", *pos);
+                return false;
+            }
+            lead = getMarker(marker);
+            more = (lead < 0);
+            if (more && markerSize != 4) {
+                formatError(error, "Negative record marker (%ld) at offset %ld.", lead, *pos);
+                return false;
+            }
+            if (more) 
+                lead = -lead;
+
+            *length += lead;
+            *pos += markerSize + lead + markerSize;
+        } while (more);
+
+        return true;
+    }
+
+}
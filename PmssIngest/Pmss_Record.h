@@ -0,0 +1,85 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+
+#include <string>
+#include <vector>
+#include "Pmss_Header.h"
+#include "Pmss_FileSource.h"
+
+#ifndef Pmss_Pmss_Record_h
+#define Pmss_Pmss_Record_h
+
+namespace Pmss {
+
+    // Framing of the Fortran records (unformatted, sequential) of a PMss file:
+    // each record has a leading and a trailing length marker of 4 bytes (the 
+    // default) or 8 bytes (gfortran -frecord-marker=8, some other compilers).
+    // With 4-byte markers, gfortran splits records over 2 GB into subrecords:
+    // a negative leading marker means that more subrecords follow, a negative
+    // trailing marker that the subrecord continues a previous one.
+    class PmssRecordFormat {
+    private:
+        int bswap;
+        int markerSize;
+
+        static bool detectFirstMarker(const char * first, int swap);
+
+        const char * readPayload(PmssFileSource * source, long lead, std::vector<char> & buffer, long * length, 
+                                 std::string * error) const;
+
+    public:
+        // byte order is detected by readHeader
+        static const int swapAuto = -1;
+
+        PmssRecordFormat(int bswap = 0, int markerSize = 4);
+
+        int getSwap() const;
+        int getMarkerSize() const;
+
+        long getMarker(const char * data) const;
+
+        // bytes of the four header records, i.e. where the data blocks start
+        long getHeaderSize() const;
+
+        // read the header records at the start of the file, the marker size 
+        // (and the byte order with swapAuto) is detected from the first marker, 
+        // which is 24; fails if a given byte order contradicts it. header is 
+        // filled as with 4-byte markers and not byteswapped (see PmssReader::swapPmssHeader)
+        bool readHeader(PmssFileSource * source, pmssHeader & header, std::string * error);
+
+        // read the record at the current position and return a pointer to its
+        // payload of length bytes, valid until the next read; subrecords are 
+        // joined in buffer. NULL at the end of the file (error empty) or if the 
+        // record is broken (reason in error).
+        const char * readRecord(PmssFileSource * source, std::vector<char> & buffer, long * length, std::string * error) const;
+
+        // read a record holding one integer (4 or 8 bytes), e.g. nrecord
+        bool readCount(PmssFileSource * source, std::vector<char> & buffer, long * count, std::string * error) const;
+
+        // jump over the record starting at byte offset pos by reading its 
+        // (sub)record markers only; pos is moved behind it
+        bool skipRecord(PmssFileSource * source, long * pos, long * length, std::string * error) const;
+    };
+
+}
+
+#endif
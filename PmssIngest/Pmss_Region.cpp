@@ -0,0 +1,153 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "Pmss_Region.h"
+
+using namespace std;
+
+namespace Pmss {
+
+    PmssRegion::PmssRegion() {
+        int i;
+
+        type = REGION_NONE;
+        for (i = 0; i < 6; i++) 
+            values[i] = 0;
+    }
+
+    bool PmssRegion::parse(string text) {
+        size_t colon;
+        string kind;
+        const char * pos;
+        char * end;
+        int numValues, i;
+
+        type = REGION_NONE;
+        if (text.length() == 0) {
+            return true;
+        }
+
+        colon = text.find(':');
+        if (colon == string::npos) {
+            return false;
+        }
+        kind = text.substr(0, colon);
+        if (kind.compare("box") == 0) {
+            numValues = 6;
+        } else if (kind.compare("sphere") == 0) {
+            numValues = 4;
+        } else {
+            return false;
+        }
+
+        // comma separated numbers, nothing else
+        pos = text.c_str() + colon + 1;
+        for (i = 0; i < numValues; i++) {
+            values[i] = strtod(pos, &end);
+            if (end == pos || (*end != ((i < numValues-1) ? ',' : '\0'))) {
+                return false;
+            }
+            pos = end + 1;
+        }
+
+        if (numValues == 6) {
+            if (!(values[0] < values[1] && values[2] < values[3] && values[4] < values[5])) {
+                return false;
+            }
+            type = REGION_BOX;
+        } else {
+            if (!(values[3] > 0)) {
+                return false;
+            }
+            type = REGION_SPHERE;
+        }
+
+        return true;
+    }
+
+    bool PmssRegion::isSet() const {
+        return type != REGION_NONE;
+    }
+
+    bool PmssRegion::contains(float x, float y, float z) const {
+        double dx, dy, dz;
+
+        if (type == REGION_BOX) {
+            return (x >= values[0] && x < values[1] 
+                 && y >= values[2] && y < values[3]
+                 && z >= values[4] && z < values[5]);
+        }
+        if (type == REGION_SPHERE) {
+            dx = x - values[0];
+            dy = y - values[1];
+            dz = z - values[2];
+            return (dx*dx + dy*dy + dz*dz <= values[3]*values[3]);
+        }
+
+        return true;
+    }
+
+    bool PmssRegion::intersects(const float * bounds) const {
+        double d, dist2;
+        int i;
+
+        if (type == REGION_BOX) {
+            return (bounds[0] < values[1] && bounds[1] >= values[0]
+                 && bounds[2] < values[3] && bounds[3] >= values[2]
+                 && bounds[4] < values[5] && bounds[5] >= values[4]);
+        }
+        if (type == REGION_SPHERE) {
+            // distance from the centre to the nearest point of the box
+            dist2 = 0;
+            for (i = 0; i < 3; i++) {
+                d = 0;
+                if (values[i] < bounds[2*i]) 
+                    d = bounds[2*i] - values[i];
+                else if (values[i] > bounds[2*i+1]) 
+                    d = values[i] - bounds[2*i+1];
+                dist2 += d*d;
+            }
+            return (dist2 <= values[3]*values[3]);
+        }
+
+        return true;
+    }
+
+    string PmssRegion::describe() const {
+        char text[256];
+
+        if (type == REGION_BOX) {
+            snprintf(text, sizeof(text), "box x: %g - %g, y: %g - %g, z: %g - %g", 
+                values[0], values[1], values[2], values[3], values[4], values[5]);
+        } else if (type == REGION_SPHERE) {
+            snprintf(text, sizeof(text), "sphere around %g, %g, %g with radius %g", 
+                values[0], values[1], values[2], values[3]);
+        } else {
+            snprintf(text, sizeof(text), "everything");
+        }
+
+        return text;
+    }
+
+}
@@ -0,0 +1,61 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+
+#include <string>
+
+#ifndef Pmss_Pmss_Region_h
+#define Pmss_Pmss_Region_h
+
+namespace Pmss {
+
+    // Part of the simulation box to be ingested: an axis-aligned box or a
+    // sphere, in the same units as the particle positions (no periodic 
+    // wrapping). Given on the command line as 
+    //   box:xMin,xMax,yMin,yMax,zMin,zMax   or   sphere:x,y,z,radius
+    class PmssRegion {
+    private:
+        int type;
+        double values[6];   // box: xMin, xMax, yMin, yMax, zMin, zMax; sphere: x, y, z, radius
+
+    public:
+        enum { REGION_NONE = 0, REGION_BOX, REGION_SPHERE };
+
+        PmssRegion();
+
+        // parse the command line form; false if it is not valid
+        bool parse(std::string text);
+
+        bool isSet() const;
+
+        // particle at x, y, z is inside (box: upper faces excluded)
+        bool contains(float x, float y, float z) const;
+
+        // the region and the box bounds (xMin, xMax, yMin, yMax, zMin, zMax)
+        // have points in common; used to skip files and data blocks
+        bool intersects(const float * bounds) const;
+
+        std::string describe() const;
+    };
+
+}
+
+#endif
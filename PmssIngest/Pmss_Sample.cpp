@@ -0,0 +1,126 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+
+#include <stdlib.h>
+#include "Pmss_Sample.h"
+
+using namespace std;
+
+namespace Pmss {
+
+    PmssSample::PmssSample() {
+        fraction = 1.0;
+        threshold = 0;
+    }
+
+    bool PmssSample::setFraction(double newFraction) {
+        const double range = 18446744073709551616.0;   // 2^64
+
+        if (!(newFraction > 0 && newFraction <= 1)) {
+            return false;
+        }
+
+        fraction = newFraction;
+        if (fraction * range >= range) {
+            threshold = ~0UL;
+        } else {
+            threshold = (unsigned long) (fraction * range);
+        }
+
+        return true;
+    }
+
+    double PmssSample::getFraction() const {
+        return fraction;
+    }
+
+    bool PmssSample::isSet() const {
+        return fraction < 1.0;
+    }
+
+    bool PmssSample::contains(long id) const {
+        return fraction >= 1.0 || hashId(id) < threshold;
+    }
+
+    /* The id-th output of splitmix64 (seed 0): consecutive ids give uniformly 
+     * spread hashes, so any sample rate takes the same fraction of every id range */
+    unsigned long PmssSample::hashId(long id) {
+        unsigned long h = (unsigned long) id * 0x9e3779b97f4a7c15UL;
+
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9UL;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebUL;
+        return h ^ (h >> 31);
+    }
+
+    bool parseSampleTables(string text, vector<pmssSampleTable> & tables) {
+        pmssSampleTable entry;
+        PmssSample check;
+        const char * pos;
+        char * end;
+        const char * next;
+
+        tables.clear();
+        pos = text.c_str();
+        while (*pos != '\0') {
+            entry.fraction = strtod(pos, &end);
+            if (end == pos || !check.setFraction(entry.fraction)) {
+                return false;
+            }
+
+            entry.table = "";
+            pos = end;
+            if (*pos == ':') {
+                pos++;
+                next = pos;
+                while (*next != ',' && *next != '\0') 
+                    next++;
+                entry.table = string(pos, next - pos);
+                if (entry.table.length() == 0) {
+                    return false;
+                }
+                pos = next;
+            }
+            tables.push_back(entry);
+
+            if (*pos == ',') {
+                pos++;
+                if (*pos == '\0') {
+                    return false;
+                }
+            } else if (*pos != '\0') {
+                return false;
+            }
+        }
+
+        // one table may use -T, several need their own names
+        if (tables.size() > 1) {
+            for (size_t i = 0; i < tables.size(); i++) {
+                if (tables[i].table.length() == 0) {
+                    return false;
+                }
+            }
+        }
+
+        return tables.size() > 0;
+    }
+
+}
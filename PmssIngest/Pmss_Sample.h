@@ -0,0 +1,67 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+
+#include <string>
+#include <vector>
+
+#ifndef Pmss_Pmss_Sample_h
+#define Pmss_Pmss_Sample_h
+
+namespace Pmss {
+
+    // Deterministic subsample of the particles: a particle is taken if a hash
+    // of its id is below fraction * 2^64. The same particle is thus taken in 
+    // every snapshot and every file, and a smaller sample is always a subset 
+    // of a larger one.
+    class PmssSample {
+    private:
+        double fraction;
+        unsigned long threshold;    // hash(id) < threshold: particle is taken
+
+    public:
+        PmssSample();
+
+        // 0 < fraction <= 1; 1 (the default) takes all particles
+        bool setFraction(double fraction);
+
+        double getFraction() const;
+
+        bool isSet() const;
+
+        bool contains(long id) const;
+
+        static unsigned long hashId(long id);
+    };
+
+    // One sample rate and the table it goes to
+    typedef struct {
+        double fraction;
+        std::string table;      // empty: the table given with -T
+    } pmssSampleTable;
+
+    // parse the command line form "fraction" or "fraction:table,fraction:table,..."
+    // into tables; false if it is not valid
+    bool parseSampleTables(std::string text, std::vector<pmssSampleTable> & tables);
+
+}
+
+#endif
@@ -0,0 +1,123 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+
+#include "Pmss_SampleSplitter.h"
+
+using namespace std;
+
+namespace Pmss {
+
+    PmssSampleSplitter::PmssSampleSplitter(const vector<PmssSample> & newSamples, int queueDepth) {
+        samples = newSamples;
+        for (size_t i = 0; i < samples.size(); i++) {
+            queues.push_back(new PmssBatchQueue(queueDepth));
+            numRows.push_back(0);
+        }
+    }
+
+    PmssSampleSplitter::~PmssSampleSplitter() {
+        for (size_t i = 0; i < queues.size(); i++) 
+            delete queues[i];
+    }
+
+    PmssBatchQueue * PmssSampleSplitter::getQueue(size_t i) {
+        return queues[i];
+    }
+
+    long PmssSampleSplitter::getNumRows(size_t i) {
+        return numRows[i];
+    }
+
+    /* Copy the particles of the sample; the counters of rows read stay with 
+     * the batch, so that each sample reader counts the whole file */
+    void PmssSampleSplitter::select(const PmssParticleBatch & from, const PmssSample & sample, PmssParticleBatch & to) {
+        long i, m;
+        size_t k;
+
+        to.clear();
+        to.resize(from.numRows);
+        if (from.havePhkey && (long) to.phkey.size() < from.numRows) 
+            to.phkey.resize(to.x.size());
+        to.derived.resize(from.derived.size());
+        for (k = 0; k < to.derived.size(); k++) 
+            to.derived[k].resize(from.numRows);
+
+        m = 0;
+        for (i = 0; i < from.numRows; i++) {
+            if (!sample.contains(from.id[i])) {
+                continue;
+            }
+            to.x[m] = from.x[i];
+            to.y[m] = from.y[i];
+            to.z[m] = from.z[i];
+            to.vx[m] = from.vx[i];
+            to.vy[m] = from.vy[i];
+            to.vz[m] = from.vz[i];
+            to.id[m] = from.id[i];
+            to.row[m] = from.row[i];
+            to.fileRowId[m] = from.fileRowId[i];
+            if (from.havePhkey) 
+                to.phkey[m] = from.phkey[i];
+            for (k = 0; k < to.derived.size(); k++) 
+                to.derived[k][m] = from.derived[k][i];
+            m++;
+        }
+
+        to.numRows = m;
+        to.numRowsRead = from.numRowsRead;
+        to.numOnBoundary = from.numOnBoundary;
+        to.firstRow = from.firstRow;
+        to.havePhkey = from.havePhkey;
+    }
+
+    void PmssSampleSplitter::run(PmssReader * reader) {
+        const PmssParticleBatch * batch;
+        PmssParticleBatch * out;
+        vector<bool> active(queues.size(), true);
+        size_t i, numActive;
+
+        while ((batch = reader->nextRowBatch()) != NULL) {
+            numActive = 0;
+            for (i = 0; i < queues.size(); i++) {
+                if (!active[i]) {
+                    continue;
+                }
+                // NULL: this sample reader does not want any more rows
+                if ((out = queues[i]->getFree()) == NULL) {
+                    active[i] = false;
+                    continue;
+                }
+                select(*batch, samples[i], *out);
+                numRows[i] += out->numRows;
+                queues[i]->push();
+                numActive++;
+            }
+            if (numActive == 0) {
+                break;
+            }
+        }
+
+        for (i = 0; i < queues.size(); i++) 
+            queues[i]->finish();
+    }
+
+}
@@ -0,0 +1,60 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+
+#include <vector>
+#include "Pmss_Sample.h"
+#include "Pmss_BatchQueue.h"
+#include "Pmss_Reader.h"
+
+#ifndef Pmss_Pmss_SampleSplitter_h
+#define Pmss_Pmss_SampleSplitter_h
+
+namespace Pmss {
+
+    // Hands the particles of one reader on to several subsamples at once, one 
+    // queue per sample, each of them read by its own reader (PmssReader::setFeed)
+    // and ingested into its own table. The file is thus read and decoded only 
+    // once for all sample rates.
+    class PmssSampleSplitter {
+    private:
+        std::vector<PmssSample> samples;
+        std::vector<PmssBatchQueue *> queues;
+        std::vector<long> numRows;  // particles handed to each sample
+
+        void select(const PmssParticleBatch & from, const PmssSample & sample, PmssParticleBatch & to);
+
+    public:
+        PmssSampleSplitter(const std::vector<PmssSample> & samples, int queueDepth);
+        ~PmssSampleSplitter();
+
+        PmssBatchQueue * getQueue(size_t i);
+
+        // read all batches of the reader and distribute them, until the end 
+        // of the file or until all samples stopped reading
+        void run(PmssReader * reader);
+
+        long getNumRows(size_t i);
+    };
+
+}
+
+#endif
@@ -44,6 +44,10 @@ namespace Pmss {
     PmssSchemaMapper::~PmssSchemaMapper() {
         
     }
+
+    void PmssSchemaMapper::setDerivedColumns(const vector<string> & names) {
+        derivedNames = names;
+    }
     
     DBDataSchema::Schema * PmssSchemaMapper::generateSchema(string dbName, string tblName) {
         DBDataSchema::Schema * returnSchema = new Schema();
@@ -207,6 +211,26 @@ namespace Pmss {
         returnSchema->addItemToSchema(schemaItem9);
 
 
+        //derived columns, computed by the reader
+        for (size_t i = 0; i < derivedNames.size(); i++) {
+            char objName[32];
+            snprintf(objName, sizeof(objName), "Col%d", (int) (10 + i));
+
+            DataObjDesc * derivedObj = new DataObjDesc();
+            derivedObj->setDataObjName(objName);
+            derivedObj->setDataObjDType(DT_REAL4);
+            derivedObj->setIsConstItem(false, false);
+            derivedObj->setIsHeaderItem(false);
+
+            SchemaItem * derivedItem = new SchemaItem();
+            derivedItem->setColumnName(derivedNames[i]);
+            derivedItem->setColumnDBType(DBT_FLOAT);
+            derivedItem->setDataDesc(derivedObj);
+
+            returnSchema->addItemToSchema(derivedItem);
+        }
+
+
         return returnSchema;
     }
 }
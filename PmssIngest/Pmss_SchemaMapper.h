@@ -23,6 +23,7 @@
 #include <AsserterFactory.h>
 #include <ConverterFactory.h>
 #include <string>
+#include <vector>
 #include <stdio.h>
 
 #ifndef Pmss_Pmss_SchemaMapper_h
@@ -37,6 +38,9 @@ namespace Pmss {
     private:
         DBAsserter::AsserterFactory * assertFac;
         DBConverter::ConverterFactory * convFac;
+
+        // names of derived columns (see PmssDerived), added as "Col10", ...
+        std::vector<std::string> derivedNames;
         
     public:
         PmssSchemaMapper();
@@ -45,6 +49,8 @@ namespace Pmss {
 
         ~PmssSchemaMapper();
         
+        void setDerivedColumns(const std::vector<std::string> & names);
+
         DBDataSchema::Schema * generateSchema(std::string dbName, std::string tblName);
     };
     
@@ -0,0 +1,346 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <assert.h>
+#include <algorithm>
+#include "pmssingest_error.h"
+
+#include "Pmss_Sorter.h"
+
+using namespace std;
+
+namespace Pmss {
+
+    static bool recordLess(const pmssSortRecord & a, const pmssSortRecord & b) {
+        if (a.key != b.key) 
+            return a.key < b.key;
+        return a.row < b.row;
+    }
+
+    PmssSorter::PmssSorter(int newSortBy, long memoryBytes, string newScratchDir, int newNumThreads) {
+        sortBy = newSortBy;
+        scratchDir = newScratchDir;
+        numThreads = (newNumThreads > 1) ? newNumThreads : 1;
+
+        // one run being collected, numThreads being sorted/written
+        runSize = memoryBytes / (long) sizeof(pmssSortRecord) / (numThreads + 1);
+        if (runSize < 1024) 
+            runSize = 1024;
+
+        current = new vector<pmssSortRecord>();
+        posInMemory = 0;
+        inMemory = false;
+        finished = false;
+        havePhkey = false;
+        numRecords = 0;
+    }
+
+    PmssSorter::~PmssSorter() {
+        size_t i;
+
+        while (jobs.size() > 0) {
+            waitForJob();
+        }
+        for (i = 0; i < unusedBuffers.size(); i++) 
+            delete unusedBuffers[i];
+        for (i = 0; i < readers.size(); i++) 
+            delete readers[i];
+        for (i = 0; i < runFiles.size(); i++) 
+            fclose(runFiles[i]);
+        delete current;
+    }
+
+    int PmssSorter::getSortBy(string name) {
+        if (name.compare("none") == 0 || name.length() == 0) 
+            return SORT_NONE;
+        if (name.compare("phkey") == 0) 
+            return SORT_PHKEY;
+        if (name.compare("id") == 0) 
+            return SORT_ID;
+        return -1;
+    }
+
+    void PmssSorter::add(const PmssParticleBatch & batch) {
+        pmssSortRecord record;
+        long i;
+
+        assert(!finished);
+
+        if (batch.havePhkey) 
+            havePhkey = true;
+        if (sortBy == SORT_PHKEY && !batch.havePhkey && batch.numRows > 0) {
+            PmssIngest_error("PmssSorter: Cannot sort by phkey, it is not computed (set phkeyLevel).\n");
+        }
+
+        for (i = 0; i < batch.numRows; i++) {
+            record.id = batch.id[i];
+            record.row = batch.row[i];
+            record.fileRowId = batch.fileRowId[i];
+            record.x = batch.x[i];
+            record.y = batch.y[i];
+            record.z = batch.z[i];
+            record.vx = batch.vx[i];
+            record.vy = batch.vy[i];
+            record.vz = batch.vz[i];
+            record.phkey = batch.havePhkey ? batch.phkey[i] : 0;
+            record.key = (sortBy == SORT_PHKEY) ? record.phkey : record.id;
+
+            current->push_back(record);
+            if ((long) current->size() >= runSize) {
+                spillRun();
+            }
+        }
+        numRecords += batch.numRows;
+    }
+
+    /* Give the collected run to a thread for sorting and writing,
+     * continue with a free buffer */
+    void PmssSorter::spillRun() {
+        runJob job;
+
+        if ((int) jobs.size() >= numThreads) {
+            waitForJob();
+        }
+
+        job.records = current;
+        job.thread = new boost::thread(boost::bind(&PmssSorter::writeRun, this, current));
+        jobs.push_back(job);
+
+        if (unusedBuffers.size() > 0) {
+            current = unusedBuffers.back();
+            unusedBuffers.pop_back();
+        } else {
+            current = new vector<pmssSortRecord>();
+            current->reserve(runSize);
+        }
+    }
+
+    void PmssSorter::waitForJob() {
+        runJob job = jobs.front();
+        jobs.pop_front();
+
+        job.thread->join();
+        delete job.thread;
+
+        job.records->clear();
+        unusedBuffers.push_back(job.records);
+    }
+
+    /* Work of one thread: sort a run and write it to an (already unlinked) scratch file;
+     * an error is kept for the thread calling finish() */
+    void PmssSorter::writeRun(vector<pmssSortRecord> * records) {
+        string fileName;
+        FILE * fp;
+        int fd;
+
+        sort(records->begin(), records->end(), recordLess);
+
+        fileName = scratchDir + "/PmssSort.XXXXXX";
+        vector<char> name(fileName.begin(), fileName.end());
+        name.push_back('\0');
+
+        fd = mkstemp(&name[0]);
+        if (fd < 0) {
+            boost::mutex::scoped_lock lock(runFilesMutex);
+            if (error.length() == 0) 
+                error = "Could not create scratch file in " + scratchDir + ".";
+            return;
+        }
+        // removed as soon as it is closed
+        unlink(&name[0]);
+
+        fp = fdopen(fd, "w+b");
+        if (fp == NULL || fwrite(&(*records)[0], sizeof(pmssSortRecord), records->size(), fp) != records->size() 
+            || fflush(fp) != 0) {
+            if (fp != NULL) {
+                fclose(fp);
+            } else {
+                close(fd);
+            }
+            boost::mutex::scoped_lock lock(runFilesMutex);
+            if (error.length() == 0) 
+                error = "Could not write run to " + scratchDir + ".";
+            return;
+        }
+
+        boost::mutex::scoped_lock lock(runFilesMutex);
+        runFiles.push_back(fp);
+    }
+
+    bool PmssSorter::finish() {
+        size_t i;
+
+        finished = true;
+
+        // everything fits into memory: no need to write anything
+        if (jobs.size() == 0 && runFiles.size() == 0 && error.length() == 0) {
+            sort(current->begin(), current->end(), recordLess);
+            inMemory = true;
+            posInMemory = 0;
+            printf("Sorted %ld particles in memory.\n", numRecords);
+            return true;
+        }
+
+        if (current->size() > 0) {
+            spillRun();
+        }
+        while (jobs.size() > 0) {
+            waitForJob();
+        }
+        for (i = 0; i < unusedBuffers.size(); i++) 
+            delete unusedBuffers[i];
+        unusedBuffers.clear();
+
+        // all writing threads have ended
+        if (error.length() > 0) {
+            return false;
+        }
+
+        // read back all runs with small buffers and merge them with a heap
+        for (i = 0; i < runFiles.size(); i++) {
+            runReader * reader = new runReader;
+            reader->fp = runFiles[i];
+            reader->buffer.resize(4096);
+            reader->pos = 0;
+            reader->count = 0;
+            rewind(reader->fp);
+            readers.push_back(reader);
+            if (fillReader(reader)) {
+                heap.push_back(i);
+            }
+        }
+        for (long j = (long) heap.size() / 2 - 1; j >= 0; j--) {
+            siftDown(j);
+        }
+
+        if (error.length() > 0) {
+            return false;
+        }
+
+        printf("Sorted %ld particles in %ld runs, merging them.\n", numRecords, (long) runFiles.size());
+        return true;
+    }
+
+    /* Next chunk of a run; false at its end or on a read error (error is set) */
+    bool PmssSorter::fillReader(runReader * reader) {
+        reader->count = fread(&reader->buffer[0], sizeof(pmssSortRecord), reader->buffer.size(), reader->fp);
+        reader->pos = 0;
+        if (ferror(reader->fp)) {
+            error = "Could not read back a run from " + scratchDir + ".";
+            reader->count = 0;
+            return false;
+        }
+        return reader->count > 0;
+    }
+
+    bool PmssSorter::lessAt(int a, int b) {
+        return recordLess(readers[heap[a]]->buffer[readers[heap[a]]->pos], readers[heap[b]]->buffer[readers[heap[b]]->pos]);
+    }
+
+    void PmssSorter::siftDown(long i) {
+        long n = heap.size();
+        long smallest;
+
+        while (true) {
+            smallest = i;
+            if (2*i + 1 < n && lessAt(2*i + 1, smallest)) 
+                smallest = 2*i + 1;
+            if (2*i + 2 < n && lessAt(2*i + 2, smallest)) 
+                smallest = 2*i + 2;
+            if (smallest == i) 
+                break;
+            swap(heap[i], heap[smallest]);
+            i = smallest;
+        }
+    }
+
+    bool PmssSorter::nextBatch(PmssParticleBatch & batch, long maxRows) {
+        const pmssSortRecord * record;
+        runReader * reader = NULL;
+        long n;
+
+        if (error.length() > 0) {
+            return false;
+        }
+
+        batch.clear();
+        batch.resize(maxRows + 8);
+        batch.havePhkey = havePhkey;
+        if (havePhkey && (long) batch.phkey.size() < maxRows) {
+            batch.phkey.resize(batch.x.size());
+        }
+
+        n = 0;
+        while (n < maxRows) {
+            if (inMemory) {
+                if (posInMemory >= (long) current->size()) 
+                    break;
+                record = &(*current)[posInMemory++];
+            } else {
+                if (heap.size() == 0) 
+                    break;
+                reader = readers[heap[0]];
+                record = &reader->buffer[reader->pos];
+            }
+
+            batch.x[n] = record->x;
+            batch.y[n] = record->y;
+            batch.z[n] = record->z;
+            batch.vx[n] = record->vx;
+            batch.vy[n] = record->vy;
+            batch.vz[n] = record->vz;
+            batch.id[n] = record->id;
+            batch.row[n] = record->row;
+            batch.fileRowId[n] = record->fileRowId;
+            if (havePhkey) 
+                batch.phkey[n] = record->phkey;
+            n++;
+
+            if (!inMemory) {
+                reader->pos++;
+                if (reader->pos >= reader->count && !fillReader(reader)) {
+                    heap[0] = heap.back();
+                    heap.pop_back();
+                }
+                if (heap.size() > 0) 
+                    siftDown(0);
+            }
+        }
+
+        batch.numRows = n;
+        if (error.length() > 0) {
+            return false;
+        }
+        return n > 0;
+    }
+
+    string PmssSorter::getError() {
+        boost::mutex::scoped_lock lock(runFilesMutex);
+        return error;
+    }
+
+    long PmssSorter::getNumRuns() {
+        return inMemory ? 1 : (long) runFiles.size();
+    }
+
+}
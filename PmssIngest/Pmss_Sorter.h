@@ -0,0 +1,123 @@
+/*  
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      Adrian M. Partl <apartl@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <stdio.h>
+#include <boost/thread.hpp>
+#include "Pmss_BlockDecoder.h"
+
+#ifndef Pmss_Pmss_Sorter_h
+#define Pmss_Pmss_Sorter_h
+
+namespace Pmss {
+
+    // one particle while sorting
+    typedef struct {
+        long key;       // phkey or id
+        long id;
+        long row;       // row in file, decides if keys are equal
+        long fileRowId;
+        float x, y, z;
+        float vx, vy, vz;
+        int phkey;
+    } pmssSortRecord;
+
+
+    // External merge sort of the particles of one file by phkey or id.
+    // Particles are collected into runs of bounded size; full runs are 
+    // sorted and written to scratch files by separate threads while the 
+    // next run is collected. At the end the runs are merged and handed out 
+    // batch by batch. If everything fits into one run, nothing is written.
+    class PmssSorter {
+    private:
+        // a run that is sorted and written by a thread
+        typedef struct {
+            boost::thread * thread;
+            std::vector<pmssSortRecord> * records;
+        } runJob;
+
+        // a sorted run on disk, read back in chunks while merging
+        typedef struct {
+            FILE * fp;
+            std::vector<pmssSortRecord> buffer;
+            long pos;
+            long count;
+        } runReader;
+
+        int sortBy;
+        std::string scratchDir;
+        int numThreads;
+        long runSize;       // max. number of particles per run
+
+        std::vector<pmssSortRecord> * current;
+        std::vector<std::vector<pmssSortRecord> *> unusedBuffers;
+        std::deque<runJob> jobs;
+        std::vector<FILE *> runFiles;
+        std::string error;          // why a run could not be written or read back
+        boost::mutex runFilesMutex; // also for error
+
+        // merging
+        std::vector<runReader *> readers;
+        std::vector<int> heap;      // indices of readers, smallest record first
+        long posInMemory;           // if there is only one run, kept in memory
+        bool inMemory;
+        bool finished;
+        bool havePhkey;
+        long numRecords;
+
+        void spillRun();
+        void writeRun(std::vector<pmssSortRecord> * records);
+        void waitForJob();
+        bool fillReader(runReader * reader);
+        bool lessAt(int a, int b);
+        void siftDown(long i);
+
+    public:
+        enum { SORT_NONE = 0, SORT_PHKEY = 1, SORT_ID = 2 };
+
+        // memoryBytes is shared by all runs in memory (collected and being written)
+        PmssSorter(int sortBy, long memoryBytes, std::string scratchDir, int numThreads);
+        ~PmssSorter();
+
+        // none, phkey or id; -1 if unknown
+        static int getSortBy(std::string name);
+
+        // copy the particles of a batch
+        void add(const PmssParticleBatch & batch);
+
+        // no more particles, prepare merging; false if a run could not be written
+        bool finish();
+
+        // next (at most maxRows) sorted particles, false at the end or if 
+        // a run could not be read (then getError() is not empty)
+        bool nextBatch(PmssParticleBatch & batch, long maxRows);
+
+        // reason of the first error while writing or merging the runs
+        std::string getError();
+
+        long getNumRuns();
+    };
+
+}
+
+#endif
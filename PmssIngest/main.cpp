@@ -21,23 +21,696 @@
 // Main for PMss binary ingestor, for particles of cosmological simulations.
 
 #include <iostream>
+#include <vector>
+#include <sstream>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
 #include "Pmss_Reader.h"
 #include "Pmss_SchemaMapper.h"
+#include "Pmss_FileQueue.h"
+#include "Pmss_BulkWriter.h"
+#include "Pmss_Metrics.h"
+#include "Pmss_Log.h"
+#include "Pmss_Journal.h"
+#include "Pmss_Catalog.h"
+#include "Pmss_SampleSplitter.h"
 #include "pmssingest_error.h"
 #include <Schema.h>
 #include <DBIngestor.h>
 #include <DBAdaptorsFactory.h>
 #include <AsserterFactory.h>
 #include <ConverterFactory.h>
+#ifdef DB_SQLITE3
+#include <sqlite3.h>
+#endif
+#ifdef DB_MYSQL
+#include <mysql.h>
+#endif
 #include <boost/program_options.hpp>
+#include <boost/thread.hpp>
 
 using namespace Pmss;
 using namespace std;
 namespace po = boost::program_options;
 
+// settings given on the command line, shared by all ingest workers
+typedef struct {
+    string system;
+    string dbase;
+    string table;
+    string socket;
+    string user;
+    string pwd;
+    string port;
+    string host;
+    string path;
+    uint32_t bufferSize;
+    uint32_t outputFreq;
+    bool resumeMode;
+
+    int swap;
+    int snapnum;
+    double idfactor;
+    int nrecord;
+    long startRow;
+    long maxRows;
+    bool useMmap;
+    int decodeThreads;
+    int queueDepth;
+    int numParts;
+    int phkeyLevel;
+
+    // only particles in this part of the box
+    PmssRegion region;
+    bool withOverlap;
+
+    // extra columns computed from the particle fields and header constants
+    PmssDerived derived;
+
+    // only a deterministic subsample of the particles, into one or more tables
+    vector<pmssSampleTable> sampleTables;
+
+    // sort the particles of each file before ingesting them
+    int sortBy;
+    long sortMemory;
+    string sortDir;
+    int sortThreads;
+
+    // write files for bulk loading instead of sending rows to the database
+    string exportFormat;
+    string exportPath;
+    long exportMaxSize;
+
+    // checkpoints for resuming after a failure
+    string journalDir;
+    bool resume;
+    bool resumeCleanup;
+} ingestSettings;
+
+// what happened to one data file
+typedef struct {
+    string fileName;
+    int part;
+    int fileNum;
+    int worker;
+    long rowsRead;
+    long rowsIngested;
+    long rowsOnBoundary;    // duplicates skipped, ingested from the neighbouring file (-1 with a region or sample)
+    double seconds;
+    double readerWait;  // reading thread(s) waited for the database
+    double ingestWait;  // database side waited for reading/decoding
+    bool done;
+} ingestSummary;
+
+
+static double wallTime() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + 1.e-6 * tv.tv_usec;
+}
+
+void setupConnection(DBIngest::DBIngestor * pmssIngestor, ingestSettings & settings) {
+    string & system = settings.system;
+
+    pmssIngestor->setUsrName(settings.user);
+    pmssIngestor->setPasswd(settings.pwd);
+    
+    //settings for different DBs (copy&paste from AsciiIngest)
+    if(system.compare("mysql") == 0) {
+        pmssIngestor->setSocket(settings.socket);
+        pmssIngestor->setPort(settings.port);
+        pmssIngestor->setHost(settings.host);
+    } else if (system.compare("sqlite3") == 0) {
+        pmssIngestor->setHost(settings.path);
+    } else if (system.compare("unix_sqlsrv_odbc") == 0) {
+        pmssIngestor->setSocket("DRIVER=FreeTDS;TDS_Version=7.0;");
+        //asciiIngestor->setSocket("DRIVER=SQL Server Native Client 10.0;");
+        pmssIngestor->setPort(settings.port);
+        pmssIngestor->setHost(settings.host);
+    } else if (system.compare("sqlsrv_odbc") == 0) {
+        pmssIngestor->setSocket("DRIVER=SQL Server Native Client 10.0;");
+        pmssIngestor->setPort(settings.port);
+        pmssIngestor->setHost(settings.host);
+    } else if (system.compare("sqlsrv_odbc_bulk") == 0) {
+        //TESTS ON SQL SERVER SHOWED THIS IS VERY SLOW. BUT NO CLUE WHY, DID NOT BOTHER TO LOOK AT PROFILER YET
+        pmssIngestor->setSocket("DRIVER=SQL Server Native Client 10.0;");
+        pmssIngestor->setPort(settings.port);
+        pmssIngestor->setHost(settings.host);
+    }  else if (system.compare("cust_odbc") == 0) {
+        pmssIngestor->setSocket(settings.socket);
+        pmssIngestor->setPort(settings.port);
+        pmssIngestor->setHost(settings.host);
+    } else if (system.compare("cust_odbc_bulk") == 0) {
+        //TESTS ON SQL SERVER SHOWED THIS IS VERY SLOW. BUT NO CLUE WHY, DID NOT BOTHER TO LOOK AT PROFILER YET
+        pmssIngestor->setSocket(settings.socket);
+        pmssIngestor->setPort(settings.port);
+        pmssIngestor->setHost(settings.host);
+    }  
+    
+    // setup resume option, if desired
+    pmssIngestor->setResumeMode(settings.resumeMode); 
+}
+
+/* Write the particles of one data file into bulk load files, 
+ * named after the data file (and part) in the export directory */
+void exportFile(string dataFile, int part, ingestSettings & settings, DBDataSchema::Schema * thisSchema, PmssReader * thisReader) {
+    PmssBulkWriter * writer;
+    vector<string> fileNames;
+    string basePath;
+    size_t pos;
+    char partStr[16];
+    long numRows;
+
+    pos = dataFile.find_last_of('/');
+    basePath = settings.exportPath + "/" + ((pos == string::npos) ? dataFile : dataFile.substr(pos + 1));
+    if (settings.numParts > 1) {
+        snprintf(partStr, sizeof(partStr), "_p%d", part);
+        basePath += partStr;
+    }
+
+    writer = PmssBulkWriter::create(settings.exportFormat, basePath, settings.exportMaxSize);
+    numRows = writer->writeAll(thisReader, thisSchema);
+    if (numRows < 0) {
+        PmssIngest_error("Writing bulk load files failed.\n");
+    }
+
+    fileNames = writer->getFileNames();
+    printf("Wrote %ld rows into %ld file(s), load them e.g. with:\n", numRows, (long) fileNames.size());
+    for (size_t i = 0; i < fileNames.size(); i++) {
+        printf("   %s\n", writer->getLoadHint(fileNames[i]).c_str());
+    }
+
+    delete writer;
+}
+
+#ifdef DB_SQLITE3
+static int sqliteFirstValue(void * result, int numColumns, char ** values, char ** names) {
+    if (numColumns > 0 && values[0] != NULL) {
+        *((long *) result) = atol(values[0]);
+    }
+    return 0;
+}
+#endif
+
+/* Run one statement on the database over a separate connection (not through 
+ * DBIngestor): returns the first value of a query or the number of changed 
+ * rows; -1 on errors, -2 if not possible for this database system. */
+long executeStatement(ingestSettings & settings, string statement, bool isQuery) {
+#ifdef DB_SQLITE3
+    if (settings.system.compare("sqlite3") == 0) {
+        sqlite3 * db;
+        char * errorMsg = NULL;
+        long result = -1;
+
+        if (sqlite3_open(settings.path.c_str(), &db) != SQLITE_OK) {
+            printf("Could not open %s: %s\n", settings.path.c_str(), sqlite3_errmsg(db));
+            sqlite3_close(db);
+            return -1;
+        }
+        if (sqlite3_exec(db, statement.c_str(), isQuery ? sqliteFirstValue : NULL, &result, &errorMsg) != SQLITE_OK) {
+            printf("%s: %s\n", statement.c_str(), errorMsg);
+            sqlite3_free(errorMsg);
+            result = -1;
+        } else if (!isQuery) {
+            result = sqlite3_changes(db);
+        }
+        sqlite3_close(db);
+        return result;
+    }
+#endif
+
+#ifdef DB_MYSQL
+    if (settings.system.compare("mysql") == 0) {
+        MYSQL * db = mysql_init(NULL);
+        MYSQL_RES * queryResult;
+        MYSQL_ROW row;
+        long result = -1;
+
+        if (db == NULL || mysql_real_connect(db, settings.host.c_str(), settings.user.c_str(), settings.pwd.c_str(), 
+                settings.dbase.c_str(), atoi(settings.port.c_str()), 
+                (settings.socket.length() > 0) ? settings.socket.c_str() : NULL, 0) == NULL) {
+            printf("Could not connect to mysql: %s\n", (db != NULL) ? mysql_error(db) : "no memory");
+            if (db != NULL) 
+                mysql_close(db);
+            return -1;
+        }
+        if (mysql_query(db, statement.c_str()) != 0) {
+            printf("%s: %s\n", statement.c_str(), mysql_error(db));
+        } else if (isQuery) {
+            queryResult = mysql_store_result(db);
+            if (queryResult != NULL) {
+                row = mysql_fetch_row(queryResult);
+                if (row != NULL && row[0] != NULL) 
+                    result = atol(row[0]);
+                mysql_free_result(queryResult);
+            }
+        } else {
+            result = (long) mysql_affected_rows(db);
+        }
+        mysql_close(db);
+        return result;
+    }
+#endif
+
+    return -2;
+}
+
+/* Table name quoted for the statements of executeStatement (`name` for mysql, 
+ * "name" for sqlite3), each part of db.table separately; empty if the name 
+ * contains quotes, semicolons or control characters */
+string quoteTableName(ingestSettings & settings, string name) {
+    string quote = (settings.system.compare("mysql") == 0) ? "`" : "\"";
+    string quoted;
+    size_t start, end;
+
+    if (name.length() == 0 || name.find_first_of("\"'`;\\") != string::npos) {
+        return "";
+    }
+    for (size_t i = 0; i < name.length(); i++) {
+        if ((unsigned char) name[i] < 0x20) 
+            return "";
+    }
+
+    start = 0;
+    while (true) {
+        end = name.find('.', start);
+        if (end == start || start == name.length()) {
+            return "";
+        }
+        quoted += quote + name.substr(start, (end == string::npos) ? string::npos : end - start) + quote;
+        if (end == string::npos) 
+            break;
+        quoted += ".";
+        start = end + 1;
+    }
+
+    return quoted;
+}
+
+/* Before resuming at a checkpoint: the rows before it must all be in the table
+ * (else the earlier run was rolled back, and the file is started from scratch),
+ * the rows after it may be there partly and are removed */
+bool cleanupForResume(ingestSettings & settings, pmssCheckpoint & checkpoint, long fileRowBase, long dataStart) {
+    stringstream countStatement;
+    stringstream deleteStatement;
+    string table;
+    long numRows;
+    long numDeleted;
+
+    // the name goes into a delete statement, so nothing but a plain name is accepted
+    table = quoteTableName(settings, settings.table);
+    if (table.length() == 0) {
+        printf("Journal: table name '%s' cannot be used for cleaning up (quotes, semicolons or an empty part).\n", 
+            settings.table.c_str());
+        return false;
+    }
+
+    countStatement << "select count(*) from " << table << " where fileRowId >= " << fileRowBase 
+        << " and fileRowId < " << checkpoint.fileRowId;
+    numRows = (checkpoint.rowsBefore > 0) ? executeStatement(settings, countStatement.str(), true) : 0;
+
+    if (numRows == -2 || !settings.resumeCleanup) {
+        deleteStatement << "delete from " << table << " where fileRowId >= " << checkpoint.fileRowId 
+            << " and fileRowId < " << (long) (fileRowBase + settings.idfactor);
+        if (!settings.resumeCleanup) {
+            printf("Journal: resuming without cleanup, expecting that this was done:\n   %s\n", deleteStatement.str().c_str());
+            return true;
+        }
+        printf("Journal: cannot clean up with database system %s, please check and run:\n   %s\n   %s (expect %ld)\n"
+            "and resume with --resumeCleanup 0.\n", settings.system.c_str(), deleteStatement.str().c_str(), 
+            countStatement.str().c_str(), checkpoint.rowsBefore);
+        return false;
+    }
+    if (numRows < 0) {
+        return false;
+    }
+
+    if (numRows != checkpoint.rowsBefore) {
+        printf("Journal: found %ld instead of %ld rows before the checkpoint, starting %s from the beginning.\n", 
+            numRows, checkpoint.rowsBefore, checkpoint.dataFile.c_str());
+        checkpoint.blockOffset = dataStart;
+        checkpoint.row = 0;
+        checkpoint.fileRowId = fileRowBase;
+        checkpoint.rowsBefore = 0;
+    }
+
+    deleteStatement << "delete from " << table << " where fileRowId >= " << checkpoint.fileRowId 
+        << " and fileRowId < " << (long) (fileRowBase + settings.idfactor);
+    numDeleted = executeStatement(settings, deleteStatement.str(), false);
+    if (numDeleted < 0) {
+        return false;
+    }
+    printf("Journal: removed %ld rows after the checkpoint (row %ld).\n", numDeleted, checkpoint.row);
+
+    return true;
+}
+
+/* Where to start ingesting a file when keeping a journal: at the beginning, 
+ * or with resume at its last checkpoint. Returns false if the file was 
+ * completely ingested before. */
+bool startJournal(PmssJournal * journal, PmssReader * reader, string dataFile, ingestSettings & settings) {
+    pmssCheckpoint checkpoint;
+    long fileRowBase = (long) (reader->getFileNum() * settings.idfactor);
+
+    if (settings.resume && journal->read(checkpoint)) {
+        if (checkpoint.done) {
+            printf("Journal: %s was ingested completely before, skipping it.\n", dataFile.c_str());
+            return false;
+        }
+    } else {
+        if (settings.resume) {
+            printf("Journal: no checkpoint for %s, starting at the beginning.\n", dataFile.c_str());
+        }
+        checkpoint.dataFile = dataFile;
+        checkpoint.blockOffset = reader->getDataStart();
+        checkpoint.row = 0;
+        checkpoint.fileRowId = fileRowBase;
+        checkpoint.rowsBefore = 0;
+        checkpoint.done = false;
+    }
+
+    if (settings.resume) {
+        if (!cleanupForResume(settings, checkpoint, fileRowBase, reader->getDataStart())) {
+            PmssIngest_error("Journal: Could not prepare the table for resuming.\n");
+        }
+        if (checkpoint.row > 0 && !reader->seekBlock(checkpoint.blockOffset, checkpoint.row)) {
+            PmssIngest_error("Journal: Could not seek to the data block of the checkpoint.\n");
+        }
+    }
+
+    journal->begin(checkpoint);
+    printf("Journal: %s\n", journal->getJournalFile().c_str());
+
+    return true;
+}
+
+/* Several sample rates: the file is read and decoded once, keeping the particles 
+ * of the largest sample; the splitter hands each sample on to its own reader, 
+ * which is ingested into its own table over its own connection. Returns the 
+ * number of rows ingested into all tables. */
+long ingestSamples(string dataFile, ingestSettings & settings, PmssSchemaMapper * thisSchemaMapper, PmssReader * thisReader) {
+    DBServer::DBAdaptorsFactory adaptorFac;
+    vector<PmssSample> samples;
+    vector<DBDataSchema::Schema *> schemas;
+    vector<PmssReader *> readers;
+    vector<DBServer::DBAbstractor *> dbServers;
+    vector<DBIngest::DBIngestor *> ingestors;
+    boost::thread_group ingestThreads;
+    PmssSample largest;
+    double maxFraction;
+    long rowsIngested;
+    size_t i;
+
+    maxFraction = 0;
+    for (i = 0; i < settings.sampleTables.size(); i++) {
+        PmssSample sample;
+        sample.setFraction(settings.sampleTables[i].fraction);
+        samples.push_back(sample);
+        if (sample.getFraction() > maxFraction) 
+            maxFraction = sample.getFraction();
+    }
+    largest.setFraction(maxFraction);
+    thisReader->setSample(largest);
+
+    PmssSampleSplitter splitter(samples, (settings.queueDepth > 0) ? settings.queueDepth : 1);
+
+    for (i = 0; i < samples.size(); i++) {
+        schemas.push_back(thisSchemaMapper->generateSchema(settings.dbase, settings.sampleTables[i].table));
+        readers.push_back(new PmssReader(dataFile, settings.swap, settings.snapnum, settings.idfactor, settings.nrecord, 0, -1, false));
+        readers[i]->setFeed(splitter.getQueue(i));
+        readers[i]->setDerived(settings.derived);
+        dbServers.push_back(adaptorFac.getDBAdaptors(settings.system));
+        ingestors.push_back(new DBIngest::DBIngestor(schemas[i], readers[i], dbServers[i]));
+        setupConnection(ingestors[i], settings);
+        ingestors[i]->setPerformanceMeter(settings.outputFreq);
+        ingestThreads.create_thread(boost::bind(&DBIngest::DBIngestor::ingestData, ingestors[i], settings.bufferSize));
+    }
+
+    splitter.run(thisReader);
+    ingestThreads.join_all();
+
+    rowsIngested = 0;
+    for (i = 0; i < samples.size(); i++) {
+        printf("Sample %g: %ld rows ingested into %s.\n", samples[i].getFraction(), readers[i]->getNumRowsInside(), 
+            settings.sampleTables[i].table.c_str());
+        rowsIngested += readers[i]->getNumRowsInside();
+
+        delete ingestors[i];
+        delete dbServers[i];
+        delete readers[i];
+        delete schemas[i];
+    }
+
+    return rowsIngested;
+}
+
+/* Read one data file and send its particles to the database */
+void ingestFile(string dataFile, int part, ingestSettings & settings, PmssSchemaMapper * thisSchemaMapper, 
+                DBServer::DBAbstractor * dbServer, ingestSummary & summary) {
+    DBDataSchema::Schema * thisSchema;
+    DBIngest::DBIngestor * pmssIngestor;
+    PmssJournal * journal = NULL;
+    double startTime;
+
+    startTime = wallTime();
+
+    // files outside of the region are not opened for reading
+    int fileNum;
+    if (settings.region.isSet() && !PmssReader::fileInRegion(dataFile, settings.swap, settings.region, settings.withOverlap, &fileNum)) {
+        printf("File %s is outside of the region, skipping it.\n", dataFile.c_str());
+        summary.fileName = dataFile;
+        summary.fileNum = fileNum;
+        summary.rowsRead = 0;
+        summary.rowsIngested = 0;
+        summary.rowsOnBoundary = -1;
+        summary.seconds = wallTime() - startTime;
+        summary.readerWait = 0.;
+        summary.ingestWait = 0.;
+        summary.done = true;
+        return;
+    }
+
+    thisSchema = thisSchemaMapper->generateSchema(settings.dbase, settings.table);
+
+    printf("main: call reader ...\n");
+    PmssReader * thisReader = new PmssReader(dataFile, settings.swap, settings.snapnum, settings.idfactor, settings.nrecord, settings.startRow, settings.maxRows, settings.useMmap);         
+    thisReader->setDecodeThreads(settings.decodeThreads);
+    thisReader->setQueueDepth(settings.queueDepth);
+    thisReader->setPhkeyLevel(settings.phkeyLevel);
+    thisReader->setSort(settings.sortBy, settings.sortMemory, settings.sortDir, settings.sortThreads);
+    thisReader->setBlockPartition(part, settings.numParts);
+    if (settings.region.isSet() || settings.withOverlap) {
+        thisReader->setRegion(settings.region, settings.withOverlap);
+    }
+    if (settings.derived.size() > 0) {
+        thisReader->setDerived(settings.derived);
+    }
+    if (settings.sampleTables.size() == 1) {
+        PmssSample sample;
+        sample.setFraction(settings.sampleTables[0].fraction);
+        thisReader->setSample(sample);
+    }
+
+    if (settings.journalDir.length() > 0) {
+        journal = new PmssJournal(settings.journalDir, dataFile, part, settings.bufferSize);
+        if (!startJournal(journal, thisReader, dataFile, settings)) {
+            summary.fileName = dataFile;
+            summary.fileNum = thisReader->getFileNum();
+            summary.rowsRead = 0;
+            summary.rowsIngested = 0;
+            summary.rowsOnBoundary = 0;
+            summary.seconds = wallTime() - startTime;
+            summary.readerWait = 0.;
+            summary.ingestWait = 0.;
+            summary.done = true;
+            delete journal;
+            delete thisReader;
+            delete thisSchema;
+            return;
+        }
+        thisReader->setJournal(journal);
+    }
+    
+    long rowsIngested = -1;
+    if (settings.exportFormat.length() > 0) {
+        exportFile(dataFile, part, settings, thisSchema, thisReader);
+    } else if (settings.sampleTables.size() > 1) {
+        rowsIngested = ingestSamples(dataFile, settings, thisSchemaMapper, thisReader);
+    } else {
+        pmssIngestor = new DBIngest::DBIngestor(thisSchema, thisReader, dbServer);
+        setupConnection(pmssIngestor, settings);
+       
+        //now ingest data after setup
+        pmssIngestor->setPerformanceMeter(settings.outputFreq);	// after how many lines should I print the status?
+        pmssIngestor->ingestData(settings.bufferSize);  		// buffer size (in bytes??)
+
+        delete pmssIngestor;
+
+        // everything is committed now
+        if (journal != NULL) {
+            journal->finish();
+        }
+    }
+
+    summary.fileName = dataFile;
+    summary.fileNum = thisReader->getFileNum();
+    summary.rowsRead = thisReader->getNumRowsRead();
+    summary.rowsIngested = (rowsIngested >= 0) ? rowsIngested : thisReader->getNumRowsInside();
+    // counted before the region and sample are applied, so only meaningful without them
+    summary.rowsOnBoundary = (settings.region.isSet() || settings.sampleTables.size() > 0) ? -1 : thisReader->getNumRowsOnBoundary();
+    summary.seconds = wallTime() - startTime;
+    summary.readerWait = thisReader->getReaderWait();
+    summary.ingestWait = thisReader->getIngestWait();
+    summary.done = true;
+    PmssMetrics::count(METRIC_FILES_DONE, 1);
+
+    if (summary.rowsOnBoundary >= 0) {
+        printf("Skipped %ld particles lying exactly on a boundary to a neighbouring subbox (ingested from there).\n", 
+            summary.rowsOnBoundary);
+    }
+    if (settings.region.isSet()) {
+        printf("Skipped %ld data blocks outside of the region.\n", thisReader->getNumBlocksSkipped());
+    }
+
+    if (settings.queueDepth > 0 || settings.decodeThreads > 1) {
+        printf("Stalls: reading waited %.2f s for the database, database waited %.2f s for reading.\n", 
+            summary.readerWait, summary.ingestWait);
+    }
+
+    delete thisReader;
+    delete thisSchema;
+    if (journal != NULL) {
+        delete journal;
+    }
+}
+
+/* Take files from the queue until it is empty. Each worker has its own 
+ * database adaptor, so files are ingested over separate connections. */
+void ingestWorker(int worker, PmssFileQueue * fileQueue, ingestSettings * settings, 
+                  PmssSchemaMapper * thisSchemaMapper, vector<ingestSummary> * summaries) {
+    DBServer::DBAdaptorsFactory adaptorFac;
+    DBServer::DBAbstractor * dbServer;
+    string dataFile;
+    long index;
+    int part;
+
+    // no database needed when writing files
+    dbServer = NULL;
+    if (settings->exportFormat.length() == 0) {
+        dbServer = adaptorFac.getDBAdaptors(settings->system);
+    }
+
+    while (fileQueue->nextFile(dataFile, index, part)) {
+        printf("Worker %d: ingesting part %d of file %ld of %ld: %s\n", worker, part, index/fileQueue->getNumParts()+1, fileQueue->size(), dataFile.c_str());
+        (*summaries)[index].worker = worker;
+        ingestFile(dataFile, part, *settings, thisSchemaMapper, dbServer, (*summaries)[index]);
+        printf("Worker %d: finished %s (%ld rows in %.1f s)\n", worker, dataFile.c_str(), 
+            (*summaries)[index].rowsIngested, (*summaries)[index].seconds);
+    }
+
+    if (dbServer != NULL) {
+        delete dbServer;
+    }
+}
+
+/* Catalog mode: scan files from the queue until it is empty */
+void catalogWorker(int worker, PmssFileQueue * fileQueue, PmssCatalog * catalog) {
+    string dataFile;
+    long index;
+    int part;
+
+    while (fileQueue->nextFile(dataFile, index, part)) {
+        catalog->scanFile(index);
+    }
+}
+
+void printSummary(vector<ingestSummary> & summaries, double seconds) {
+    long rowsRead, rowsIngested, rowsOnBoundary;
+    bool haveOnBoundary;
+    char onBoundary[64];
+    long numDone;
+    size_t i;
+
+    rowsRead = 0;
+    rowsIngested = 0;
+    rowsOnBoundary = 0;
+    haveOnBoundary = true;
+    numDone = 0;
+
+    printf("\nSummary:\n");
+    printf("%-40s %4s %8s %6s %14s %14s %12s %10s %12s %10s %10s\n", "file", "part", "nodeNum", "worker", "rows read", "rows ingested", "on boundary", "time [s]", "rows/s", "read wait", "db wait");
+    for (i = 0; i < summaries.size(); i++) {
+        ingestSummary & s = summaries[i];
+        if (!s.done) {
+            printf("%-40s not done\n", s.fileName.c_str());
+            continue;
+        }
+        if (s.rowsOnBoundary >= 0) {
+            snprintf(onBoundary, sizeof(onBoundary), "%ld", s.rowsOnBoundary);
+        } else {
+            strcpy(onBoundary, "-");
+        }
+        printf("%-40s %4d %8d %6d %14ld %14ld %12s %10.1f %12.0f %10.1f %10.1f\n", s.fileName.c_str(), s.part, s.fileNum, s.worker, 
+            s.rowsRead, s.rowsIngested, onBoundary, s.seconds, s.seconds > 0 ? s.rowsIngested / s.seconds : 0., s.readerWait, s.ingestWait);
+        rowsRead += s.rowsRead;
+        rowsIngested += s.rowsIngested;
+        if (s.rowsOnBoundary >= 0) {
+            rowsOnBoundary += s.rowsOnBoundary;
+        } else {
+            haveOnBoundary = false;
+        }
+        numDone++;
+    }
+    // without a region or sample, the particles on a boundary are the duplicates that were skipped
+    if (haveOnBoundary) {
+        snprintf(onBoundary, sizeof(onBoundary), ", %ld duplicates on boundaries skipped", rowsOnBoundary);
+    } else {
+        onBoundary[0] = 0;
+    }
+    printf("Total: %ld of %ld files/parts, %ld rows read, %ld rows ingested%s, in %.1f s (%.0f rows/s)\n", 
+        numDone, (long) summaries.size(), rowsRead, rowsIngested, onBoundary, seconds, seconds > 0 ? rowsIngested / seconds : 0.);
+}
+
 int main (int argc, const char * argv[])
 {
-    string dataFile;
+    vector<string> dataFiles;
+    string fileList;
+    int numThreads;
+    int decodeThreads;
+    int queueDepth;
+    int numParts;
+    int phkeyLevel;
+    string phkeyReference;
+    string sortBy;
+    long sortMemory;
+    string sortDir;
+    int sortThreads;
+    string decodeKernel;
+    int decompressThreads;
+    int decompressAhead;
+    string exportFormat;
+    string exportPath;
+    long exportMaxSize;
+    int logLevel;
+    string metricsFile;
+    string metricsFormat;
+    double metricsInterval;
+    string metricsLabel;
+    string indexDir;
+    string journalDir;
+    bool resume;
+    bool resumeCleanup;
+    string catalogFile;
+    string catalogFormat;
+    bool validate;
+    string regionText;
+    PmssRegion region;
+    string sampleText;
+    vector<pmssSampleTable> sampleTables;
+    string derivedText;
+    PmssDerived derived;
+    bool withOverlap;
     int snapnum;
     int level;
     int swap;
@@ -50,8 +723,8 @@ int main (int argc, const char * argv[])
     
     // allow to use only some part of the data file, 
     // i.e. specify offset and maximum number of rows:
-    int startRow;
-    int maxRows;
+    long startRow;
+    long maxRows;
 
     string dbase;
     string table;
@@ -68,10 +741,10 @@ int main (int argc, const char * argv[])
 //    bool greedyDelim;
 //    bool isDryRun;
     bool resumeMode;
-    
-    DBServer::DBAbstractor * dbServer;
-    DBIngest::DBIngestor * pmssIngestor;
-    DBServer::DBAdaptorsFactory adaptorFac;
+    bool useMmap;
+
+    ingestSettings settings;
+    PmssFileQueue fileQueue;
 
 
     //build database string
@@ -94,13 +767,54 @@ int main (int argc, const char * argv[])
 #endif
     
     dbSystemDesc.append(") - [default: mysql]");
+
+    //build export format string
+    string exportDesc = "do not ingest, but write files for bulk loading in this format (";
+    exportDesc.append("tsv (LOAD DATA INFILE), pgcopy (COPY ... WITH (FORMAT binary)), bcp (native, with format file)");
+#ifdef PMSS_ARROW
+    exportDesc.append(", arrow (IPC file)");
+#endif
+    exportDesc.append(")");
     
     
-    po::options_description progDesc("PMssIngest - Ingest binary PMss (written from Gadget file) into database\n(Expect format as used by Anatoly Klypin)\n\nPmssIngest [OPTIONS] [dataFile]\n\nCommand line options:");
+    po::options_description progDesc("PMssIngest - Ingest binary PMss (written from Gadget file) into database\n(Expect format as used by Anatoly Klypin)\n\nPmssIngest [OPTIONS] [dataFile(s)]\n\nCommand line options:");
         
     progDesc.add_options()
                 ("help,?", "output help")
-                ("data,d", po::value<string>(&dataFile), "datafile to ingest")
+                ("data,d", po::value<vector<string> >(&dataFiles)->composing(), "datafile(s) to ingest; can also be a directory or a pattern like 'PMss.*'")
+                ("fileList", po::value<string>(&fileList)->default_value(""), "text file listing the datafiles to ingest, one per line")
+                ("threads", po::value<int32_t>(&numThreads)->default_value(1), "number of files ingested in parallel, each with its own reader and database connection [default: 1]")
+                ("decodeThreads", po::value<int32_t>(&decodeThreads)->default_value(1), "number of threads decoding the data blocks of one file, rows keep their order [default: 1]")
+                ("queueDepth", po::value<int32_t>(&queueDepth)->default_value(2), "number of decoded data blocks the reading thread may be ahead of the database, 0 for reading in the same thread [default: 2]")
+                ("decodeKernel", po::value<string>(&decodeKernel)->default_value("auto"), "decoding kernel for byteswap and boundary check: auto, scalar, ssse3, avx2 [default: auto]")
+                ("decompressThreads", po::value<int32_t>(&decompressThreads)->default_value(4), "threads decompressing a compressed data file (.zst with several frames, .xz with several blocks) [default: 4]")
+                ("decompressAhead", po::value<int32_t>(&decompressAhead)->default_value(4), "number of decompressed chunks (4 MB) or frames the decompression may be ahead of reading [default: 4]")
+                ("export", po::value<string>(&exportFormat)->default_value(""), exportDesc.c_str())
+                ("exportPath", po::value<string>(&exportPath)->default_value("."), "directory for the export files [default: .]")
+                ("exportMaxSize", po::value<long>(&exportMaxSize)->default_value(0), "start a new export file after this many MB, 0 for no limit [default: 0]")
+                ("phkeyLevel", po::value<int32_t>(&phkeyLevel)->default_value(0), "compute phkey (Peano-Hilbert key) with this many bits per dimension (1-10), 0 for NULL [default: 0]")
+                ("phkeyReference", po::value<string>(&phkeyReference)->default_value(""), "do not ingest, but compare the phkeys with reference keys from libhilbert in this file (lines: level box x y z key) [default: none]")
+                ("sortBy", po::value<string>(&sortBy)->default_value("none"), "ingest the particles of each file sorted by phkey (needs phkeyLevel) or id instead of in file order: none, phkey, id [default: none]")
+                ("sortMemory", po::value<long>(&sortMemory)->default_value(1024), "memory for sorting in MB, runs that do not fit are written to sortDir [default: 1024]")
+                ("sortDir", po::value<string>(&sortDir)->default_value("/tmp"), "directory for the scratch files of sorting [default: /tmp]")
+                ("sortThreads", po::value<int32_t>(&sortThreads)->default_value(2), "number of threads sorting and writing runs [default: 2]")
+                ("logLevel", po::value<int32_t>(&logLevel)->default_value(PMSS_LOG_INFO), "0: errors only, 1: warnings, 2: info, 3: debug (messages for each data block) [default: 2]")
+                ("metricsFile", po::value<string>(&metricsFile)->default_value(""), "write performance metrics (bytes, rows, times, batch latency) periodically into this file [default: none]")
+                ("metricsFormat", po::value<string>(&metricsFormat)->default_value("json"), "format of the metrics file: json (one line appended per interval) or prom (Prometheus text format, replaced each interval) [default: json]")
+                ("metricsInterval", po::value<double>(&metricsInterval)->default_value(10.), "seconds between writing the metrics [default: 10]")
+                ("metricsLabel", po::value<string>(&metricsLabel)->default_value(""), "label identifying this run in the metrics [default: pmssingest_<pid>]")
+                ("journalDir", po::value<string>(&journalDir)->default_value(""), "keep a journal for each file in this directory, with the last data block that is certainly in the database [default: none]")
+                ("resume", po::value<bool>(&resume)->default_value(0), "continue each file at its checkpoint in the journal, skip files that were done (needs journalDir) [default: 0]")
+                ("resumeCleanup", po::value<bool>(&resumeCleanup)->default_value(1), "with resume: check the rows before the checkpoint and delete the rows after it (sqlite3 and mysql only), 0 if that was done by hand [default: 1]")
+                ("catalog", po::value<string>(&catalogFile)->default_value(""), "do not ingest, but write a manifest of the data files into this file: header, boundaries, data blocks and inconsistencies; only headers are read [default: none]")
+                ("catalogFormat", po::value<string>(&catalogFormat)->default_value("json"), "format of the manifest: json or csv [default: json]")
+                ("validate", po::value<bool>(&validate)->default_value(0), "do not ingest, but read all data blocks and check them: skipints, Np, NaN and positions outside of the file; count the particles inside and compute a checksum of each file; writes a manifest if catalog is given [default: 0]")
+                ("region", po::value<string>(&regionText)->default_value(""), "only ingest particles in this region, box:xMin,xMax,yMin,yMax,zMin,zMax or sphere:x,y,z,radius; files and data blocks outside of it are skipped (the bounds of the blocks are kept in the block index) [default: all]")
+                ("overlap", po::value<bool>(&withOverlap)->default_value(0), "also ingest the particles in the overlap region (dBuffer) around the subbox of each file, which are ingested from the neighbouring files as well [default: 0]")
+                ("sample", po::value<string>(&sampleText)->default_value(""), "only ingest a deterministic subsample of the particles (taken by a hash of the id, the same particles in each file and snapshot): a fraction (0-1), or fraction:table,fraction:table,... to ingest several samples into separate tables, reading each file only once [default: all]")
+                ("derived", po::value<string>(&derivedText)->default_value(""), "add columns computed from x, y, z, vx, vy, vz and the header constants (aexpn, redshift, Omega0, OmegaL0, hubble, box, particleMass, Hz) as name=expression;name=expression;..., e.g. \"vAbs=sqrt(vx*vx+vy*vy+vz*vz);zRsd=z+vz/(aexpn*Hz)\" [default: none]")
+                ("indexDir", po::value<string>(&indexDir)->default_value(""), "directory for the block index files (<datafile>.idx), none for not keeping them [default: next to the data files]")
+                ("fileParts", po::value<int32_t>(&numParts)->default_value(1), "split each file into this many parts (every n-th data block), ingested in parallel like separate files; rows are not in file order anymore [default: 1]")
                 ("system,s", po::value<string>(&system)->default_value("mysql"), dbSystemDesc.c_str())
                 ("bufferSize,B", po::value<uint32_t>(&bufferSize)->default_value(128), "ingest buffer size (will be reduced to sytem maximum if needed) [default: 128]")
                 ("outputFreq,F", po::value<uint32_t>(&outputFreq)->default_value(100000), "number of rows after which a performance measurement is output [default: 100000]")
@@ -113,14 +827,15 @@ int main (int argc, const char * argv[])
                 ("host,H", po::value<string>(&host)->default_value("localhost"), "host to use for database access (where applicable) [default: localhost]")
                 ("path,p", po::value<string>(&path)->default_value(""), "path to a database file (mainly for sqlite3, where applicable)")
 //                ("snapnum,M", po::value<int32_t>(&snapnum)->default_value(0), "number of snapshot (needed for fofIds)")
-                ("startRow,i", po::value<int32_t>(&startRow)->default_value(0), "start reading at this initial row number (default 0)")
-                ("maxRows,m", po::value<int32_t>(&maxRows)->default_value(-1), "max. number of rows to be read (default -1 for all rows)")
-                ("swap,w", po::value<int32_t>(&swap)->default_value(0), "flag for byte swapping (default 0)")
+                ("startRow,i", po::value<long>(&startRow)->default_value(0), "start reading at this initial row number (default 0)")
+                ("maxRows,m", po::value<long>(&maxRows)->default_value(-1), "max. number of rows to be read (default -1 for all rows)")
+                ("swap,w", po::value<int32_t>(&swap)->default_value(-1), "flag for byte swapping, -1: detect it from the record markers of each file (default -1)")
                 ("resumeMode,R", po::value<bool>(&resumeMode)->default_value(0), "try to resume ingest on failed connection (turns off transactions)? [default: 0]")                
+                ("mmap", po::value<bool>(&useMmap)->default_value(0), "map the data file into memory instead of reading it as a stream [default: 0]")
                 ;
 
     po::positional_options_description posDesc;
-    posDesc.add("data", 1);
+    posDesc.add("data", -1);
     
     //read out the options
     po::variables_map varMap;
@@ -129,13 +844,171 @@ int main (int argc, const char * argv[])
     // --> only compiles at erebos if I include the (char **) cast
     po::notify(varMap);
     
-    if(varMap.count("help") || varMap.count("?") || dataFile.length() == 0) {
+    if (phkeyReference.length() > 0) {
+        return (PmssHilbert::checkReference(phkeyReference) == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if(varMap.count("help") || varMap.count("?") || (dataFiles.size() == 0 && fileList.length() == 0)) {
         cout << progDesc;
         return EXIT_SUCCESS;
     }
+
+    fileQueue.addPaths(dataFiles);
+    if (fileList.length() > 0) {
+        fileQueue.addListFile(fileList);
+    }
+    if (fileQueue.size() == 0) {
+        PmssIngest_error("No data file found to ingest.\n");
+    }
+    if ((fileQueue.size() > 1 || numParts > 1) && startRow > 0) {
+        PmssIngest_error("startRow can only be used when ingesting a single data file as a whole.\n");
+    }
+    fileQueue.setNumParts(numParts);
+    if (exportFormat.length() > 0) {
+        PmssBulkWriter * testWriter = PmssBulkWriter::create(exportFormat, "", 0);
+        if (testWriter == NULL) {
+            PmssIngest_error("Unknown export format.\n");
+        }
+        delete testWriter;
+    }
+    if (resume && journalDir.length() == 0) {
+        PmssIngest_error("resume needs a journalDir.\n");
+    }
+    if (journalDir.length() > 0 && (numParts > 1 || startRow > 0 || exportFormat.length() > 0 
+            || PmssSorter::getSortBy(sortBy) != PmssSorter::SORT_NONE)) {
+        PmssIngest_error("journalDir can only be used when ingesting whole files in file order into the database (no fileParts, startRow, export or sortBy).\n");
+    }
+    if (PmssSorter::getSortBy(sortBy) < 0) {
+        PmssIngest_error("Unknown sortBy, use none, phkey or id.\n");
+    }
+    if (PmssSorter::getSortBy(sortBy) == PmssSorter::SORT_PHKEY && phkeyLevel <= 0) {
+        PmssIngest_error("Sorting by phkey needs a phkeyLevel.\n");
+    }
+    if (!region.parse(regionText)) {
+        PmssIngest_error("Could not parse region, use box:xMin,xMax,yMin,yMax,zMin,zMax or sphere:x,y,z,radius.\n");
+    }
+    if (sampleText.length() > 0 && !parseSampleTables(sampleText, sampleTables)) {
+        PmssIngest_error("Could not parse sample, use a fraction (0-1) or fraction:table,fraction:table,...\n");
+    }
+    if (sampleTables.size() > 1 && (exportFormat.length() > 0 || journalDir.length() > 0)) {
+        PmssIngest_error("Several samples can only be ingested into the database, without journalDir and export.\n");
+    }
+    if (sampleTables.size() == 1 && sampleTables[0].table.length() > 0) {
+        table = sampleTables[0].table;
+    }
+    string derivedError;
+    if (!derived.parse(derivedText, &derivedError)) {
+        printf("Derived columns: %s.\n", derivedError.c_str());
+        PmssIngest_error("Could not parse derived, use name=expression;name=expression;...\n");
+    }
+    if (!PmssBlockDecoder::setKernel(decodeKernel)) {
+        PmssIngest_error("Unknown decodeKernel or not supported by this CPU.\n");
+    }
+    PmssCompressedSource::setDecompression(decompressThreads, decompressAhead);
+    PmssBlockIndex::setIndexDir(indexDir);
+    if (!PmssMetricsExporter::isFormat(metricsFormat)) {
+        PmssIngest_error("Unknown metricsFormat, use json or prom.\n");
+    }
+    if (metricsLabel.length() == 0) {
+        char pidStr[32];
+        snprintf(pidStr, sizeof(pidStr), "pmssingest_%ld", (long) getpid());
+        metricsLabel = pidStr;
+    }
+    setLogLevel(logLevel);
+    if (numThreads < 1) {
+        numThreads = 1;
+    }
+    if (numThreads > fileQueue.numTasks()) {
+        numThreads = fileQueue.numTasks();
+    }
+
+    if (catalogFile.length() > 0 || validate) {
+        if (!PmssCatalog::isFormat(catalogFormat)) {
+            PmssIngest_error("Unknown catalogFormat, use json or csv.\n");
+        }
+        if (numParts > 1) {
+            PmssIngest_error("catalog and validate always scan whole files, do not use fileParts.\n");
+        }
+
+        vector<string> fileNames;
+        for (long i = 0; i < fileQueue.size(); i++) {
+            fileNames.push_back(fileQueue.getFile(i));
+        }
+        PmssCatalog catalog(fileNames, swap);
+        catalog.setValidate(validate);
+
+        double startTime = wallTime();
+        boost::thread_group workers;
+        for (int i = 0; i < numThreads; i++) {
+            workers.create_thread(boost::bind(&catalogWorker, i, &fileQueue, &catalog));
+        }
+        workers.join_all();
+
+        if (catalogFile.length() > 0 && !catalog.write(catalogFile, catalogFormat)) {
+            return EXIT_FAILURE;
+        }
+        catalog.printSummary();
+        if (catalogFile.length() > 0) {
+            printf("Manifest of %ld files written to %s in %.1f s.\n", catalog.getNumFiles(), catalogFile.c_str(), wallTime() - startTime);
+        } else {
+            printf("%ld files checked in %.1f s.\n", catalog.getNumFiles(), wallTime() - startTime);
+        }
+
+        return (catalog.getNumFilesWithErrors() > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
     
     cout << "You have entered the following parameters:" << endl;
-    cout << "Data file: " << dataFile << endl;
+    if (fileQueue.size() == 1) {
+        cout << "Data file: " << fileQueue.getFile(0) << endl;
+    } else {
+        cout << "Data files: " << fileQueue.size() << " (" << fileQueue.getFile(0) << " ... " << fileQueue.getFile(fileQueue.size()-1) << ")" << endl;
+    }
+    if (fileQueue.numTasks() > 1) {
+        cout << "Parallel ingest threads: " << numThreads << endl;
+    }
+    if (numParts > 1) {
+        cout << "Parts per file: " << numParts << endl;
+    }
+    if (region.isSet()) {
+        cout << "Region: " << region.describe() << endl;
+    }
+    if (withOverlap) {
+        cout << "Including the overlap regions" << endl;
+    }
+    for (size_t i = 0; i < derived.size(); i++) {
+        cout << "Derived column: " << derived.getName(i) << " = " << derived.getExpression(i) << endl;
+    }
+    for (size_t i = 0; i < sampleTables.size(); i++) {
+        cout << "Sample: " << sampleTables[i].fraction;
+        if (sampleTables.size() > 1) {
+            cout << " into table " << sampleTables[i].table;
+        }
+        cout << endl;
+    }
+    if (decodeThreads > 1) {
+        cout << "Decoding threads per file: " << decodeThreads << endl;
+    }
+    cout << "Read ahead queue depth: " << queueDepth << endl;
+    if (phkeyLevel > 0) {
+        cout << "phkey level: " << phkeyLevel << endl;
+    }
+    if (PmssSorter::getSortBy(sortBy) != PmssSorter::SORT_NONE) {
+        cout << "Sorted by: " << sortBy << " (" << sortMemory << " MB, scratch files in " << sortDir << ")" << endl;
+    }
+    cout << "Decoding kernel: " << PmssBlockDecoder::getKernelName() << endl;
+    cout << "Decompression (.gz, .xz, .zst): " << decompressThreads << " threads, " << decompressAhead << " chunks ahead" << endl;
+    if (metricsFile.length() > 0) {
+        cout << "Metrics: " << metricsFile << " (" << metricsFormat << ", every " << metricsInterval << " s, label " << metricsLabel << ")" << endl;
+    }
+    if (indexDir.length() > 0) {
+        cout << "Block index files: " << indexDir << endl;
+    }
+    if (journalDir.length() > 0) {
+        cout << "Journal: " << journalDir << (resume ? " (resuming)" : "") << endl;
+    }
+    if (exportFormat.length() > 0) {
+        cout << "Export format: " << exportFormat << " (into " << exportPath << ")" << endl;
+    }
     cout << "DB system: " << system << endl;
     cout << "Buffer size: " << bufferSize << endl;
     cout << "Performance output frequency: " << outputFreq << endl;
@@ -150,23 +1023,20 @@ int main (int argc, const char * argv[])
     }
     cout << "Port: " << port << endl;
     cout << "Host: " << host << endl;
-    cout << "Path: " << path << endl << endl;
+    cout << "Path: " << path << endl;
+    cout << "Memory mapped file: " << useMmap << endl << endl;
    
     DBAsserter::AsserterFactory * assertFac = new DBAsserter::AsserterFactory;
     DBConverter::ConverterFactory * convFac = new DBConverter::ConverterFactory;
     PmssSchemaMapper * thisSchemaMapper = new PmssSchemaMapper(assertFac, convFac);     //registering the converter and asserter factories
+    vector<string> derivedNames;
+    for (size_t i = 0; i < derived.size(); i++) {
+        derivedNames.push_back(derived.getName(i));
+    }
+    thisSchemaMapper->setDerivedColumns(derivedNames);
     //PmssSchemaMapper * thisSchemaMapper = new PmssSchemaMapper();
     
-    DBDataSchema::Schema * thisSchema;
-    //thisSchema = thisSchemaMapper->generateSchema("test", "fofWorld");
-    //thisSchema = thisSchemaMapper->generateSchema("test", "fofTest");
-    //thisSchema = thisSchemaMapper->generateSchema("spider", "fof");
-
-    thisSchema = thisSchemaMapper->generateSchema(dbase, table);
-    
-    //now setup the file reader
-    //datafile = "fofTest-10.ascii"; //"miniFOF-5.ascii";
-    //dataFile = "test1.bin";
+    //now setup the file reader(s)
     //snapnum = 88;
     //aexpn = 1.0;
     //level = 1;
@@ -179,58 +1049,78 @@ int main (int argc, const char * argv[])
     //maxRows = 100;
     idfactor = 1.e11;
     nrecord = 500000;
-    printf("main: call reader ...\n");
-    PmssReader * thisReader = new PmssReader(dataFile, swap, snapnum, idfactor, nrecord, startRow, maxRows);         
-     
-    dbServer = adaptorFac.getDBAdaptors(system);
-    
-    pmssIngestor = new DBIngest::DBIngestor(thisSchema, thisReader, dbServer);
-    pmssIngestor->setUsrName(user);
-    pmssIngestor->setPasswd(pwd);
-    
-    //settings for different DBs (copy&paste from AsciiIngest)
-    if(system.compare("mysql") == 0) {
-        pmssIngestor->setSocket(socket);
-        pmssIngestor->setPort(port);
-        pmssIngestor->setHost(host);
-    } else if (system.compare("sqlite3") == 0) {
-        pmssIngestor->setHost(path);
-    } else if (system.compare("unix_sqlsrv_odbc") == 0) {
-        pmssIngestor->setSocket("DRIVER=FreeTDS;TDS_Version=7.0;");
-        //asciiIngestor->setSocket("DRIVER=SQL Server Native Client 10.0;");
-        pmssIngestor->setPort(port);
-        pmssIngestor->setHost(host);
-    } else if (system.compare("sqlsrv_odbc") == 0) {
-        pmssIngestor->setSocket("DRIVER=SQL Server Native Client 10.0;");
-        pmssIngestor->setPort(port);
-        pmssIngestor->setHost(host);
-    } else if (system.compare("sqlsrv_odbc_bulk") == 0) {
-        //TESTS ON SQL SERVER SHOWED THIS IS VERY SLOW. BUT NO CLUE WHY, DID NOT BOTHER TO LOOK AT PROFILER YET
-        pmssIngestor->setSocket("DRIVER=SQL Server Native Client 10.0;");
-        pmssIngestor->setPort(port);
-        pmssIngestor->setHost(host);
-    }  else if (system.compare("cust_odbc") == 0) {
-        pmssIngestor->setSocket(socket);
-        pmssIngestor->setPort(port);
-        pmssIngestor->setHost(host);
-    } else if (system.compare("cust_odbc_bulk") == 0) {
-        //TESTS ON SQL SERVER SHOWED THIS IS VERY SLOW. BUT NO CLUE WHY, DID NOT BOTHER TO LOOK AT PROFILER YET
-        pmssIngestor->setSocket(socket);
-        pmssIngestor->setPort(port);
-        pmssIngestor->setHost(host);
-    }  
-    
-    
-    // setup resume option, if desired
-    pmssIngestor->setResumeMode(resumeMode); 
-    
-   
-    //now ingest data after setup
-    pmssIngestor->setPerformanceMeter(outputFreq);	// after how many lines should I print the status?
-    pmssIngestor->ingestData(bufferSize);  		// buffer size (in bytes??)
+
+    settings.system = system;
+    settings.dbase = dbase;
+    settings.table = table;
+    settings.socket = socket;
+    settings.user = user;
+    settings.pwd = pwd;
+    settings.port = port;
+    settings.host = host;
+    settings.path = path;
+    settings.bufferSize = bufferSize;
+    settings.outputFreq = outputFreq;
+    settings.resumeMode = resumeMode;
+    settings.swap = swap;
+    settings.snapnum = snapnum;
+    settings.idfactor = idfactor;
+    settings.nrecord = nrecord;
+    settings.startRow = startRow;
+    settings.maxRows = maxRows;
+    settings.useMmap = useMmap;
+    settings.decodeThreads = decodeThreads;
+    settings.queueDepth = queueDepth;
+    settings.phkeyLevel = phkeyLevel;
+    settings.sortBy = PmssSorter::getSortBy(sortBy);
+    settings.sortMemory = sortMemory * 1024 * 1024;
+    settings.sortDir = sortDir;
+    settings.sortThreads = sortThreads;
+    settings.numParts = numParts;
+    settings.region = region;
+    settings.withOverlap = withOverlap;
+    settings.sampleTables = sampleTables;
+    settings.derived = derived;
+    settings.exportFormat = exportFormat;
+    settings.exportPath = exportPath;
+    settings.exportMaxSize = exportMaxSize * 1024 * 1024;
+    settings.journalDir = journalDir;
+    settings.resume = resume;
+    settings.resumeCleanup = resumeCleanup;
+
+    vector<ingestSummary> summaries(fileQueue.numTasks());
+    for (long i = 0; i < fileQueue.numTasks(); i++) {
+        summaries[i].fileName = fileQueue.getFile(i / numParts);
+        summaries[i].part = i % numParts;
+        summaries[i].done = false;
+    }
+
+    PmssMetricsExporter * metricsExporter = NULL;
+    if (metricsFile.length() > 0) {
+        metricsExporter = new PmssMetricsExporter(metricsFile, metricsFormat, metricsInterval, metricsLabel);
+        metricsExporter->start();
+    }
+
+    double startTime = wallTime();
+
+    if (numThreads == 1) {
+        ingestWorker(0, &fileQueue, &settings, thisSchemaMapper, &summaries);
+    } else {
+        boost::thread_group workers;
+        for (int i = 0; i < numThreads; i++) {
+            workers.create_thread(boost::bind(&ingestWorker, i, &fileQueue, &settings, thisSchemaMapper, &summaries));
+        }
+        workers.join_all();
+    }
+
+    if (fileQueue.numTasks() > 1) {
+        printSummary(summaries, wallTime() - startTime);
+    }
+
+    // writes the final numbers
+    delete metricsExporter;
     
     delete thisSchemaMapper;
-    delete thisSchema;
     //delete assertFac;
     //delete convFac;
 